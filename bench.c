@@ -0,0 +1,807 @@
+/*
+   bench.c
+   noise and flock micro-benchmarks, golden output regression check
+
+   usage: bench [--check] [--noise | --flock] [--reps n] [--threads n]
+                [--max size] [--boids n] [--out file]
+
+   times every noise entry point over square fields, the flock step over
+   growing boid counts and its parallel efficiency per thread count on a
+   clustered flock and the load time of a flock snapshot, reports per item
+   percentiles as json (stdout or --out) with a readable summary on stderr.
+   before timing anything the fast noise paths are checked against the
+   scalar reference, perlin() against hashes of the original
+   implementation, a snapshot against a replay of its recorded steps and
+   the simulation thread's frames against serial steps, --check stops
+   after that
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "boids.h"
+#include "fractal.h"
+#include "noise_cache.h"
+#include "perlin.h"
+#include "pool.h"
+#include "sim_thread.h"
+#include "simd.h"
+#include "simplex.h"
+#include "snapshot.h"
+
+// time the simplex3 entry points are timed and checked at
+#define SIMPLEX_T 1.25f
+
+// the snapshot check records and replays this many steps of a small flock,
+// the load is timed with a million boids
+#define SNAPSHOT_CHECK_BOIDS 2000
+#define SNAPSHOT_CHECK_STEPS 20
+#define SNAPSHOT_BOIDS (1 << 20)
+
+// the simulation thread check reads a small flock stepping every
+// millisecond for this long
+#define SIM_CHECK_BOIDS 2000
+#define SIM_CHECK_DT 0.001f
+#define SIM_CHECK_MS 50
+
+// golden output --------------------------------------------------------------
+
+// fnv-1a of perlin() over 512x512 windows at these origins, recorded from
+// the original global table implementation (seed 0)
+#define GOLDEN_SIZE 512
+
+static const struct { int y, x; uint32_t hash; } golden[] =
+{
+    {     0,    0, 0x59bb755du },
+    {  1000, 3000, 0xffd896b7u },
+    { 77777,  123, 0xc42bc35fu }
+};
+
+#define GOLDEN_COUNT (int) (sizeof(golden) / sizeof(golden[0]))
+
+static uint32_t fnv1a(const uint8_t * bytes, size_t n)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < n; i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// shared state ---------------------------------------------------------------
+
+struct bench
+{
+    perlin_ctx ctx;
+    struct pool * pool;
+    int size;               // current field edge
+
+    uint8_t * bytes;        // size * size outputs
+    float * raw;
+    float * ys;             // coordinates for the float entry points
+    float * xs;
+    float * ts;             // SIMPLEX_T everywhere, for simplex3_raw_batch
+};
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// fill the coordinate arrays the way perlin() maps pixels
+static void bench_coords(struct bench * b)
+{
+    for (int y = 0; y < b->size; y++)
+    {
+        for (int x = 0; x < b->size; x++)
+        {
+            b->ys[(size_t) y * b->size + x] = (y + 0.5) / 8;
+            b->xs[(size_t) y * b->size + x] = (x + 0.5) / 8;
+            b->ts[(size_t) y * b->size + x] = SIMPLEX_T;
+        }
+    }
+}
+
+// checks ---------------------------------------------------------------------
+
+// a fresh file for a snapshot under /tmp, path is at least 64 bytes
+static int temp_path(char * path)
+{
+    strcpy(path, "/tmp/bench_snapshot_XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Error: couldnt create %s\n", path);
+        return 0;
+    }
+    close(fd);
+    return 1;
+}
+
+// save a flock with a few noise tiles, record steps after it, then load it
+// back and replay them. returns failures
+static int check_snapshot(struct bench * b)
+{
+    char path[64];
+    if (!temp_path(path)) { return 1; }
+
+    struct boid_params params, loaded_params;
+    boid_params_default(&params);
+    struct boids * boids = boids_create(SNAPSHOT_CHECK_BOIDS);
+    struct boids * loaded = boids_create(SNAPSHOT_CHECK_BOIDS);
+    struct noise_cache * cache = noise_cache_create(16 * 4096, 0);
+    struct noise_cache * loaded_cache = noise_cache_create(16 * 4096, 0);
+    struct snapshot_recorder recorder = {0};
+    struct snapshot s = {0};
+
+    int ok = boids != NULL && loaded != NULL && cache != NULL && loaded_cache != NULL;
+    if (ok)
+    {
+        boids_spawn(boids, &params, SNAPSHOT_CHECK_BOIDS, 99);
+        for (int i = 0; i < 4; i++) { noise_cache_get(cache, &b->ctx, NULL, i, -i); }
+        ok = snapshot_write(path, boids, &params, &b->ctx, cache, 0) &&
+            snapshot_recorder_open(&recorder, path);
+    }
+    for (int i = 0; ok && i < SNAPSHOT_CHECK_STEPS; i++)
+    {
+        params.cohesion_weight = 0.5f + 0.01f * i;
+        ok = boids_step(boids, &params, 1.0f / 60.0f, b->pool) &&
+            snapshot_record(&recorder, boids, &params, 1.0f / 60.0f);
+    }
+    ok = snapshot_recorder_close(&recorder) && ok;
+
+    // the saved flock, context and tiles come back exactly
+    ok = ok && snapshot_open(&s, path) && s.record_count == SNAPSHOT_CHECK_STEPS &&
+        snapshot_restore(&s, loaded, &loaded_params) &&
+        s.ctx != NULL && memcmp(s.ctx, &b->ctx, sizeof(perlin_ctx)) == 0 &&
+        snapshot_restore_tiles(&s, loaded_cache) == 4;
+    for (int i = 0; ok && i < 4; i++)
+    {
+        ok = memcmp(noise_cache_get(loaded_cache, &b->ctx, NULL, i, -i),
+                noise_cache_get(cache, &b->ctx, NULL, i, -i), 4096) == 0;
+    }
+    struct noise_cache_stats stats = {0};
+    if (loaded_cache != NULL) { noise_cache_get_stats(loaded_cache, &stats); }
+    ok = ok && stats.misses == 0;
+    fprintf(stderr, "check snapshot round trip: %s\n", ok ? "ok" : "FAIL");
+
+    // replayed on one thread, every step hashes the same as when recorded
+    int replayed = ok ? snapshot_replay(&s, loaded, NULL) : -1;
+    int same = replayed == SNAPSHOT_CHECK_STEPS &&
+        memcmp(boids_current(loaded)->px, boids_current(boids)->px,
+               sizeof(float) * SNAPSHOT_CHECK_BOIDS) == 0;
+    fprintf(stderr, "check snapshot replay: %s (%d of %d steps)\n",
+            same ? "ok" : "FAIL", replayed, SNAPSHOT_CHECK_STEPS);
+
+    snapshot_close(&s);
+    remove(path);
+    noise_cache_destroy(loaded_cache);
+    noise_cache_destroy(cache);
+    boids_destroy(loaded);
+    boids_destroy(boids);
+    return !ok + !same;
+}
+
+// read a flock stepping on its own thread for a while, then step a copy of
+// it serially. the last frame read must be the copy at that step, with
+// the positions of the step before. returns failures
+static int check_sim_thread(void)
+{
+    struct boid_params params;
+    boid_params_default(&params);
+    struct boids * boids = boids_create(SIM_CHECK_BOIDS);
+    struct boids * serial = boids_create(SIM_CHECK_BOIDS);
+    struct pool * pool = pool_create(2);
+    float * prev = malloc(sizeof(float) * SIM_CHECK_BOIDS);
+    struct sim_thread sim;
+
+    int ok = boids != NULL && serial != NULL && pool != NULL && prev != NULL;
+    if (ok)
+    {
+        boids_spawn(boids, &params, SIM_CHECK_BOIDS, 7);
+        boids_spawn(serial, &params, SIM_CHECK_BOIDS, 7);
+        ok = sim_thread_start(&sim, boids, &params, SIM_CHECK_DT, pool);
+    }
+
+    // frames only ever move forward, alpha stays in [0, 1]
+    uint64_t step = 0, hash = 0;
+    if (ok)
+    {
+        double end = now() + SIM_CHECK_MS * 1e-3;
+        while (ok && now() < end)
+        {
+            float alpha;
+            const struct sim_frame * f = sim_thread_latest(&sim, &alpha);
+            ok = f->step >= step && alpha >= 0.0f && alpha <= 1.0f;
+            step = f->step;
+            hash = snapshot_hash(&f->state, SIM_CHECK_BOIDS);
+            memcpy(prev, f->prev.px, sizeof(float) * SIM_CHECK_BOIDS);
+        }
+        ok = ok && sim_thread_ok(&sim) && step > 0;
+
+        struct sim_thread_stats stats;
+        sim_thread_get_stats(&sim, &stats);
+        sim_thread_stop(&sim);
+        fprintf(stderr, "check sim_thread: %lu steps, %lu reads, %lu stale, "
+                "%lu never read, %lu overran, %lu dropped\n",
+                (unsigned long) stats.steps, (unsigned long) stats.reads,
+                (unsigned long) stats.stale, (unsigned long) stats.unseen,
+                (unsigned long) stats.overruns, (unsigned long) stats.dropped);
+    }
+
+    for (uint64_t i = 0; ok && i < step; i++)
+    {
+        if (i + 1 == step)
+        {
+            ok = memcmp(prev, boids_current(serial)->px, sizeof(float) * SIM_CHECK_BOIDS) == 0;
+        }
+        ok = ok && boids_step(serial, &params, SIM_CHECK_DT, NULL);
+    }
+    ok = ok && snapshot_hash(boids_current(serial), SIM_CHECK_BOIDS) == hash;
+    fprintf(stderr, "check sim_thread frames: %s (step %lu)\n", ok ? "ok" : "FAIL",
+            (unsigned long) step);
+
+    free(prev);
+    pool_destroy(pool);
+    boids_destroy(serial);
+    boids_destroy(boids);
+    return !ok;
+}
+
+// compare every fast path against the scalar reference, returns failures
+static int check(struct bench * b)
+{
+    int failures = 0;
+    int n = GOLDEN_SIZE;
+    uint8_t * ref = malloc((size_t) n * n);
+    uint8_t * out = malloc((size_t) n * n);
+
+    for (int g = 0; g < GOLDEN_COUNT; g++)
+    {
+        for (int y = 0; y < n; y++)
+        {
+            for (int x = 0; x < n; x++)
+            {
+                ref[y * n + x] = perlin(&b->ctx, golden[g].y + y, golden[g].x + x);
+            }
+        }
+
+        uint32_t hash = fnv1a(ref, (size_t) n * n);
+        int ok = hash == golden[g].hash;
+        failures += !ok;
+        fprintf(stderr, "check perlin golden @%d,%d: %s (0x%08x)\n",
+                golden[g].y, golden[g].x, ok ? "ok" : "FAIL", hash);
+
+        perlin_fill_grid(&b->ctx, out, n, n, golden[g].y, golden[g].x, n);
+        ok = memcmp(ref, out, (size_t) n * n) == 0;
+        failures += !ok;
+        fprintf(stderr, "check perlin_fill_grid @%d,%d: %s\n",
+                golden[g].y, golden[g].x, ok ? "ok" : "FAIL");
+
+        perlin_fill_tiled(&b->ctx, b->pool, out, n, n, golden[g].y, golden[g].x, n, 0);
+        ok = memcmp(ref, out, (size_t) n * n) == 0;
+        failures += !ok;
+        fprintf(stderr, "check perlin_fill_tiled @%d,%d: %s\n",
+                golden[g].y, golden[g].x, ok ? "ok" : "FAIL");
+    }
+
+    // every lookup table cell size against perlin_cell at each origin
+    for (int shift = PERLIN_LUT_MIN_SHIFT; shift <= PERLIN_LUT_MAX_SHIFT; shift++)
+    {
+        int cell = 1 << shift, same = 1;
+        for (int g = 0; g < GOLDEN_COUNT; g++)
+        {
+            perlin_fill_lut(&b->ctx, out, n - 3, n, golden[g].y, golden[g].x + 3, n, cell);
+            for (int y = 0; y < n; y++)
+            {
+                for (int x = 0; x < n - 3; x++)
+                {
+                    same &= out[y * n + x] == (uint8_t) perlin_cell(&b->ctx,
+                            golden[g].y + y, golden[g].x + 3 + x, cell);
+                }
+            }
+        }
+        failures += !same;
+        fprintf(stderr, "check perlin_fill_lut cell %d: %s\n", cell, same ? "ok" : "FAIL");
+    }
+
+    // every vector kernel this cpu has against perlin_raw
+    enum simd_level saved = perlin_get_kernel();
+    for (int k = SIMD_SCALAR; k <= (int) simd_detect(); k++)
+    {
+        perlin_set_kernel(k);
+        perlin_raw_batch(&b->ctx, b->raw, b->ys, b->xs, b->size * b->size);
+
+        float worst = 0.0f;
+        for (size_t i = 0; i < (size_t) b->size * b->size; i++)
+        {
+            float d = fabsf(b->raw[i] - perlin_raw(&b->ctx, b->ys[i], b->xs[i]));
+            worst = d > worst ? d : worst;
+        }
+
+        int ok = worst <= PERLIN_SIMD_EPSILON;
+        failures += !ok;
+        fprintf(stderr, "check perlin_raw_batch %s: %s (max error %g)\n",
+                simd_name(k), ok ? "ok" : "FAIL", worst);
+
+        simplex3_raw_batch(&b->ctx, b->raw, b->ys, b->xs, b->ts, b->size * b->size);
+        worst = 0.0f;
+        for (size_t i = 0; i < (size_t) b->size * b->size; i++)
+        {
+            float d = fabsf(b->raw[i] - simplex3_raw(&b->ctx, b->ys[i], b->xs[i], b->ts[i]));
+            worst = d > worst ? d : worst;
+        }
+
+        ok = worst <= SIMPLEX_SIMD_EPSILON;
+        failures += !ok;
+        fprintf(stderr, "check simplex3_raw_batch %s: %s (max error %g)\n",
+                simd_name(k), ok ? "ok" : "FAIL", worst);
+    }
+
+    // the scalar kernel fills exactly what simplex3 gives, pixel by pixel
+    perlin_set_kernel(SIMD_SCALAR);
+    simplex3_fill_grid(&b->ctx, out, n, n, golden[1].y, golden[1].x, SIMPLEX_T, n);
+    int same = 1;
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            same &= out[y * n + x] == simplex3(&b->ctx, golden[1].y + y, golden[1].x + x, SIMPLEX_T);
+        }
+    }
+    failures += !same;
+    fprintf(stderr, "check simplex3_fill_grid: %s\n", same ? "ok" : "FAIL");
+    perlin_set_kernel(saved);
+
+    failures += check_snapshot(b);
+    failures += check_sim_thread();
+
+    free(out);
+    free(ref);
+    return failures;
+}
+
+// benchmarks -----------------------------------------------------------------
+
+static void run_perlin(struct bench * b)
+{
+    for (int y = 0; y < b->size; y++)
+    {
+        for (int x = 0; x < b->size; x++)
+        {
+            b->bytes[(size_t) y * b->size + x] = perlin(&b->ctx, y, x);
+        }
+    }
+}
+
+static void run_perlin_raw(struct bench * b)
+{
+    for (size_t i = 0; i < (size_t) b->size * b->size; i++)
+    {
+        b->raw[i] = perlin_raw(&b->ctx, b->ys[i], b->xs[i]);
+    }
+}
+
+static void run_fill_grid(struct bench * b)
+{
+    perlin_fill_grid(&b->ctx, b->bytes, b->size, b->size, 0, 0, b->size);
+}
+
+static void run_fill_tiled(struct bench * b)
+{
+    perlin_fill_tiled(&b->ctx, b->pool, b->bytes, b->size, b->size, 0, 0, b->size, 0);
+}
+
+static void run_fill_lut4(struct bench * b)
+{
+    perlin_fill_lut(&b->ctx, b->bytes, b->size, b->size, 0, 0, b->size, 4);
+}
+
+static void run_fill_lut8(struct bench * b)
+{
+    perlin_fill_lut(&b->ctx, b->bytes, b->size, b->size, 0, 0, b->size, 8);
+}
+
+static void run_fill_lut32(struct bench * b)
+{
+    perlin_fill_lut(&b->ctx, b->bytes, b->size, b->size, 0, 0, b->size, 32);
+}
+
+static void run_raw_batch(struct bench * b)
+{
+    perlin_raw_batch(&b->ctx, b->raw, b->ys, b->xs, b->size * b->size);
+}
+
+static void run_simplex3_raw(struct bench * b)
+{
+    for (size_t i = 0; i < (size_t) b->size * b->size; i++)
+    {
+        b->raw[i] = simplex3_raw(&b->ctx, b->ys[i], b->xs[i], b->ts[i]);
+    }
+}
+
+static void run_simplex3_batch(struct bench * b)
+{
+    simplex3_raw_batch(&b->ctx, b->raw, b->ys, b->xs, b->ts, b->size * b->size);
+}
+
+static void run_simplex3_fill(struct bench * b)
+{
+    simplex3_fill_grid(&b->ctx, b->bytes, b->size, b->size, 0, 0, SIMPLEX_T, b->size);
+}
+
+static void run_fractal4(struct bench * b)
+{
+    struct fractal f = { FRACTAL_FBM, 4, 2.0f, 0.5f };
+    fractal_fill_grid(&b->ctx, &f, b->bytes, b->size, b->size, 0, 0, b->size);
+}
+
+struct benchmark
+{
+    const char * name;
+    void (*run)(struct bench *);
+    enum simd_level kernel; // kernel to force, only for batched float paths
+};
+
+static const struct benchmark benchmarks[] =
+{
+    { "perlin",                 run_perlin,     SIMD_SCALAR },
+    { "perlin_raw",             run_perlin_raw, SIMD_SCALAR },
+    { "perlin_fill_grid",       run_fill_grid,  SIMD_SCALAR },
+    { "perlin_fill_tiled",      run_fill_tiled, SIMD_SCALAR },
+    { "perlin_fill_lut4",       run_fill_lut4,  SIMD_SCALAR },
+    { "perlin_fill_lut8",       run_fill_lut8,  SIMD_SCALAR },
+    { "perlin_fill_lut32",      run_fill_lut32, SIMD_SCALAR },
+    { "perlin_raw_batch",       run_raw_batch,  SIMD_SCALAR },
+    { "perlin_raw_batch",       run_raw_batch,  SIMD_SSE2 },
+    { "perlin_raw_batch",       run_raw_batch,  SIMD_AVX2 },
+    { "fractal_fill_grid_fbm4", run_fractal4,   SIMD_AVX2 },
+    { "simplex3_raw",           run_simplex3_raw,   SIMD_SCALAR },
+    { "simplex3_raw_batch",     run_simplex3_batch, SIMD_SCALAR },
+    { "simplex3_raw_batch",     run_simplex3_batch, SIMD_SSE2 },
+    { "simplex3_raw_batch",     run_simplex3_batch, SIMD_AVX2 },
+    { "simplex3_fill_grid",     run_simplex3_fill,  SIMD_AVX2 }
+};
+
+#define BENCHMARK_COUNT (int) (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// flock steps --------------------------------------------------------------
+
+struct flock_bench
+{
+    struct boids * boids;
+    struct boid_params params;
+    struct pool * pool;
+};
+
+static void run_step(void * arg)
+{
+    struct flock_bench * f = arg;
+    boids_step(f->boids, &f->params, 1.0f / 60.0f, f->pool);
+}
+
+// a flock of count boids at constant density, so neighbours per boid stay
+// the same as it grows
+static int flock_setup(struct flock_bench * f, int count, struct pool * pool)
+{
+    boid_params_default(&f->params);
+    float edge = cbrtf(count * 125.0f);
+    f->params.bounds[0] = f->params.bounds[1] = f->params.bounds[2] = edge;
+    f->pool = pool;
+
+    f->boids = boids_create(count);
+    if (f->boids == NULL) { return 0; }
+    boids_spawn(f->boids, &f->params, count, 1234);
+    return 1;
+}
+
+// pull three quarters of the flock into a few tight clusters, so the work
+// per chunk is very uneven
+static void flock_cluster(struct flock_bench * f)
+{
+    struct boid_state * s = &f->boids->state[f->boids->current];
+    float edge = f->params.bounds[0];
+
+    for (int i = 0; i < f->boids->count; i++)
+    {
+        if (i % 4 == 3) { continue; }
+        float cx = edge * (0.2f + 0.2f * (i % 4));
+        s->px[i] = cx + fmodf(s->px[i], edge * 0.1f);
+        s->py[i] = cx + fmodf(s->py[i], edge * 0.1f);
+        s->pz[i] = cx + fmodf(s->pz[i], edge * 0.1f);
+    }
+}
+
+// snapshots ------------------------------------------------------------------
+
+struct snapshot_bench
+{
+    const char * path;
+    struct boids * boids;
+    struct boid_params params;
+    int restore;            // copy into boids too, not just map
+};
+
+static void run_snapshot(void * arg)
+{
+    struct snapshot_bench * sb = arg;
+    struct snapshot s;
+    if (snapshot_open(&s, sb->path) && sb->restore)
+    {
+        snapshot_restore(&s, sb->boids, &sb->params);
+    }
+    snapshot_close(&s);
+}
+
+// reporting ------------------------------------------------------------------
+
+struct report
+{
+    FILE * out;
+    int reps;
+    int first;
+    double * times;
+};
+
+static int compare_double(const void * a, const void * b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of sorted values
+static double percentile(const double * sorted, int n, double p)
+{
+    int rank = (int) ceil(p / 100.0 * n) - 1;
+    return sorted[rank < 0 ? 0 : rank >= n ? n - 1 : rank];
+}
+
+// time run over the repetitions after one warm up, and report ns per item
+// where items is how many samples or boids one run processes. returns the
+// median ns per item
+static double measure(struct report * r, const char * name, const char * variant,
+        const char * unit, int size, double items, void (*run)(void *), void * arg)
+{
+    run(arg);
+    for (int i = 0; i < r->reps; i++)
+    {
+        double t = now();
+        run(arg);
+        r->times[i] = (now() - t) * 1e9 / items;
+    }
+    qsort(r->times, r->reps, sizeof(double), compare_double);
+
+    double * times = r->times;
+    double p50 = percentile(times, r->reps, 50);
+    double p90 = percentile(times, r->reps, 90);
+    double p99 = percentile(times, r->reps, 99);
+
+    fprintf(r->out, "%s\n    { \"name\": \"%s\", \"variant\": \"%s\", \"unit\": \"%s\", "
+            "\"size\": %d, \"ns_per_%s\": { \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+            "\"p99\": %.4f, \"max\": %.4f }, \"%ss_per_sec_p50\": %.0f, \"ms_per_run_p50\": %.4f }",
+            r->first ? "" : ",", name, variant, unit, size, unit,
+            times[0], p50, p90, p99, times[r->reps - 1], unit, 1e9 / p50, p50 * items * 1e-6);
+    r->first = 0;
+
+    fprintf(stderr, "%-24s %-7s %8d  p50 %9.3f ns/%-6s p99 %9.3f  %8.3f ms/run\n",
+            name, variant, size, p50, unit, p99, p50 * items * 1e-6);
+    return p50;
+}
+
+// noise benchmark entry, forcing its kernel first
+struct noise_run
+{
+    struct bench * b;
+    const struct benchmark * m;
+};
+
+static void run_noise(void * arg)
+{
+    struct noise_run * n = arg;
+    n->m->run(n->b);
+}
+
+static void bench_noise(struct report * r, struct bench * b, int max_size)
+{
+    for (int size = 256; size <= max_size; size *= 4)
+    {
+        b->size = size;
+        bench_coords(b);
+
+        for (int i = 0; i < BENCHMARK_COUNT; i++)
+        {
+            const struct benchmark * m = &benchmarks[i];
+            if (m->kernel > simd_detect()) { continue; }
+            perlin_set_kernel(m->kernel);
+
+            struct noise_run n = { b, m };
+            measure(r, m->name, simd_name(m->kernel), "sample", size,
+                    (double) size * size, run_noise, &n);
+        }
+    }
+    perlin_set_kernel(simd_detect());
+}
+
+// step time against boid count for the grid and, while it is bearable,
+// the brute force reference
+static void bench_flock(struct report * r, struct pool * pool, int max_boids)
+{
+    for (int count = 1000; count <= max_boids; count *= 4)
+    {
+        for (int search = BOIDS_GRID; search <= BOIDS_BRUTE; search++)
+        {
+            if (search == BOIDS_BRUTE && count > 16000) { continue; }
+
+            struct flock_bench f;
+            if (!flock_setup(&f, count, pool)) { return; }
+            f.boids->search = search;
+
+            measure(r, "boids_step", search == BOIDS_GRID ? "grid" : "brute",
+                    "boid", count, count, run_step, &f);
+
+            boids_destroy(f.boids);
+        }
+    }
+}
+
+// parallel efficiency of a clustered grid step for 1, 2, 4 ... threads up
+// to max_threads, each with its own persistent pool
+static void bench_scaling(struct report * r, int max_threads, int count)
+{
+    double base = 0.0;
+
+    for (int threads = 1; ; threads *= 2)
+    {
+        if (threads > max_threads) { threads = max_threads; }
+
+        struct flock_bench f;
+        if (!flock_setup(&f, count, pool_create(threads))) { return; }
+        flock_cluster(&f);
+
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%dt", threads);
+        unsigned long steals = pool_steals(f.pool);
+        double ns = measure(r, "boids_step_clustered", variant, "boid", count,
+                count, run_step, &f);
+        steals = pool_steals(f.pool) - steals;
+
+        if (threads == 1) { base = ns; }
+        double speedup = base / ns;
+
+        fprintf(r->out, ",\n    { \"name\": \"boids_scaling\", \"threads\": %d, "
+                "\"size\": %d, \"speedup\": %.3f, \"efficiency\": %.3f, "
+                "\"steals_per_run\": %.1f }",
+                threads, count, speedup, speedup / threads,
+                (double) steals / (r->reps + 1));
+        fprintf(stderr, "%-24s %-7d %8d  speedup %6.2fx  efficiency %5.1f%%  "
+                "%.1f steals/run\n", "boids_scaling", threads, count, speedup,
+                100.0 * speedup / threads, (double) steals / (r->reps + 1));
+
+        boids_destroy(f.boids);
+        pool_destroy(f.pool);
+        if (threads == max_threads) { break; }
+    }
+}
+
+// load time of a million boid snapshot, mapped only and then copied into
+// a flock. the file was just written, so it comes from the page cache
+static void bench_snapshot(struct report * r)
+{
+    char path[64];
+    struct snapshot_bench sb = { .path = path };
+    boid_params_default(&sb.params);
+    sb.boids = boids_create(SNAPSHOT_BOIDS);
+    if (sb.boids == NULL || !temp_path(path))
+    {
+        boids_destroy(sb.boids);
+        return;
+    }
+    boids_spawn(sb.boids, &sb.params, SNAPSHOT_BOIDS, 1);
+
+    if (snapshot_write(path, sb.boids, &sb.params, NULL, NULL, 0))
+    {
+        measure(r, "snapshot_open", "mmap", "boid", SNAPSHOT_BOIDS, SNAPSHOT_BOIDS,
+                run_snapshot, &sb);
+        sb.restore = 1;
+        measure(r, "snapshot_restore", "copy", "boid", SNAPSHOT_BOIDS, SNAPSHOT_BOIDS,
+                run_snapshot, &sb);
+    }
+
+    remove(path);
+    boids_destroy(sb.boids);
+}
+
+// main -----------------------------------------------------------------------
+
+int main(int argc, char ** argv)
+{
+    int reps = 9;
+    int threads = 0;
+    int max_size = 2048;
+    int max_boids = 256000;
+    int check_only = 0;
+    int noise = 1, flock = 1;
+    const char * out_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--check") == 0) { check_only = 1; }
+        else if (strcmp(argv[i], "--noise") == 0) { flock = 0; }
+        else if (strcmp(argv[i], "--flock") == 0) { noise = 0; }
+        else if (strcmp(argv[i], "--boids") == 0 && i + 1 < argc) { max_boids = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) { reps = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc) { max_size = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) { out_path = argv[++i]; }
+        else
+        {
+            fprintf(stderr, "usage: %s [--check] [--noise | --flock] [--reps n] "
+                    "[--threads n] [--max size] [--boids n] [--out file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 1) { reps = 1; }
+
+    struct bench b;
+    perlin_ctx_init(&b.ctx, 0);
+    b.pool = pool_create(threads);
+
+    size_t cap = (size_t) max_size * max_size;
+    if (cap < (size_t) GOLDEN_SIZE * GOLDEN_SIZE) { cap = (size_t) GOLDEN_SIZE * GOLDEN_SIZE; }
+    b.bytes = malloc(cap);
+    b.raw = malloc(cap * sizeof(float));
+    b.ys = malloc(cap * sizeof(float));
+    b.xs = malloc(cap * sizeof(float));
+    b.ts = malloc(cap * sizeof(float));
+
+    b.size = GOLDEN_SIZE;
+    bench_coords(&b);
+    int failures = check(&b);
+    if (check_only || failures > 0)
+    {
+        fprintf(stderr, "%s\n", failures ? "golden check FAILED" : "golden check passed");
+        return failures ? 1 : 0;
+    }
+
+    FILE * out = out_path ? fopen(out_path, "w") : stdout;
+    if (out == NULL)
+    {
+        fprintf(stderr, "Error: couldnt open %s\n", out_path);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"simd\": \"%s\",\n  \"threads\": %d,\n  \"reps\": %d,\n"
+            "  \"golden\": \"pass\",\n  \"results\": [",
+            simd_name(simd_detect()), pool_threads(b.pool), reps);
+
+    struct report r = { out, reps, 1, malloc(sizeof(double) * reps) };
+
+    if (noise) { bench_noise(&r, &b, max_size); }
+    if (flock)
+    {
+        bench_flock(&r, b.pool, max_boids);
+        bench_scaling(&r, pool_threads(b.pool), max_boids < 64000 ? max_boids : 64000);
+        bench_snapshot(&r);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) { fclose(out); }
+
+    free(r.times);
+    free(b.ts);
+    free(b.xs);
+    free(b.ys);
+    free(b.raw);
+    free(b.bytes);
+    pool_destroy(b.pool);
+    return 0;
+}
@@ -0,0 +1,503 @@
+/*
+   boids.c
+   flocking simulation core, boids stored as structure of arrays
+
+   every step reads the current state and writes the other one, so the
+   update order does not matter. the three rules share one pass over a
+   boid's candidate neighbours, which is where all the time goes, so that
+   pass is vectorized across 4 (sse2) or 8 (avx2) neighbours at a time.
+   with the grid, candidates come from the cell sorted copy of the state so
+   each run of neighbouring cells is one contiguous vector sweep
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "boids.h"
+#include "grid.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BOIDS_X86
+#endif
+
+// the boid being steered
+struct query
+{
+    float x, y, z;
+    float r2;                   // neighbour radius squared
+    float sr2;                  // separation radius squared
+};
+
+// what the rules need to know about a boid's neighbourhood
+struct steer
+{
+    float count;                // neighbours within the radius
+    float px, py, pz;           // sum of their positions
+    float vx, vy, vz;           // sum of their velocities
+    float sx, sy, sz;           // sum of offsets away from close ones / d^2
+};
+
+typedef void (*accumulate_fn)(const struct boid_state * s, int j0, int j1,
+        const struct query * q, struct steer * acc);
+
+// allocation -----------------------------------------------------------------
+
+static float * alloc_array(int capacity)
+{
+    // aligned_alloc wants a size that is a multiple of the alignment
+    size_t bytes = sizeof(float) * (size_t) capacity;
+    bytes = (bytes + BOIDS_ALIGN - 1) / BOIDS_ALIGN * BOIDS_ALIGN;
+    return aligned_alloc(BOIDS_ALIGN, bytes ? bytes : BOIDS_ALIGN);
+}
+
+static int state_alloc(struct boid_state * s, int capacity)
+{
+    s->px = alloc_array(capacity);
+    s->py = alloc_array(capacity);
+    s->pz = alloc_array(capacity);
+    s->vx = alloc_array(capacity);
+    s->vy = alloc_array(capacity);
+    s->vz = alloc_array(capacity);
+    return s->px && s->py && s->pz && s->vx && s->vy && s->vz;
+}
+
+static void state_free(struct boid_state * s)
+{
+    free(s->px); free(s->py); free(s->pz);
+    free(s->vx); free(s->vy); free(s->vz);
+}
+
+// steering kernels -----------------------------------------------------------
+
+static void accumulate_scalar(const struct boid_state * s, int j0, int j1,
+        const struct query * q, struct steer * acc)
+{
+    for (int j = j0; j < j1; j++)
+    {
+        float dx = s->px[j] - q->x;
+        float dy = s->py[j] - q->y;
+        float dz = s->pz[j] - q->z;
+        float d2 = dx*dx + dy*dy + dz*dz;
+
+        // d2 == 0 is the boid itself (or one exactly on top of it)
+        if (d2 <= 0.0f || d2 >= q->r2) { continue; }
+
+        acc->count += 1.0f;
+        acc->px += s->px[j]; acc->py += s->py[j]; acc->pz += s->pz[j];
+        acc->vx += s->vx[j]; acc->vy += s->vy[j]; acc->vz += s->vz[j];
+
+        if (d2 < q->sr2)
+        {
+            float inv = 1.0f / d2;
+            acc->sx -= dx * inv; acc->sy -= dy * inv; acc->sz -= dz * inv;
+        }
+    }
+}
+
+#ifdef BOIDS_X86
+
+static inline float hsum_sse2(__m128 v)
+{
+    __m128 hi = _mm_movehl_ps(v, v);
+    v = _mm_add_ps(v, hi);
+    hi = _mm_shuffle_ps(v, v, 1);
+    return _mm_cvtss_f32(_mm_add_ss(v, hi));
+}
+
+// 4 neighbours per iteration, lanes outside the radius are masked to zero
+static void accumulate_sse2(const struct boid_state * s, int j0, int j1,
+        const struct query * q, struct steer * acc)
+{
+    const __m128 qx = _mm_set1_ps(q->x), qy = _mm_set1_ps(q->y), qz = _mm_set1_ps(q->z);
+    const __m128 r2 = _mm_set1_ps(q->r2), sr2 = _mm_set1_ps(q->sr2);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+    __m128 count = zero, spx = zero, spy = zero, spz = zero;
+    __m128 svx = zero, svy = zero, svz = zero, sx = zero, sy = zero, sz = zero;
+
+    int j = j0;
+    for (; j + 4 <= j1; j += 4)
+    {
+        __m128 px = _mm_loadu_ps(s->px + j);
+        __m128 py = _mm_loadu_ps(s->py + j);
+        __m128 pz = _mm_loadu_ps(s->pz + j);
+
+        __m128 dx = _mm_sub_ps(px, qx);
+        __m128 dy = _mm_sub_ps(py, qy);
+        __m128 dz = _mm_sub_ps(pz, qz);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                _mm_mul_ps(dz, dz));
+
+        __m128 other = _mm_cmpgt_ps(d2, zero);
+        __m128 near = _mm_and_ps(other, _mm_cmplt_ps(d2, r2));
+        __m128 close = _mm_and_ps(other, _mm_cmplt_ps(d2, sr2));
+
+        count = _mm_add_ps(count, _mm_and_ps(near, one));
+        spx = _mm_add_ps(spx, _mm_and_ps(near, px));
+        spy = _mm_add_ps(spy, _mm_and_ps(near, py));
+        spz = _mm_add_ps(spz, _mm_and_ps(near, pz));
+        svx = _mm_add_ps(svx, _mm_and_ps(near, _mm_loadu_ps(s->vx + j)));
+        svy = _mm_add_ps(svy, _mm_and_ps(near, _mm_loadu_ps(s->vy + j)));
+        svz = _mm_add_ps(svz, _mm_and_ps(near, _mm_loadu_ps(s->vz + j)));
+
+        // masking after the divide also clears the lanes where d2 == 0
+        __m128 inv = _mm_and_ps(close, _mm_div_ps(one, d2));
+        sx = _mm_sub_ps(sx, _mm_mul_ps(dx, inv));
+        sy = _mm_sub_ps(sy, _mm_mul_ps(dy, inv));
+        sz = _mm_sub_ps(sz, _mm_mul_ps(dz, inv));
+    }
+
+    acc->count += hsum_sse2(count);
+    acc->px += hsum_sse2(spx); acc->py += hsum_sse2(spy); acc->pz += hsum_sse2(spz);
+    acc->vx += hsum_sse2(svx); acc->vy += hsum_sse2(svy); acc->vz += hsum_sse2(svz);
+    acc->sx += hsum_sse2(sx); acc->sy += hsum_sse2(sy); acc->sz += hsum_sse2(sz);
+
+    accumulate_scalar(s, j, j1, q, acc);
+}
+
+// kept entirely in avx2 code, calling the sse2 version would mix legacy and
+// vex encoded instructions and pay a state transition per call
+__attribute__((target("avx2")))
+static inline float hsum_avx2(__m256 v)
+{
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+}
+
+// 8 neighbours per iteration
+__attribute__((target("avx2")))
+static void accumulate_avx2(const struct boid_state * s, int j0, int j1,
+        const struct query * q, struct steer * acc)
+{
+    const __m256 qx = _mm256_set1_ps(q->x), qy = _mm256_set1_ps(q->y), qz = _mm256_set1_ps(q->z);
+    const __m256 r2 = _mm256_set1_ps(q->r2), sr2 = _mm256_set1_ps(q->sr2);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+    __m256 count = zero, spx = zero, spy = zero, spz = zero;
+    __m256 svx = zero, svy = zero, svz = zero, sx = zero, sy = zero, sz = zero;
+
+    int j = j0;
+    for (; j + 8 <= j1; j += 8)
+    {
+        __m256 px = _mm256_loadu_ps(s->px + j);
+        __m256 py = _mm256_loadu_ps(s->py + j);
+        __m256 pz = _mm256_loadu_ps(s->pz + j);
+
+        __m256 dx = _mm256_sub_ps(px, qx);
+        __m256 dy = _mm256_sub_ps(py, qy);
+        __m256 dz = _mm256_sub_ps(pz, qz);
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx),
+                _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+        __m256 other = _mm256_cmp_ps(d2, zero, _CMP_GT_OQ);
+        __m256 near = _mm256_and_ps(other, _mm256_cmp_ps(d2, r2, _CMP_LT_OQ));
+        __m256 close = _mm256_and_ps(other, _mm256_cmp_ps(d2, sr2, _CMP_LT_OQ));
+
+        count = _mm256_add_ps(count, _mm256_and_ps(near, one));
+        spx = _mm256_add_ps(spx, _mm256_and_ps(near, px));
+        spy = _mm256_add_ps(spy, _mm256_and_ps(near, py));
+        spz = _mm256_add_ps(spz, _mm256_and_ps(near, pz));
+        svx = _mm256_add_ps(svx, _mm256_and_ps(near, _mm256_loadu_ps(s->vx + j)));
+        svy = _mm256_add_ps(svy, _mm256_and_ps(near, _mm256_loadu_ps(s->vy + j)));
+        svz = _mm256_add_ps(svz, _mm256_and_ps(near, _mm256_loadu_ps(s->vz + j)));
+
+        __m256 inv = _mm256_and_ps(close, _mm256_div_ps(one, d2));
+        sx = _mm256_sub_ps(sx, _mm256_mul_ps(dx, inv));
+        sy = _mm256_sub_ps(sy, _mm256_mul_ps(dy, inv));
+        sz = _mm256_sub_ps(sz, _mm256_mul_ps(dz, inv));
+    }
+
+    acc->count += hsum_avx2(count);
+    acc->px += hsum_avx2(spx); acc->py += hsum_avx2(spy); acc->pz += hsum_avx2(spz);
+    acc->vx += hsum_avx2(svx); acc->vy += hsum_avx2(svy); acc->vz += hsum_avx2(svz);
+    acc->sx += hsum_avx2(sx); acc->sy += hsum_avx2(sy); acc->sz += hsum_avx2(sz);
+
+    // the scalar tail is legacy sse code, clean the upper halves first
+    _mm256_zeroupper();
+    accumulate_scalar(s, j, j1, q, acc);
+}
+
+#endif
+
+static accumulate_fn pick_kernel(enum simd_level level)
+{
+    switch (level)
+    {
+#ifdef BOIDS_X86
+        case SIMD_AVX2: return accumulate_avx2;
+        case SIMD_SSE2: return accumulate_sse2;
+#endif
+        default:        return accumulate_scalar;
+    }
+}
+
+// integration ----------------------------------------------------------------
+
+static inline float wrap(float v, float bound)
+{
+    if (v < 0.0f) { return v + bound; }
+    if (v >= bound) { return v - bound; }
+    return v;
+}
+
+// apply the rules to boid i of from and write it into to
+static void integrate(const struct boid_state * from, struct boid_state * to,
+        int i, const struct steer * acc, const struct boid_params * p, float dt)
+{
+    float px = from->px[i], py = from->py[i], pz = from->pz[i];
+    float vx = from->vx[i], vy = from->vy[i], vz = from->vz[i];
+
+    // separation
+    float ax = acc->sx * p->separation_weight;
+    float ay = acc->sy * p->separation_weight;
+    float az = acc->sz * p->separation_weight;
+
+    if (acc->count > 0.0f)
+    {
+        float inv = 1.0f / acc->count;
+
+        // alignment, steer towards the average heading
+        ax += (acc->vx * inv - vx) * p->alignment_weight;
+        ay += (acc->vy * inv - vy) * p->alignment_weight;
+        az += (acc->vz * inv - vz) * p->alignment_weight;
+
+        // cohesion, steer towards the centre of mass
+        ax += (acc->px * inv - px) * p->cohesion_weight;
+        ay += (acc->py * inv - py) * p->cohesion_weight;
+        az += (acc->pz * inv - pz) * p->cohesion_weight;
+    }
+
+    vx += ax * dt;
+    vy += ay * dt;
+    vz += az * dt;
+
+    // keep the speed within limits
+    float speed = sqrtf(vx*vx + vy*vy + vz*vz);
+    float scale = 1.0f;
+    if (speed > p->max_speed) { scale = p->max_speed / speed; }
+    else if (speed < p->min_speed && speed > 0.0f) { scale = p->min_speed / speed; }
+    vx *= scale; vy *= scale; vz *= scale;
+
+    to->vx[i] = vx;
+    to->vy[i] = vy;
+    to->vz[i] = vz;
+    to->px[i] = wrap(px + vx * dt, p->bounds[0]);
+    to->py[i] = wrap(py + vy * dt, p->bounds[1]);
+    to->pz[i] = wrap(pz + vz * dt, p->bounds[2]);
+}
+
+// public api -----------------------------------------------------------------
+
+void boid_params_default(struct boid_params * params)
+{
+    params->neighbour_radius = 5.0f;
+    params->separation_radius = 1.5f;
+    params->separation_weight = 1.5f;
+    params->alignment_weight = 1.0f;
+    params->cohesion_weight = 0.5f;
+    params->min_speed = 2.0f;
+    params->max_speed = 8.0f;
+    params->bounds[0] = params->bounds[1] = params->bounds[2] = 100.0f;
+}
+
+struct boids * boids_create(int capacity)
+{
+    struct boids * boids = calloc(1, sizeof(struct boids));
+    if (boids == NULL) { return NULL; }
+
+    boids->capacity = capacity;
+    boids->kernel = simd_detect();
+    boids->search = BOIDS_GRID;
+
+    boids->grid = malloc(sizeof(struct grid));
+    if (boids->grid != NULL) { grid_init(boids->grid); }
+
+    if (boids->grid == NULL ||
+        !state_alloc(&boids->state[0], capacity) ||
+        !state_alloc(&boids->state[1], capacity))
+    {
+        printf("Error: couldnt allocate state for %d boids\n", capacity);
+        boids_destroy(boids);
+        return NULL;
+    }
+
+    return boids;
+}
+
+void boids_destroy(struct boids * boids)
+{
+    if (boids == NULL) { return; }
+    if (boids->grid != NULL)
+    {
+        grid_free(boids->grid);
+        free(boids->grid);
+    }
+    state_free(&boids->state[0]);
+    state_free(&boids->state[1]);
+    free(boids);
+}
+
+// next value of a xorshift32 generator as a float in [0, 1)
+static float random01(uint32_t * state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+int boids_spawn(struct boids * boids, const struct boid_params * params,
+        int count, uint32_t seed)
+{
+    struct boid_state * s = &boids->state[boids->current];
+    uint32_t state = seed ? seed : 1;
+
+    if (count > boids->capacity - boids->count)
+    {
+        count = boids->capacity - boids->count;
+    }
+
+    for (int i = boids->count; i < boids->count + count; i++)
+    {
+        s->px[i] = random01(&state) * params->bounds[0];
+        s->py[i] = random01(&state) * params->bounds[1];
+        s->pz[i] = random01(&state) * params->bounds[2];
+
+        // random direction at a speed between the limits
+        float vx = random01(&state) - 0.5f;
+        float vy = random01(&state) - 0.5f;
+        float vz = random01(&state) - 0.5f;
+        float len = sqrtf(vx*vx + vy*vy + vz*vz);
+        float speed = params->min_speed +
+            random01(&state) * (params->max_speed - params->min_speed);
+        float scale = len > 0.0f ? speed / len : 0.0f;
+
+        s->vx[i] = vx * scale;
+        s->vy[i] = vy * scale;
+        s->vz[i] = vz * scale;
+    }
+
+    boids->count += count;
+    return count;
+}
+
+const struct boid_state * boids_current(const struct boids * boids)
+{
+    return &boids->state[boids->current];
+}
+
+// steer boids [i0, i1) by comparing them with every boid
+static void step_brute(struct boids * boids, const struct boid_params * params,
+        float dt, struct query q, int i0, int i1)
+{
+    const struct boid_state * from = &boids->state[boids->current];
+    struct boid_state * to = &boids->state[!boids->current];
+    accumulate_fn accumulate = pick_kernel(boids->kernel);
+
+    for (int i = i0; i < i1; i++)
+    {
+        struct steer acc;
+        memset(&acc, 0, sizeof(acc));
+
+        q.x = from->px[i];
+        q.y = from->py[i];
+        q.z = from->pz[i];
+        accumulate(from, 0, boids->count, &q, &acc);
+
+        integrate(from, to, i, &acc, params, dt);
+    }
+}
+
+// steer the boids at sorted positions [k0, k1) of the grid, looking only
+// at the cells around them. boids keep their original slots in the state
+static void step_grid(struct boids * boids, const struct boid_params * params,
+        float dt, struct query q, int k0, int k1)
+{
+    const struct grid * grid = boids->grid;
+    const struct boid_state * from = &boids->state[boids->current];
+    struct boid_state * to = &boids->state[!boids->current];
+    accumulate_fn accumulate = pick_kernel(boids->kernel);
+    int ranges[GRID_MAX_RANGES][2];
+
+    for (int k = k0; k < k1; k++)
+    {
+        struct steer acc;
+        memset(&acc, 0, sizeof(acc));
+
+        q.x = grid->sorted.px[k];
+        q.y = grid->sorted.py[k];
+        q.z = grid->sorted.pz[k];
+
+        int n = grid_query(grid, q.x, q.y, q.z, ranges);
+        for (int r = 0; r < n; r++)
+        {
+            accumulate(&grid->sorted, ranges[r][0], ranges[r][1], &q, &acc);
+        }
+
+        integrate(from, to, grid->order[k], &acc, params, dt);
+    }
+}
+
+// one step as handed to the pool
+struct step_job
+{
+    struct boids * boids;
+    const struct boid_params * params;
+    float dt;
+    struct query q;
+};
+
+static void step_chunk(void * arg, int begin, int end)
+{
+    struct step_job * job = arg;
+    if (job->boids->search == BOIDS_BRUTE)
+    {
+        step_brute(job->boids, job->params, job->dt, job->q, begin, end);
+    }
+    else
+    {
+        step_grid(job->boids, job->params, job->dt, job->q, begin, end);
+    }
+}
+
+int boids_step(struct boids * boids, const struct boid_params * params,
+        float dt, struct pool * pool)
+{
+    struct step_job job =
+    {
+        .boids = boids,
+        .params = params,
+        .dt = dt,
+        .q.r2 = params->neighbour_radius * params->neighbour_radius,
+        .q.sr2 = params->separation_radius * params->separation_radius
+    };
+
+    if (boids->search == BOIDS_GRID &&
+        !grid_build(boids->grid, &boids->state[boids->current], boids->count,
+                params->neighbour_radius, params->bounds))
+    {
+        return 0;
+    }
+
+    // chunks are runs of BOIDS_GRAIN boids, taken in cell order with the
+    // grid, so a chunk inside a dense cluster has far more neighbours to
+    // visit than one in open space and stealing evens that out
+    if (pool != NULL)
+    {
+        pool_for(pool, step_chunk, &job, boids->count, BOIDS_GRAIN);
+    }
+    else
+    {
+        step_chunk(&job, 0, boids->count);
+    }
+
+    boids->current = !boids->current;
+    return 1;
+}
@@ -0,0 +1,86 @@
+/*
+   boids.h
+   flocking simulation core, boids stored as structure of arrays
+*/
+
+#ifndef BOIDS
+#define BOIDS
+
+#include <stdint.h>
+
+#include "pool.h"
+#include "simd.h"
+
+// alignment of every state array, one avx2 register or cache line half
+#define BOIDS_ALIGN 32
+
+// boids per work chunk of a parallel step
+#define BOIDS_GRAIN 256
+
+// one snapshot of the flock, each array holds count floats
+struct boid_state
+{
+    float * px, * py, * pz;     // positions
+    float * vx, * vy, * vz;     // velocities
+};
+
+// tuning of the three steering rules and the world
+struct boid_params
+{
+    float neighbour_radius;     // alignment and cohesion look this far
+    float separation_radius;    // and separation this far
+    float separation_weight;
+    float alignment_weight;
+    float cohesion_weight;
+    float min_speed, max_speed;
+    float bounds[3];            // world is [0, bounds) on each axis, wrapping
+};
+
+// how a step finds each boid's neighbours
+enum boids_search
+{
+    BOIDS_GRID = 0,             // uniform grid, only the surrounding cells
+    BOIDS_BRUTE                 // every other boid, the O(n^2) reference
+};
+
+struct grid;
+
+struct boids
+{
+    int count;
+    int capacity;
+
+    // double buffered so a step reads one state and writes the other
+    struct boid_state state[2];
+    int current;                // index of the latest state
+
+    enum simd_level kernel;     // steering kernel, best supported by default
+    enum boids_search search;   // BOIDS_GRID by default
+
+    struct grid * grid;         // rebuilt every grid step
+};
+
+// sensible defaults for a 100 unit cube
+void boid_params_default(struct boid_params * params);
+
+// allocate room for capacity boids, with no boids in it yet
+struct boids * boids_create(int capacity);
+
+void boids_destroy(struct boids * boids);
+
+// add count boids at random positions and headings inside the world,
+// returns how many fit
+int boids_spawn(struct boids * boids, const struct boid_params * params,
+        int count, uint32_t seed);
+
+// latest state of the flock
+const struct boid_state * boids_current(const struct boids * boids);
+
+// advance the flock by dt seconds, spread over pool if not NULL. workers
+// only read the current state and write their own boids of the next one,
+// so nothing is locked. returns 0 if the grid could not grow
+int boids_step(struct boids * boids, const struct boid_params * params,
+        float dt, struct pool * pool);
+
+
+#endif
@@ -0,0 +1,332 @@
+/*
+   cull.c
+   gpu frustum culling and level of detail, feeding indirect draws
+
+   one invocation per boid tests its bounding sphere against the planes of
+   the camera's frustum and sizes it on screen. boids out of view or under
+   a pixel are dropped, the rest get the dart near the eye or a flat quad
+   further out. survivors are packed per lod: each workgroup counts its
+   boids in shared memory, reserves a run with one atomic add on the lod's
+   instance count in the draw command, and copies its records there. the
+   draw commands start the frame with their instance counts zeroed, so the
+   cpu never sees a draw list and records the same two draws every frame.
+   nothing needs features beyond vulkan 1.0 core, single indirect draws
+   with first instance 0 run on lavapipe too
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cull.h"
+#include "gpu_flock.h"
+#include "util.h"
+
+#define SHADER_DIR "shaders/"
+#define GROUP_SIZE 256
+
+// push constants, params in cull_common.glsl
+struct cull_push
+{
+    float view_projection[16];
+    float bounds[4];            // xyz world size, w bounding radius
+    float lod[4];               // pixels per unit at unit distance, skip
+                                // and quad radius in pixels, unused
+    uint32_t range[4];          // count, first record, records per lod, unused
+};
+
+static const char * shader_paths[RENDER_SOURCES] =
+{
+    SHADER_DIR "cull_packed.spv",
+    SHADER_DIR "cull_state.spv"
+};
+
+static const VkDeviceSize record_sizes[RENDER_SOURCES] =
+{
+    sizeof(struct Instance),
+    sizeof(struct gpu_boid)
+};
+
+#define BINDINGS 3
+
+// setup ----------------------------------------------------------------------
+
+static int create_buffers(struct cull * c)
+{
+    VkDeviceSize instances_size = c->stride * c->capacity * RENDER_LODS;
+    return gpu_create_buffer(c->allocator, instances_size,
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &c->instances, &c->instances_memory) &&
+        gpu_create_buffer(c->allocator, sizeof(struct cull_draws),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &c->draws, &c->draws_memory) &&
+        gpu_create_buffer(c->allocator, sizeof(struct cull_draws) * c->frames,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &c->readback, &c->readback_memory);
+}
+
+static int create_pipeline(struct cull * c, VkPipelineCache pipeline_cache)
+{
+    VkDescriptorSetLayoutBinding bindings[BINDINGS];
+    for (int b = 0; b < BINDINGS; b++)
+    {
+        bindings[b] = (VkDescriptorSetLayoutBinding) {0};
+        bindings[b].binding = b;
+        bindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[b].descriptorCount = 1;
+        bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {0};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = BINDINGS;
+    set_layout_info.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(c->device, &set_layout_info, c->host,
+                &c->set_layout) != VK_SUCCESS) { return 0; }
+
+    VkPushConstantRange push_range = {0};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.size = sizeof(struct cull_push);
+
+    VkPipelineLayoutCreateInfo layout_info = {0};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &c->set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(c->device, &layout_info, c->host, &c->layout) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    VkShaderModule module = load_shader(c->device, c->host, shader_paths[c->source]);
+    if (module == VK_NULL_HANDLE) { return 0; }
+
+    VkComputePipelineCreateInfo pipeline_info = {0};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = c->layout;
+
+    VkResult result = vkCreateComputePipelines(c->device, pipeline_cache, 1,
+            &pipeline_info, c->host, &c->pipeline);
+    vkDestroyShaderModule(c->device, module, c->host);
+    return result == VK_SUCCESS;
+}
+
+static void write_binding(struct cull * c, VkDescriptorSet set, uint32_t binding, VkBuffer buffer)
+{
+    VkDescriptorBufferInfo buffer_info = { buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet write = {0};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &buffer_info;
+    vkUpdateDescriptorSets(c->device, 1, &write, 0, NULL);
+}
+
+// a set per slot, binding 0 is written when the slot records
+static int create_descriptors(struct cull * c)
+{
+    VkDescriptorPoolSize pool_size = {0};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = BINDINGS * c->frames;
+
+    VkDescriptorPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = c->frames;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if (vkCreateDescriptorPool(c->device, &pool_info, c->host,
+                &c->descriptor_pool) != VK_SUCCESS) { return 0; }
+
+    VkDescriptorSetLayout layouts[FRAMES_MAX];
+    for (int i = 0; i < c->frames; i++) { layouts[i] = c->set_layout; }
+
+    VkDescriptorSetAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = c->descriptor_pool;
+    alloc_info.descriptorSetCount = c->frames;
+    alloc_info.pSetLayouts = layouts;
+    if (vkAllocateDescriptorSets(c->device, &alloc_info, c->sets) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < c->frames; i++)
+    {
+        write_binding(c, c->sets[i], 1, c->instances);
+        write_binding(c, c->sets[i], 2, c->draws);
+    }
+    return 1;
+}
+
+// public api -----------------------------------------------------------------
+
+int cull_create(struct cull * c, struct gpu_allocator * allocator,
+        VkDevice device, VkPipelineCache pipeline_cache, enum render_source source,
+        uint32_t capacity, int frames)
+{
+    memset(c, 0, sizeof(struct cull));
+    c->allocator = allocator;
+    c->device = device;
+    c->host = allocator->host;
+    c->source = source;
+    c->stride = record_sizes[source];
+    c->capacity = capacity;
+    c->frames = frames;
+
+    if (capacity < 1 || frames < 1 || frames > FRAMES_MAX ||
+        !create_buffers(c) ||
+        !create_pipeline(c, pipeline_cache) ||
+        !create_descriptors(c))
+    {
+        printf("Error: couldnt set up the cull pass\n");
+        cull_destroy(c);
+        return 0;
+    }
+
+    return 1;
+}
+
+void cull_destroy(struct cull * c)
+{
+    if (c->device == VK_NULL_HANDLE) { return; }
+
+    if (c->pipeline != VK_NULL_HANDLE) { vkDestroyPipeline(c->device, c->pipeline, c->host); }
+    if (c->descriptor_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(c->device, c->descriptor_pool, c->host);
+    }
+    if (c->layout != VK_NULL_HANDLE) { vkDestroyPipelineLayout(c->device, c->layout, c->host); }
+    if (c->set_layout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(c->device, c->set_layout, c->host);
+    }
+    gpu_destroy_buffer(c->allocator, c->instances, &c->instances_memory);
+    gpu_destroy_buffer(c->allocator, c->draws, &c->draws_memory);
+    gpu_destroy_buffer(c->allocator, c->readback, &c->readback_memory);
+
+    memset(c, 0, sizeof(struct cull));
+}
+
+// add what slot's last pass counted to the totals
+static void collect(struct cull * c, int slot)
+{
+    const struct cull_draws * d =
+        (const struct cull_draws *) c->readback_memory.mapped + slot;
+    uint64_t drawn = 0;
+    for (int lod = 0; lod < RENDER_LODS; lod++)
+    {
+        c->stats.drawn[lod] += d->lods[lod].instanceCount;
+        drawn += d->lods[lod].instanceCount;
+    }
+    c->stats.frames++;
+    c->stats.boids += c->recorded[slot];
+    c->stats.small += d->small;
+    c->stats.outside += c->recorded[slot] - drawn - d->small;
+    c->recorded[slot] = 0;
+}
+
+void cull_record(struct cull * c, const struct renderer * r, VkCommandBuffer command_buffer,
+        int slot, VkBuffer instances, VkDeviceSize offset, uint32_t count)
+{
+    if (c->recorded[slot] != 0) { collect(c, slot); }
+    if (count > c->capacity) { count = c->capacity; }
+
+    // the set's last frame is done, point it at this frame's records
+    write_binding(c, c->sets[slot], 0, instances);
+
+    // the previous frame may still be drawing from the commands and
+    // records this pass overwrites, or copying its counts out
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, NULL, 0, NULL, 0, NULL);
+
+    // the commands start with no instances, the pass adds them
+    struct cull_draws draws = {0};
+    for (int lod = 0; lod < RENDER_LODS; lod++)
+    {
+        draws.lods[lod].indexCount = r->lods[lod].index_count;
+        draws.lods[lod].firstIndex = r->lods[lod].first_index;
+        draws.lods[lod].vertexOffset = r->lods[lod].vertex_offset;
+    }
+    vkCmdUpdateBuffer(command_buffer, c->draws, 0, sizeof(draws), &draws);
+
+    VkMemoryBarrier clear_barrier = {0};
+    clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clear_barrier, 0, NULL, 0, NULL);
+
+    struct cull_push push = {0};
+    float pixels = render_camera(r, push.view_projection);
+    push.bounds[0] = r->bounds[0];
+    push.bounds[1] = r->bounds[1];
+    push.bounds[2] = r->bounds[2];
+    push.bounds[3] = RENDER_BOID_SCALE;
+    push.lod[0] = pixels;
+    push.lod[1] = CULL_SKIP_PIXELS;
+    push.lod[2] = CULL_QUAD_PIXELS;
+    push.range[0] = count;
+    push.range[1] = (uint32_t) (offset / c->stride);
+    push.range[2] = c->capacity;
+
+    if (count > 0)
+    {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, c->pipeline);
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                c->layout, 0, 1, &c->sets[slot], 0, NULL);
+        vkCmdPushConstants(command_buffer, c->layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                0, sizeof(push), &push);
+        vkCmdDispatch(command_buffer, (count + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    }
+
+    // the draws read the commands and records, the copy the counts
+    VkMemoryBarrier out_barrier = {0};
+    out_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    out_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    out_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &out_barrier, 0, NULL, 0, NULL);
+
+    VkBufferCopy region = { 0, sizeof(struct cull_draws) * slot, sizeof(struct cull_draws) };
+    vkCmdCopyBuffer(command_buffer, c->draws, c->readback, 1, &region);
+
+    VkMemoryBarrier host_barrier = {0};
+    host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0, 1, &host_barrier, 0, NULL, 0, NULL);
+
+    c->recorded[slot] = count;
+}
+
+void cull_flush(struct cull * c)
+{
+    for (int slot = 0; slot < c->frames; slot++)
+    {
+        if (c->recorded[slot] != 0) { collect(c, slot); }
+    }
+}
+
+VkDeviceSize cull_offset(const struct cull * c, int lod)
+{
+    return c->stride * c->capacity * lod;
+}
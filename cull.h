@@ -0,0 +1,95 @@
+/*
+   cull.h
+   gpu frustum culling and level of detail, feeding indirect draws
+*/
+
+#ifndef CULL
+#define CULL
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#include "frames.h"
+#include "gpu_alloc.h"
+#include "render.h"
+
+// a boid whose radius on screen is under this many pixels is skipped, and
+// one under CULL_QUAD_PIXELS drawn as a quad
+#define CULL_SKIP_PIXELS 0.5f
+#define CULL_QUAD_PIXELS 3.0f
+
+// what the pass writes: a draw command per lod, then the count of boids in
+// view but too small to draw. read back as is, see struct cull_stats
+struct cull_draws
+{
+    VkDrawIndexedIndirectCommand lods[RENDER_LODS];
+    uint32_t small;
+    uint32_t reserved[3];
+};
+
+// totals over every frame read back so far
+struct cull_stats
+{
+    uint64_t frames;
+    uint64_t boids;
+    uint64_t drawn[RENDER_LODS];
+    uint64_t small;             // in view, skipped for size
+    uint64_t outside;           // out of view
+};
+
+// a compute pass over one source's instance records that drops boids out
+// of view or under a pixel, picks a lod for the rest and packs them per
+// lod into instances, counting them straight into the draw commands. the
+// cpu records the same two draws whatever the flock's size. the counts of
+// each slot are copied out and read once its fence comes round again
+struct cull
+{
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // the allocator's, for every object
+    enum render_source source;
+    VkDeviceSize stride;        // bytes per instance record of source
+    uint32_t capacity;          // boids per lod in instances
+    int frames;
+
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet sets[FRAMES_MAX];   // per slot, their input changes
+
+    VkBuffer instances;         // RENDER_LODS runs of capacity records
+    struct gpu_allocation instances_memory;
+    VkBuffer draws;             // struct cull_draws, indirect and storage
+    struct gpu_allocation draws_memory;
+    VkBuffer readback;          // a struct cull_draws per slot, host visible
+    struct gpu_allocation readback_memory;
+
+    uint32_t recorded[FRAMES_MAX];      // boids culled in the slot's last use
+    struct cull_stats stats;
+};
+
+// pass for up to capacity boids of source in frames slots. the pipeline
+// comes from pipeline_cache when it is not VK_NULL_HANDLE. returns 0 on
+// failure, after cleaning up
+int cull_create(struct cull * c, struct gpu_allocator * allocator,
+        VkDevice device, VkPipelineCache pipeline_cache, enum render_source source,
+        uint32_t capacity, int frames);
+
+void cull_destroy(struct cull * c);
+
+// once slot's fence is done: count its last results, then record the pass
+// over count records of instances from offset, a whole number of records,
+// for r's current camera. instances need storage buffer usage. it ends
+// with the draws ready for render_record_culled
+void cull_record(struct cull * c, const struct renderer * r, VkCommandBuffer command_buffer,
+        int slot, VkBuffer instances, VkDeviceSize offset, uint32_t count);
+
+// count every slot's results, once the device is idle
+void cull_flush(struct cull * c);
+
+// where lod's records start in instances
+VkDeviceSize cull_offset(const struct cull * c, int lod);
+
+
+#endif
@@ -0,0 +1,244 @@
+/*
+   fractal.c
+   layered perlin noise: fractal brownian motion and turbulence
+
+   every octave count up to FRACTAL_MAX_SPECIALIZED gets its own copy of the
+   kernels with the count as a compile time constant, so the octave loop is
+   fully unrolled and the per octave frequency and amplitude sit in
+   registers. grids are evaluated a row chunk at a time, one perlin_raw_batch
+   call per octave, so a layered field costs its octaves and little else
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fractal.h"
+#include "perlin.h"
+
+// samples per row chunk, sized so the chunk buffers stay in L1
+#define CHUNK 256
+
+#define INLINE static inline __attribute__((always_inline))
+
+// per octave frequency and amplitude, computed once per call
+struct octaves
+{
+    float freq[FRACTAL_MAX_OCTAVES];
+    float amp[FRACTAL_MAX_OCTAVES];
+    float norm;             // 1 / sum of amplitudes
+};
+
+static void octaves_init(struct octaves * o, const struct fractal * f, int count)
+{
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float sum = 0.0f;
+
+    for (int i = 0; i < count; i++)
+    {
+        o->freq[i] = freq;
+        o->amp[i] = amp;
+        sum += amp;
+        freq *= f->lacunarity;
+        amp *= f->gain;
+    }
+    o->norm = 1.0f / sum;
+}
+
+// generic kernels -------------------------------------------------------------
+
+// single sample, count and turbulence are constants in the specializations
+INLINE float sample(const perlin_ctx * ctx, const struct octaves * o, float y, float x,
+        const int count, const int turbulence)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        float n = perlin_raw(ctx, y * o->freq[i], x * o->freq[i]);
+        sum += o->amp[i] * (turbulence ? fabsf(n) : n);
+    }
+    return sum;
+}
+
+// n samples along a row, one batched perlin call per octave
+INLINE void row(const perlin_ctx * ctx, const struct octaves * o, float * out, float y, const float * xs,
+        int n, const int count, const int turbulence)
+{
+    float ys[CHUNK], xo[CHUNK], noise[CHUNK];
+
+    // callers hand over at most a chunk, said here so the scratch buffers
+    // are seen to be filled before the batch reads them
+    if (n <= 0) { return; }
+    if (n > CHUNK) { n = CHUNK; }
+    for (int j = 0; j < n; j++) { out[j] = 0.0f; }
+
+    for (int i = 0; i < count; i++)
+    {
+        const float freq = o->freq[i];
+        const float amp = o->amp[i];
+
+        for (int j = 0; j < n; j++)
+        {
+            ys[j] = y * freq;
+            xo[j] = xs[j] * freq;
+        }
+        perlin_raw_batch(ctx, noise, ys, xo, n);
+        for (int j = 0; j < n; j++)
+        {
+            out[j] += amp * (turbulence ? fabsf(noise[j]) : noise[j]);
+        }
+    }
+}
+
+// specializations -------------------------------------------------------------
+
+typedef float (*sample_fn)(const perlin_ctx *, const struct octaves *, float, float);
+typedef void (*row_fn)(const perlin_ctx *, const struct octaves *, float *, float,
+        const float *, int);
+
+#define SPECIALIZE(N)                                                           \
+    static float sample_fbm_##N(const perlin_ctx * ctx,                         \
+            const struct octaves * o, float y, float x)                         \
+    { return sample(ctx, o, y, x, N, 0); }                                      \
+    static float sample_turb_##N(const perlin_ctx * ctx,                        \
+            const struct octaves * o, float y, float x)                         \
+    { return sample(ctx, o, y, x, N, 1); }                                      \
+    static void row_fbm_##N(const perlin_ctx * ctx, const struct octaves * o,   \
+            float * out, float y, const float * xs, int n)                      \
+    { row(ctx, o, out, y, xs, n, N, 0); }                                       \
+    static void row_turb_##N(const perlin_ctx * ctx, const struct octaves * o,  \
+            float * out, float y, const float * xs, int n)                      \
+    { row(ctx, o, out, y, xs, n, N, 1); }
+
+SPECIALIZE(1)
+SPECIALIZE(2)
+SPECIALIZE(3)
+SPECIALIZE(4)
+SPECIALIZE(5)
+SPECIALIZE(6)
+SPECIALIZE(7)
+SPECIALIZE(8)
+
+// indexed by [mode][octaves - 1]
+static const sample_fn sample_table[2][FRACTAL_MAX_SPECIALIZED] =
+{
+    { sample_fbm_1, sample_fbm_2, sample_fbm_3, sample_fbm_4,
+      sample_fbm_5, sample_fbm_6, sample_fbm_7, sample_fbm_8 },
+    { sample_turb_1, sample_turb_2, sample_turb_3, sample_turb_4,
+      sample_turb_5, sample_turb_6, sample_turb_7, sample_turb_8 }
+};
+
+static const row_fn row_table[2][FRACTAL_MAX_SPECIALIZED] =
+{
+    { row_fbm_1, row_fbm_2, row_fbm_3, row_fbm_4,
+      row_fbm_5, row_fbm_6, row_fbm_7, row_fbm_8 },
+    { row_turb_1, row_turb_2, row_turb_3, row_turb_4,
+      row_turb_5, row_turb_6, row_turb_7, row_turb_8 }
+};
+
+// fallbacks for more octaves than we specialize, same kernels with the
+// count left at runtime
+static float sample_many(const perlin_ctx * ctx, const struct octaves * o,
+        float y, float x, int count, int turbulence)
+{
+    return sample(ctx, o, y, x, count, turbulence);
+}
+
+static void row_many(const perlin_ctx * ctx, const struct octaves * o,
+        float * out, float y, const float * xs, int n, int count, int turbulence)
+{
+    row(ctx, o, out, y, xs, n, count, turbulence);
+}
+
+// public api ------------------------------------------------------------------
+
+static int octave_count(const struct fractal * f)
+{
+    return f->octaves < 1 ? 1 :
+        f->octaves > FRACTAL_MAX_OCTAVES ? FRACTAL_MAX_OCTAVES : f->octaves;
+}
+
+// map a normalized value to 0 to 255 like perlin() does
+static inline int quantize(const struct fractal * f, float v)
+{
+    int q = f->mode == FRACTAL_TURBULENCE
+        ? v / SQRT22 * 255
+        : (SQRT22 + v) / 2 / SQRT22 * 255;
+    return q < 0 ? 0 : q > 255 ? 255 : q;
+}
+
+// raw value at y, x with octaves o already worked out for count
+static float raw_octaves(const perlin_ctx * ctx, const struct fractal * f,
+        const struct octaves * o, int count, float y, float x)
+{
+    int turbulence = f->mode == FRACTAL_TURBULENCE;
+    if (count > FRACTAL_MAX_SPECIALIZED)
+    {
+        return sample_many(ctx, o, y, x, count, turbulence);
+    }
+    return sample_table[turbulence][count - 1](ctx, o, y, x);
+}
+
+// raw fractal value at y, x in lattice units
+float fractal_raw(const perlin_ctx * ctx, const struct fractal * f,
+        float y, float x)
+{
+    int count = octave_count(f);
+    struct octaves o;
+    octaves_init(&o, f, count);
+    return raw_octaves(ctx, f, &o, count, y, x);
+}
+
+// fractal value from 0 to 255 at integer pixel coordinates
+int fractal(const perlin_ctx * ctx, const struct fractal * f, int y, int x)
+{
+    int count = octave_count(f);
+    struct octaves o;
+    octaves_init(&o, f, count);
+
+    float raw = raw_octaves(ctx, f, &o, count, (y + 0.5) / 8, (x + 0.5) / 8);
+    return quantize(f, raw * o.norm);
+}
+
+// fill a caller-owned buffer with fractal() values
+void fractal_fill_grid(const perlin_ctx * ctx, const struct fractal * f,
+        uint8_t * out, int width, int height, int origin_y, int origin_x,
+        int stride)
+{
+    int count = octave_count(f);
+    int turbulence = f->mode == FRACTAL_TURBULENCE;
+    struct octaves o;
+    octaves_init(&o, f, count);
+
+    float xs[CHUNK], values[CHUNK];
+
+    for (int r = 0; r < height; r++)
+    {
+        float y = (origin_y + r + 0.5) / 8;
+        uint8_t * dst = out + (size_t) r * stride;
+
+        for (int c0 = 0; c0 < width; c0 += CHUNK)
+        {
+            int n = width - c0 < CHUNK ? width - c0 : CHUNK;
+            for (int j = 0; j < n; j++)
+            {
+                xs[j] = (origin_x + c0 + j + 0.5) / 8;
+            }
+
+            if (count <= FRACTAL_MAX_SPECIALIZED)
+            {
+                row_table[turbulence][count - 1](ctx, &o, values, y, xs, n);
+            }
+            else
+            {
+                row_many(ctx, &o, values, y, xs, n, count, turbulence);
+            }
+
+            for (int j = 0; j < n; j++)
+            {
+                dst[c0 + j] = quantize(f, values[j] * o.norm);
+            }
+        }
+    }
+}
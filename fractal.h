@@ -0,0 +1,49 @@
+/*
+   fractal.h
+   layered perlin noise: fractal brownian motion and turbulence
+*/
+
+#ifndef FRACTAL
+#define FRACTAL
+
+#include <stdint.h>
+
+#include "perlin.h"
+
+// octave counts with a compile time specialized kernel, more still work
+// through the generic loop up to FRACTAL_MAX_OCTAVES
+#define FRACTAL_MAX_SPECIALIZED 8
+#define FRACTAL_MAX_OCTAVES 32
+
+// how octaves are combined
+enum fractal_mode
+{
+    FRACTAL_FBM = 0,        // signed sum of octaves
+    FRACTAL_TURBULENCE      // sum of absolute octaves, billowy look
+};
+
+struct fractal
+{
+    enum fractal_mode mode;
+    int octaves;            // number of layers, 1 to FRACTAL_MAX_OCTAVES
+    float lacunarity;       // frequency multiplier per octave, usually 2
+    float gain;             // amplitude multiplier per octave, usually 0.5
+};
+
+// raw fractal value at y, x in lattice units. fbm lies within
+// +/-sqrt2/2 * sum of amplitudes, turbulence within 0 and that
+float fractal_raw(const perlin_ctx * ctx, const struct fractal * f,
+        float y, float x);
+
+// fractal value from 0 to 255 at integer pixel coordinates, using the same
+// base frequency as perlin() and normalized by the sum of amplitudes
+int fractal(const perlin_ctx * ctx, const struct fractal * f, int y, int x);
+
+// fill a caller-owned width x height buffer (rows stride bytes apart) with
+// fractal() values starting at pixel origin_y, origin_x
+void fractal_fill_grid(const perlin_ctx * ctx, const struct fractal * f,
+        uint8_t * out, int width, int height, int origin_y, int origin_x,
+        int stride);
+
+
+#endif
@@ -0,0 +1,154 @@
+/*
+   frames.c
+   frames in flight: per frame command buffer, fence and semaphores
+*/
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frames.h"
+
+int frames_create(struct frames * f, VkDevice device, const VkAllocationCallbacks * host,
+        VkCommandPool command_pool, int count)
+{
+    memset(f, 0, sizeof(struct frames));
+    f->device = device;
+    f->host = host;
+    f->command_pool = command_pool;
+    f->current = count - 1;     // so the first begin lands on slot 0
+
+    if (count < 1 || count > FRAMES_MAX)
+    {
+        printf("Error: %d frames in flight, 1 to %d allowed\n", count, FRAMES_MAX);
+        return 0;
+    }
+
+    VkCommandBuffer command_buffers[FRAMES_MAX];
+    VkCommandBufferAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = count;
+    if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    // fences start signalled, a frame never submitted has nothing to wait for
+    VkFenceCreateInfo fence_info = {0};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    VkSemaphoreCreateInfo semaphore_info = {0};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    f->count = count;
+    for (int i = 0; i < count; i++)
+    {
+        struct frame * frame = &f->frame[i];
+        frame->command_buffer = command_buffers[i];
+        if (vkCreateFence(device, &fence_info, host, &frame->fence) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphore_info, host, &frame->image_available) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphore_info, host, &frame->render_finished) != VK_SUCCESS)
+        {
+            printf("Error: couldnt create frame %d sync objects\n", i);
+            frames_destroy(f);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+void frames_destroy(struct frames * f)
+{
+    if (f->device == VK_NULL_HANDLE) { return; }
+
+    for (int i = 0; i < f->count; i++)
+    {
+        struct frame * frame = &f->frame[i];
+        if (frame->fence != VK_NULL_HANDLE) { vkDestroyFence(f->device, frame->fence, f->host); }
+        if (frame->image_available != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(f->device, frame->image_available, f->host);
+        }
+        if (frame->render_finished != VK_NULL_HANDLE)
+        {
+            vkDestroySemaphore(f->device, frame->render_finished, f->host);
+        }
+        if (frame->command_buffer != VK_NULL_HANDLE)
+        {
+            vkFreeCommandBuffers(f->device, f->command_pool, 1, &frame->command_buffer);
+        }
+    }
+
+    memset(f, 0, sizeof(struct frames));
+}
+
+struct frame * frames_wait(struct frames * f)
+{
+    f->current = (f->current + 1) % f->count;
+    struct frame * frame = &f->frame[f->current];
+
+    // the gpu is a whole ring of frames behind, the only time the cpu blocks
+    if (vkGetFenceStatus(f->device, frame->fence) != VK_SUCCESS)
+    {
+        uint64_t start = SDL_GetPerformanceCounter();
+        if (vkWaitForFences(f->device, 1, &frame->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+        {
+            return NULL;
+        }
+        f->stats.waits++;
+        f->stats.wait_ms += 1000.0 * (SDL_GetPerformanceCounter() - start) /
+            SDL_GetPerformanceFrequency();
+    }
+
+    // submits finish in order, so everything up to this frame's is done
+    if (frame->serial > f->completed) { f->completed = frame->serial; }
+
+    // the fence is only reset at submit, so a frame dropped before then
+    // (ie swapchain out of date) leaves it signalled for next time. its
+    // command buffer is only begun once the frame is sure to be submitted
+    return frame;
+}
+
+int frames_record(struct frame * frame)
+{
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    return vkBeginCommandBuffer(frame->command_buffer, &begin_info) == VK_SUCCESS;
+}
+
+struct frame * frames_begin(struct frames * f)
+{
+    struct frame * frame = frames_wait(f);
+    if (frame == NULL || !frames_record(frame)) { return NULL; }
+    return frame;
+}
+
+VkResult frames_submit(struct frames * f, VkQueue queue, struct frame * frame, int presenting)
+{
+    VkResult result = vkEndCommandBuffer(frame->command_buffer);
+    if (result != VK_SUCCESS) { return result; }
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.waitSemaphoreCount = presenting ? 1 : 0;
+    submit_info.pWaitSemaphores = &frame->image_available;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame->command_buffer;
+    submit_info.signalSemaphoreCount = presenting ? 1 : 0;
+    submit_info.pSignalSemaphores = &frame->render_finished;
+
+    vkResetFences(f->device, 1, &frame->fence);
+    result = vkQueueSubmit(queue, 1, &submit_info, frame->fence);
+    if (result != VK_SUCCESS) { return result; }
+
+    frame->serial = ++f->serial;
+    f->stats.frames++;
+    return VK_SUCCESS;
+}
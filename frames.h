@@ -0,0 +1,71 @@
+/*
+   frames.h
+   frames in flight: per frame command buffer, fence and semaphores
+*/
+
+#ifndef FRAMES
+#define FRAMES
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#define FRAMES_MAX 8
+
+struct frame
+{
+    VkCommandBuffer command_buffer;
+    VkFence fence;                  // signalled when the frame's submit is done
+    VkSemaphore image_available;    // acquire to render
+    VkSemaphore render_finished;    // render to present
+    uint64_t serial;                // submit number of the frame's last use
+};
+
+struct frames_stats
+{
+    uint64_t frames;            // frames submitted
+    uint64_t waits;             // frames that found the gpu still busy with
+                                // their previous use and had to wait
+    double wait_ms;             // time spent in those waits
+};
+
+// count frames recorded and submitted round robin. while the gpu works on
+// one the cpu records the next, a frame only waits when it comes round to
+// a slot whose previous submit has not finished
+struct frames
+{
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // for the sync objects, NULL is fine
+    VkCommandPool command_pool;
+    int count;
+    int current;                // slot of the frame being recorded
+    uint64_t serial;            // serial of the latest submit
+    uint64_t completed;         // serial known to have finished
+    struct frame frame[FRAMES_MAX];
+    struct frames_stats stats;
+};
+
+// count <= FRAMES_MAX frames from command_pool. returns 0 on failure
+int frames_create(struct frames * f, VkDevice device, const VkAllocationCallbacks * host,
+        VkCommandPool command_pool, int count);
+
+// the device must be idle
+void frames_destroy(struct frames * f);
+
+// move to the next frame and wait until the gpu is done with it. NULL on
+// failure
+struct frame * frames_wait(struct frames * f);
+
+// begin the frame's command buffer. returns 0 on failure. a frame that is
+// dropped after this, rather than submitted, leaves it recording
+int frames_record(struct frame * frame);
+
+// frames_wait then frames_record, for a frame that is always submitted
+struct frame * frames_begin(struct frames * f);
+
+// end the frame's command buffer and submit it, signalling the fence. a
+// presenting frame also waits for its image at the color output stage and
+// signals render_finished, an offscreen one uses no semaphores
+VkResult frames_submit(struct frames * f, VkQueue queue, struct frame * frame, int presenting);
+
+
+#endif
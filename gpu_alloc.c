@@ -0,0 +1,512 @@
+/*
+   gpu_alloc.c
+   device memory sub-allocated out of large blocks per memory type
+
+   drivers cap live vkAllocateMemory calls (maxMemoryAllocationCount, 4096
+   on many) and round each one up to a large page, so a buffer per
+   allocation wastes memory and runs out with many small buffers. blocks
+   are allocated block_size at a time and split first fit. freed ranges
+   merge with their neighbours, an empty block is kept for reuse unless
+   another empty one of its type already is
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_alloc.h"
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// free lists ------------------------------------------------------------------
+
+static int insert_range(struct gpu_block * b, int at, VkDeviceSize offset, VkDeviceSize size)
+{
+    if (b->free_count == b->free_capacity)
+    {
+        int capacity = b->free_capacity ? 2 * b->free_capacity : 16;
+        struct gpu_range * grown = realloc(b->free, sizeof(struct gpu_range) * capacity);
+        if (grown == NULL) { return 0; }
+        b->free = grown;
+        b->free_capacity = capacity;
+    }
+
+    memmove(&b->free[at + 1], &b->free[at], sizeof(struct gpu_range) * (b->free_count - at));
+    b->free[at] = (struct gpu_range) { offset, size };
+    b->free_count++;
+    return 1;
+}
+
+static void remove_range(struct gpu_block * b, int at)
+{
+    memmove(&b->free[at], &b->free[at + 1], sizeof(struct gpu_range) * (b->free_count - at - 1));
+    b->free_count--;
+}
+
+// first fit of size at alignment, its offset in offset
+static int take_range(struct gpu_block * b, VkDeviceSize size, VkDeviceSize alignment,
+        VkDeviceSize * offset)
+{
+    for (int i = 0; i < b->free_count; i++)
+    {
+        struct gpu_range r = b->free[i];
+        VkDeviceSize start = align_up(r.offset, alignment);
+        if (start + size > r.offset + r.size) { continue; }
+
+        // what is left either side of the allocation stays free
+        VkDeviceSize end = start + size;
+        VkDeviceSize tail = r.offset + r.size - end;
+        if (start > r.offset)
+        {
+            b->free[i].size = start - r.offset;
+            if (tail > 0 && !insert_range(b, i + 1, end, tail)) { return 0; }
+        }
+        else if (tail > 0)
+        {
+            b->free[i] = (struct gpu_range) { end, tail };
+        }
+        else
+        {
+            remove_range(b, i);
+        }
+
+        *offset = start;
+        return 1;
+    }
+    return 0;
+}
+
+// put a range back, merged with the free ranges it touches
+static int give_range(struct gpu_block * b, VkDeviceSize offset, VkDeviceSize size)
+{
+    int at = 0;
+    while (at < b->free_count && b->free[at].offset < offset) { at++; }
+
+    int before = at > 0 && b->free[at - 1].offset + b->free[at - 1].size == offset;
+    int after = at < b->free_count && offset + size == b->free[at].offset;
+
+    if (before && after)
+    {
+        b->free[at - 1].size += size + b->free[at].size;
+        remove_range(b, at);
+    }
+    else if (before)
+    {
+        b->free[at - 1].size += size;
+    }
+    else if (after)
+    {
+        b->free[at].offset = offset;
+        b->free[at].size += size;
+    }
+    else
+    {
+        return insert_range(b, at, offset, size);
+    }
+    return 1;
+}
+
+// blocks ----------------------------------------------------------------------
+
+static int live_blocks(const struct gpu_allocator * a)
+{
+    int live = 0;
+    for (int i = 0; i < a->block_count; i++)
+    {
+        if (a->blocks[i].memory != VK_NULL_HANDLE) { live++; }
+    }
+    return live;
+}
+
+static void release_block(struct gpu_allocator * a, int index)
+{
+    struct gpu_block * b = &a->blocks[index];
+    if (b->mapped != NULL) { vkUnmapMemory(a->device, b->memory); }
+    vkFreeMemory(a->device, b->memory, a->host);
+    free(b->free);
+    memset(b, 0, sizeof(struct gpu_block));
+
+    while (a->block_count > 0 && a->blocks[a->block_count - 1].memory == VK_NULL_HANDLE)
+    {
+        a->block_count--;
+    }
+}
+
+// a new block of size bytes of type, its index or -1
+static int add_block(struct gpu_allocator * a, VkDeviceSize size, uint32_t type,
+        int images, int dedicated)
+{
+    int index = 0;
+    while (index < a->block_count && a->blocks[index].memory != VK_NULL_HANDLE) { index++; }
+    if (index == GPU_MAX_BLOCKS ||
+        (a->max_device_allocations && (uint32_t) live_blocks(a) >= a->max_device_allocations))
+    {
+        printf("Error: couldnt add a memory block, %d in use\n", live_blocks(a));
+        return -1;
+    }
+
+    VkMemoryAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = type;
+
+    struct gpu_block * b = &a->blocks[index];
+    memset(b, 0, sizeof(struct gpu_block));
+    if (vkAllocateMemory(a->device, &alloc_info, a->host, &b->memory) != VK_SUCCESS)
+    {
+        b->memory = VK_NULL_HANDLE;
+        return -1;
+    }
+    b->size = size;
+    b->type = type;
+    b->images = images;
+    b->dedicated = dedicated;
+
+    // mapped for good, a block can only be mapped once at a time anyway
+    VkMemoryPropertyFlags properties = a->memory_properties.memoryTypes[type].propertyFlags;
+    if ((properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+        vkMapMemory(a->device, b->memory, 0, VK_WHOLE_SIZE, 0, (void **) &b->mapped) != VK_SUCCESS)
+    {
+        b->mapped = NULL;
+        if (index >= a->block_count) { a->block_count = index + 1; }
+        release_block(a, index);
+        return -1;
+    }
+
+    if (index >= a->block_count) { a->block_count = index + 1; }
+    if (!dedicated && !insert_range(b, 0, 0, size))
+    {
+        release_block(a, index);
+        return -1;
+    }
+    return index;
+}
+
+// allocate from block index, 0 if it has no room
+static int alloc_from(struct gpu_allocator * a, int index, const VkMemoryRequirements * requirements,
+        struct gpu_allocation * allocation)
+{
+    struct gpu_block * b = &a->blocks[index];
+    VkDeviceSize offset = 0;
+    if (b->dedicated)
+    {
+        if (b->live > 0) { return 0; }
+    }
+    else if (!take_range(b, requirements->size, requirements->alignment, &offset))
+    {
+        return 0;
+    }
+
+    b->live++;
+    b->used += requirements->size;
+    allocation->memory = b->memory;
+    allocation->offset = offset;
+    allocation->size = requirements->size;
+    allocation->mapped = b->mapped != NULL ? b->mapped + offset : NULL;
+    allocation->block = index;
+    return 1;
+}
+
+// allocator -------------------------------------------------------------------
+
+int gpu_allocator_create(struct gpu_allocator * a, VkPhysicalDevice physical_device,
+        VkDevice device, VkDeviceSize block_size, const VkAllocationCallbacks * host)
+{
+    memset(a, 0, sizeof(struct gpu_allocator));
+    a->physical_device = physical_device;
+    a->device = device;
+    a->host = host;
+    a->block_size = block_size ? block_size : GPU_BLOCK_SIZE;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &a->memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    a->max_device_allocations = properties.limits.maxMemoryAllocationCount;
+    return 1;
+}
+
+void gpu_allocator_destroy(struct gpu_allocator * a)
+{
+    for (int i = a->block_count - 1; i >= 0; i--)
+    {
+        if (a->blocks[i].memory == VK_NULL_HANDLE) { continue; }
+        if (a->blocks[i].live > 0)
+        {
+            printf("Error: memory block %d freed with %d allocations live\n",
+                    i, a->blocks[i].live);
+        }
+        release_block(a, i);
+    }
+    memset(a, 0, sizeof(struct gpu_allocator));
+}
+
+int gpu_alloc(struct gpu_allocator * a, const VkMemoryRequirements * requirements,
+        VkMemoryPropertyFlags flags, int image, struct gpu_allocation * allocation)
+{
+    memset(allocation, 0, sizeof(struct gpu_allocation));
+    allocation->block = -1;
+    VkMemoryRequirements r = *requirements;
+    if (r.alignment == 0) { r.alignment = 1; }
+
+    // too big to share a block, it gets one of its own
+    int dedicated = r.size > a->block_size / 2;
+
+    for (uint32_t type = 0; type < a->memory_properties.memoryTypeCount; type++)
+    {
+        if (!(r.memoryTypeBits & (1u << type)) ||
+            (a->memory_properties.memoryTypes[type].propertyFlags & flags) != flags)
+        {
+            continue;
+        }
+
+        for (int i = 0; !dedicated && i < a->block_count; i++)
+        {
+            const struct gpu_block * b = &a->blocks[i];
+            if (b->memory == VK_NULL_HANDLE || b->dedicated ||
+                b->type != type || b->images != image)
+            {
+                continue;
+            }
+            if (alloc_from(a, i, &r, allocation)) { return 1; }
+        }
+
+        int index = add_block(a, dedicated ? r.size : a->block_size, type, image, dedicated);
+        if (index >= 0 && alloc_from(a, index, &r, allocation)) { return 1; }
+
+        // that heap may be full, the next matching type may not be
+    }
+
+    printf("Error: couldnt allocate %lu bytes of device memory\n", (unsigned long) r.size);
+    return 0;
+}
+
+void gpu_free(struct gpu_allocator * a, struct gpu_allocation * allocation)
+{
+    if (allocation->block < 0 || allocation->memory == VK_NULL_HANDLE) { return; }
+
+    int index = allocation->block;
+    VkDeviceSize offset = allocation->offset;
+    VkDeviceSize size = allocation->size;
+    memset(allocation, 0, sizeof(struct gpu_allocation));
+    allocation->block = -1;
+
+    struct gpu_block * b = &a->blocks[index];
+    b->live--;
+    b->used -= size;
+    if (b->dedicated)
+    {
+        release_block(a, index);
+        return;
+    }
+
+    // a failed merge only loses the range until the block goes
+    give_range(b, offset, size);
+    if (b->live > 0) { return; }
+
+    // keep one empty block per type for the next allocation
+    for (int i = 0; i < a->block_count; i++)
+    {
+        const struct gpu_block * other = &a->blocks[i];
+        if (i != index && other->memory != VK_NULL_HANDLE && !other->dedicated &&
+            other->live == 0 && other->type == b->type && other->images == b->images)
+        {
+            release_block(a, index);
+            return;
+        }
+    }
+}
+
+void gpu_allocator_stats(const struct gpu_allocator * a, struct gpu_allocator_stats * stats)
+{
+    memset(stats, 0, sizeof(struct gpu_allocator_stats));
+    for (int i = 0; i < a->block_count; i++)
+    {
+        const struct gpu_block * b = &a->blocks[i];
+        if (b->memory == VK_NULL_HANDLE) { continue; }
+
+        stats->blocks++;
+        stats->dedicated += b->dedicated;
+        stats->block_bytes += b->size;
+        stats->used_bytes += b->used;
+        stats->allocations += b->live;
+        for (int r = 0; r < b->free_count; r++)
+        {
+            stats->free_bytes += b->free[r].size;
+            if (b->free[r].size > stats->largest_free) { stats->largest_free = b->free[r].size; }
+        }
+    }
+
+    if (stats->free_bytes > 0)
+    {
+        stats->fragmentation = 1.0f - (float) stats->largest_free / (float) stats->free_bytes;
+    }
+}
+
+// resources -------------------------------------------------------------------
+
+int gpu_create_buffer(struct gpu_allocator * a, VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags flags, VkBuffer * buffer, struct gpu_allocation * allocation)
+{
+    memset(allocation, 0, sizeof(struct gpu_allocation));
+    allocation->block = -1;
+
+    VkBufferCreateInfo buffer_info = {0};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(a->device, &buffer_info, a->host, buffer) != VK_SUCCESS)
+    {
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(a->device, *buffer, &requirements);
+    if (!gpu_alloc(a, &requirements, flags, 0, allocation) ||
+        vkBindBufferMemory(a->device, *buffer, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        gpu_destroy_buffer(a, *buffer, allocation);
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+void gpu_destroy_buffer(struct gpu_allocator * a, VkBuffer buffer,
+        struct gpu_allocation * allocation)
+{
+    if (buffer != VK_NULL_HANDLE) { vkDestroyBuffer(a->device, buffer, a->host); }
+    gpu_free(a, allocation);
+}
+
+int gpu_bind_image(struct gpu_allocator * a, VkImage image, VkMemoryPropertyFlags flags,
+        struct gpu_allocation * allocation)
+{
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(a->device, image, &requirements);
+    if (!gpu_alloc(a, &requirements, flags, 1, allocation)) { return 0; }
+
+    if (vkBindImageMemory(a->device, image, allocation->memory, allocation->offset) != VK_SUCCESS)
+    {
+        gpu_free(a, allocation);
+        return 0;
+    }
+    return 1;
+}
+
+// linear ----------------------------------------------------------------------
+
+int gpu_linear_create(struct gpu_linear * linear, struct gpu_allocator * a,
+        VkDeviceSize size, uint32_t type_bits, VkMemoryPropertyFlags flags)
+{
+    memset(linear, 0, sizeof(struct gpu_linear));
+    linear->allocator = a;
+
+    // aligned for anything a buffer asks of its memory
+    VkMemoryRequirements requirements = { size, 256, type_bits };
+    return gpu_alloc(a, &requirements, flags, 0, &linear->range);
+}
+
+void gpu_linear_destroy(struct gpu_linear * linear)
+{
+    if (linear->allocator != NULL) { gpu_free(linear->allocator, &linear->range); }
+    memset(linear, 0, sizeof(struct gpu_linear));
+}
+
+int gpu_linear_alloc(struct gpu_linear * linear, const VkMemoryRequirements * requirements,
+        struct gpu_allocation * allocation)
+{
+    const struct gpu_block * b = &linear->allocator->blocks[linear->range.block];
+    VkDeviceSize alignment = requirements->alignment ? requirements->alignment : 1;
+
+    // alignment is of the offset into the memory, not into the range
+    VkDeviceSize start = align_up(linear->range.offset + linear->top, alignment);
+    if (!(requirements->memoryTypeBits & (1u << b->type)) ||
+        start + requirements->size > linear->range.offset + linear->range.size)
+    {
+        return 0;
+    }
+
+    linear->top = start + requirements->size - linear->range.offset;
+    allocation->memory = linear->range.memory;
+    allocation->offset = start;
+    allocation->size = requirements->size;
+    allocation->mapped = b->mapped != NULL ? b->mapped + start : NULL;
+    allocation->block = -1;     // not for gpu_free, the range goes as a whole
+    return 1;
+}
+
+void gpu_linear_reset(struct gpu_linear * linear)
+{
+    linear->top = 0;
+}
+
+// pool ------------------------------------------------------------------------
+
+int gpu_pool_create(struct gpu_pool * pool, struct gpu_allocator * a,
+        VkDeviceSize slot, VkDeviceSize alignment, int count,
+        uint32_t type_bits, VkMemoryPropertyFlags flags)
+{
+    memset(pool, 0, sizeof(struct gpu_pool));
+    pool->allocator = a;
+    pool->slot = align_up(slot, alignment);
+    pool->count = count;
+
+    pool->free_slots = malloc(sizeof(int) * count);
+    if (pool->free_slots == NULL) { return 0; }
+    for (int i = 0; i < count; i++) { pool->free_slots[i] = count - 1 - i; }
+    pool->free_count = count;
+
+    VkMemoryRequirements requirements = { pool->slot * count, alignment, type_bits };
+    if (!gpu_alloc(a, &requirements, flags, 0, &pool->range))
+    {
+        gpu_pool_destroy(pool);
+        return 0;
+    }
+    return 1;
+}
+
+void gpu_pool_destroy(struct gpu_pool * pool)
+{
+    if (pool->allocator != NULL) { gpu_free(pool->allocator, &pool->range); }
+    free(pool->free_slots);
+    memset(pool, 0, sizeof(struct gpu_pool));
+}
+
+int gpu_pool_alloc(struct gpu_pool * pool, const VkMemoryRequirements * requirements,
+        struct gpu_allocation * allocation)
+{
+    const struct gpu_block * b = &pool->allocator->blocks[pool->range.block];
+    VkDeviceSize alignment = requirements->alignment ? requirements->alignment : 1;
+
+    // slots start at multiples of the pool's alignment, which must cover it
+    if (pool->free_count == 0 || requirements->size > pool->slot ||
+        (pool->range.offset | pool->slot) & (alignment - 1) ||
+        !(requirements->memoryTypeBits & (1u << b->type)))
+    {
+        return 0;
+    }
+
+    int slot = pool->free_slots[--pool->free_count];
+    VkDeviceSize offset = pool->range.offset + pool->slot * slot;
+    allocation->memory = pool->range.memory;
+    allocation->offset = offset;
+    allocation->size = pool->slot;
+    allocation->mapped = b->mapped != NULL ? b->mapped + offset : NULL;
+    allocation->block = -1;     // not for gpu_free, gpu_pool_free takes it back
+    return 1;
+}
+
+void gpu_pool_free(struct gpu_pool * pool, struct gpu_allocation * allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE) { return; }
+
+    int slot = (int) ((allocation->offset - pool->range.offset) / pool->slot);
+    pool->free_slots[pool->free_count++] = slot;
+    memset(allocation, 0, sizeof(struct gpu_allocation));
+    allocation->block = -1;
+}
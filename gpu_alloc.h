@@ -0,0 +1,152 @@
+/*
+   gpu_alloc.h
+   device memory sub-allocated out of large blocks per memory type
+*/
+
+#ifndef GPU_ALLOC
+#define GPU_ALLOC
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#define GPU_BLOCK_SIZE ((VkDeviceSize) 64 << 20)
+#define GPU_MAX_BLOCKS 64
+
+// a range of a block, bind resources at memory + offset
+struct gpu_allocation
+{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint8_t * mapped;           // the range in the block's mapping, NULL
+                                // unless the memory is host visible
+    int block;                  // owning block, -1 when empty
+};
+
+struct gpu_range
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// one vkAllocateMemory, handed out in ranges from a free list sorted by
+// offset. optimal tiling images get blocks of their own so no buffer ever
+// shares a bufferImageGranularity page with one
+struct gpu_block
+{
+    VkDeviceMemory memory;      // VK_NULL_HANDLE for an unused slot
+    VkDeviceSize size;
+    uint32_t type;
+    int images;                 // holds optimal tiling images
+    int dedicated;              // a single allocation too big to share
+    uint8_t * mapped;           // whole block, mapped once if host visible
+    int live;                   // allocations in the block
+    VkDeviceSize used;          // bytes in them
+
+    struct gpu_range * free;
+    int free_count;
+    int free_capacity;
+};
+
+struct gpu_allocator_stats
+{
+    int blocks;                 // device allocations, dedicated included
+    int dedicated;
+    VkDeviceSize block_bytes;   // device memory allocated
+    VkDeviceSize used_bytes;    // of it handed out
+    VkDeviceSize free_bytes;    // of it free inside shared blocks
+    VkDeviceSize largest_free;  // biggest single free range
+    int allocations;            // live allocations
+    float fragmentation;        // 1 - largest_free / free_bytes, 0 when
+                                // all free space is one range
+};
+
+struct gpu_allocator
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    const VkAllocationCallbacks * host;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkDeviceSize block_size;
+    uint32_t max_device_allocations;    // maxMemoryAllocationCount
+
+    struct gpu_block blocks[GPU_MAX_BLOCKS];
+    int block_count;            // slots in use or once used
+};
+
+// set up an allocator carving block_size blocks (0 for GPU_BLOCK_SIZE).
+// host goes to every vkAllocateMemory and vkFreeMemory, and to the buffers
+// and other objects of the modules using the allocator. NULL is fine
+int gpu_allocator_create(struct gpu_allocator * a, VkPhysicalDevice physical_device,
+        VkDevice device, VkDeviceSize block_size, const VkAllocationCallbacks * host);
+
+// every allocation must have been freed, blocks are released regardless
+void gpu_allocator_destroy(struct gpu_allocator * a);
+
+// memory for requirements with all of flags. image is set for optimal
+// tiling images. returns 0 on failure
+int gpu_alloc(struct gpu_allocator * a, const VkMemoryRequirements * requirements,
+        VkMemoryPropertyFlags flags, int image, struct gpu_allocation * allocation);
+
+// return an allocation, which is left empty. empty ones are ignored
+void gpu_free(struct gpu_allocator * a, struct gpu_allocation * allocation);
+
+void gpu_allocator_stats(const struct gpu_allocator * a, struct gpu_allocator_stats * stats);
+
+// create_buffer out of the allocator, for buffers, and the image
+// equivalent. both return 0 on failure with nothing left behind
+int gpu_create_buffer(struct gpu_allocator * a, VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags flags, VkBuffer * buffer, struct gpu_allocation * allocation);
+void gpu_destroy_buffer(struct gpu_allocator * a, VkBuffer buffer,
+        struct gpu_allocation * allocation);
+int gpu_bind_image(struct gpu_allocator * a, VkImage image, VkMemoryPropertyFlags flags,
+        struct gpu_allocation * allocation);
+
+// strategies ------------------------------------------------------------------
+
+// one range bumped through and let go of as a whole, for resources that
+// live and die together or per frame data reset once its fence is done
+struct gpu_linear
+{
+    struct gpu_allocator * allocator;
+    struct gpu_allocation range;
+    VkDeviceSize top;           // bytes handed out of range
+};
+
+// size bytes of memory types in type_bits with flags
+int gpu_linear_create(struct gpu_linear * linear, struct gpu_allocator * a,
+        VkDeviceSize size, uint32_t type_bits, VkMemoryPropertyFlags flags);
+void gpu_linear_destroy(struct gpu_linear * linear);
+
+// the next aligned piece of the range, 0 when it does not fit
+int gpu_linear_alloc(struct gpu_linear * linear, const VkMemoryRequirements * requirements,
+        struct gpu_allocation * allocation);
+
+// everything handed out is free again
+void gpu_linear_reset(struct gpu_linear * linear);
+
+// count equal slots taken and returned one at a time in constant time, ie
+// one per frame in flight
+struct gpu_pool
+{
+    struct gpu_allocator * allocator;
+    struct gpu_allocation range;
+    VkDeviceSize slot;          // bytes per slot, a multiple of the alignment
+    int count;
+    int * free_slots;           // stack of free slot indices
+    int free_count;
+};
+
+// count slots of at least slot bytes at alignment (a power of two)
+int gpu_pool_create(struct gpu_pool * pool, struct gpu_allocator * a,
+        VkDeviceSize slot, VkDeviceSize alignment, int count,
+        uint32_t type_bits, VkMemoryPropertyFlags flags);
+void gpu_pool_destroy(struct gpu_pool * pool);
+
+// a free slot, requirements must fit the slot. 0 when none are left
+int gpu_pool_alloc(struct gpu_pool * pool, const VkMemoryRequirements * requirements,
+        struct gpu_allocation * allocation);
+void gpu_pool_free(struct gpu_pool * pool, struct gpu_allocation * allocation);
+
+
+#endif
@@ -0,0 +1,457 @@
+/*
+   gpu_flock.c
+   flock update as vulkan compute dispatches over storage buffers
+
+   a step is the cpu grid step split into passes: clear the cell counts,
+   count boids per cell with atomics, scan the counts into cell starts,
+   scatter the boids into cell order, then steer every boid against the 27
+   cells around it. all buffers stay on the device, the state buffers
+   double as instance vertex buffers so nothing comes back to the cpu
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_flock.h"
+#include "grid.h"
+#include "util.h"
+
+#define SHADER_DIR "shaders/"
+#define GROUP_SIZE 256
+
+// push constants, params in flock_common.glsl
+struct flock_push
+{
+    float bounds[4];            // xyz world size, w 1 / cell edge
+    int32_t dims[4];            // xyz cells per axis, w boid count
+    float limits[4];            // radius^2, separation radius^2, min, max speed
+    float weights[4];           // separation, alignment, cohesion, dt
+};
+
+static const char * shader_paths[GPU_FLOCK_PASSES] =
+{
+    SHADER_DIR "flock_count.spv",
+    SHADER_DIR "flock_scan.spv",
+    SHADER_DIR "flock_scatter.spv",
+    SHADER_DIR "flock_steer.spv"
+};
+
+#define BINDINGS 6
+
+// buffers ----------------------------------------------------------------------
+
+#define STORAGE_BUFFERS 6
+
+static int create_storage(struct gpu_flock * flock, VkDeviceSize size,
+        VkBufferUsageFlags usage, VkBuffer * buffer)
+{
+    VkBufferCreateInfo buffer_info = {0};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (vkCreateBuffer(flock->device, &buffer_info, flock->host, buffer) != VK_SUCCESS)
+    {
+        printf("Error: couldnt create %lu byte flock buffer\n", (unsigned long) size);
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+// host visible staging buffer for uploads and readbacks
+static int create_staging(struct gpu_flock * flock, VkDeviceSize size,
+        VkBuffer * buffer, struct gpu_allocation * memory)
+{
+    return gpu_create_buffer(flock->allocator, size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            buffer, memory);
+}
+
+// the buffers first, then one linear range sized for all of them
+static int create_buffers(struct gpu_flock * flock)
+{
+    VkDeviceSize state_size = sizeof(struct gpu_boid) * (VkDeviceSize) flock->count;
+    VkBufferUsageFlags state_usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    if (!create_storage(flock, state_size, state_usage, &flock->state[0]) ||
+        !create_storage(flock, state_size, state_usage, &flock->state[1]) ||
+        !create_storage(flock, state_size, 0, &flock->sorted) ||
+        !create_storage(flock, sizeof(uint32_t) * (VkDeviceSize) flock->cells,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT, &flock->cell_count) ||
+        !create_storage(flock, sizeof(uint32_t) * (VkDeviceSize) flock->cells, 0,
+                &flock->cell_start) ||
+        !create_storage(flock, 2 * sizeof(uint32_t) * (VkDeviceSize) flock->count, 0,
+                &flock->boid_cell))
+    {
+        return 0;
+    }
+
+    VkBuffer buffers[STORAGE_BUFFERS] =
+    {
+        flock->state[0], flock->state[1], flock->sorted,
+        flock->cell_count, flock->cell_start, flock->boid_cell
+    };
+    VkMemoryRequirements requirements[STORAGE_BUFFERS];
+    VkDeviceSize total = 0;
+    uint32_t type_bits = ~0u;
+    for (int b = 0; b < STORAGE_BUFFERS; b++)
+    {
+        vkGetBufferMemoryRequirements(flock->device, buffers[b], &requirements[b]);
+        total += requirements[b].size + requirements[b].alignment;
+        type_bits &= requirements[b].memoryTypeBits;
+    }
+
+    if (!gpu_linear_create(&flock->memory, flock->allocator, total, type_bits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+    {
+        return 0;
+    }
+
+    for (int b = 0; b < STORAGE_BUFFERS; b++)
+    {
+        struct gpu_allocation allocation;
+        if (!gpu_linear_alloc(&flock->memory, &requirements[b], &allocation) ||
+            vkBindBufferMemory(flock->device, buffers[b], allocation.memory,
+                allocation.offset) != VK_SUCCESS)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// pipelines and descriptors ----------------------------------------------------
+
+static int create_pipelines(struct gpu_flock * flock, VkPipelineCache pipeline_cache)
+{
+    VkDescriptorSetLayoutBinding bindings[BINDINGS];
+    for (int b = 0; b < BINDINGS; b++)
+    {
+        bindings[b] = (VkDescriptorSetLayoutBinding) {0};
+        bindings[b].binding = b;
+        bindings[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[b].descriptorCount = 1;
+        bindings[b].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {0};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = BINDINGS;
+    set_layout_info.pBindings = bindings;
+    if (vkCreateDescriptorSetLayout(flock->device, &set_layout_info, flock->host,
+                &flock->set_layout) != VK_SUCCESS) { return 0; }
+
+    VkPushConstantRange push_range = {0};
+    push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_range.size = sizeof(struct flock_push);
+
+    VkPipelineLayoutCreateInfo layout_info = {0};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &flock->set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(flock->device, &layout_info, flock->host,
+                &flock->layout) != VK_SUCCESS) { return 0; }
+
+    for (int p = 0; p < GPU_FLOCK_PASSES; p++)
+    {
+        VkShaderModule module = load_shader(flock->device, flock->host, shader_paths[p]);
+        if (module == VK_NULL_HANDLE) { return 0; }
+
+        VkComputePipelineCreateInfo pipeline_info = {0};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipeline_info.stage.module = module;
+        pipeline_info.stage.pName = "main";
+        pipeline_info.layout = flock->layout;
+
+        VkResult result = vkCreateComputePipelines(flock->device, pipeline_cache,
+                1, &pipeline_info, flock->host, &flock->pipelines[p]);
+        vkDestroyShaderModule(flock->device, module, flock->host);
+        if (result != VK_SUCCESS) { return 0; }
+    }
+
+    return 1;
+}
+
+static int create_descriptors(struct gpu_flock * flock)
+{
+    VkDescriptorPoolSize pool_size = {0};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_size.descriptorCount = 2 * BINDINGS;
+
+    VkDescriptorPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 2;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if (vkCreateDescriptorPool(flock->device, &pool_info, flock->host,
+                &flock->descriptor_pool) != VK_SUCCESS) { return 0; }
+
+    VkDescriptorSetLayout layouts[2] = { flock->set_layout, flock->set_layout };
+    VkDescriptorSetAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = flock->descriptor_pool;
+    alloc_info.descriptorSetCount = 2;
+    alloc_info.pSetLayouts = layouts;
+    if (vkAllocateDescriptorSets(flock->device, &alloc_info, flock->sets) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    // set i reads state i and writes the other, the rest is shared
+    for (int i = 0; i < 2; i++)
+    {
+        VkBuffer buffers[BINDINGS] =
+        {
+            flock->state[i], flock->state[!i], flock->sorted,
+            flock->cell_count, flock->cell_start, flock->boid_cell
+        };
+        VkDescriptorBufferInfo buffer_infos[BINDINGS];
+        VkWriteDescriptorSet writes[BINDINGS];
+
+        for (int b = 0; b < BINDINGS; b++)
+        {
+            buffer_infos[b] = (VkDescriptorBufferInfo) { buffers[b], 0, VK_WHOLE_SIZE };
+            writes[b] = (VkWriteDescriptorSet) {0};
+            writes[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[b].dstSet = flock->sets[i];
+            writes[b].dstBinding = b;
+            writes[b].descriptorCount = 1;
+            writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[b].pBufferInfo = &buffer_infos[b];
+        }
+        vkUpdateDescriptorSets(flock->device, BINDINGS, writes, 0, NULL);
+    }
+
+    return 1;
+}
+
+// upload the current cpu state into state[0]
+static int upload(struct gpu_flock * flock, VkCommandPool command_pool,
+        VkQueue queue, const struct boid_state * s)
+{
+    VkDeviceSize size = sizeof(struct gpu_boid) * (VkDeviceSize) flock->count;
+    VkBuffer staging;
+    struct gpu_allocation staging_memory;
+    if (!create_staging(flock, size, &staging, &staging_memory)) { return 0; }
+
+    struct gpu_boid * boids = (struct gpu_boid *) staging_memory.mapped;
+    for (int i = 0; i < flock->count; i++)
+    {
+        boids[i] = (struct gpu_boid)
+        {
+            { s->px[i], s->py[i], s->pz[i], 1.0f },
+            { s->vx[i], s->vy[i], s->vz[i], 0.0f }
+        };
+    }
+
+    VkCommandBuffer command_buffer = begin_one_shot(flock->device, command_pool);
+    if (command_buffer == VK_NULL_HANDLE)
+    {
+        gpu_destroy_buffer(flock->allocator, staging, &staging_memory);
+        return 0;
+    }
+    VkBufferCopy region = { 0, 0, size };
+    vkCmdCopyBuffer(command_buffer, staging, flock->state[0], 1, &region);
+    VkResult result = end_one_shot(flock->device, command_pool, queue, command_buffer);
+
+    gpu_destroy_buffer(flock->allocator, staging, &staging_memory);
+    return result == VK_SUCCESS;
+}
+
+// public api -------------------------------------------------------------------
+
+int gpu_flock_create(struct gpu_flock * flock, struct gpu_allocator * allocator,
+        VkDevice device, VkCommandPool command_pool, VkQueue queue,
+        VkPipelineCache pipeline_cache, const struct boids * initial, const struct boid_params * params)
+{
+    memset(flock, 0, sizeof(struct gpu_flock));
+    flock->allocator = allocator;
+    flock->device = device;
+    flock->host = allocator->host;
+    flock->count = initial->count;
+    flock->cells = grid_layout(initial->count, params->neighbour_radius,
+            params->bounds, &flock->cell, flock->dims);
+
+    if (flock->count < 1 ||
+        !create_buffers(flock) ||
+        !create_pipelines(flock, pipeline_cache) ||
+        !create_descriptors(flock) ||
+        !upload(flock, command_pool, queue, boids_current(initial)))
+    {
+        printf("Error: couldnt set up the gpu flock\n");
+        gpu_flock_destroy(flock);
+        return 0;
+    }
+
+    return 1;
+}
+
+void gpu_flock_destroy(struct gpu_flock * flock)
+{
+    if (flock->device == VK_NULL_HANDLE) { return; }
+
+    for (int p = 0; p < GPU_FLOCK_PASSES; p++)
+    {
+        if (flock->pipelines[p] != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(flock->device, flock->pipelines[p], flock->host);
+        }
+    }
+    if (flock->descriptor_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(flock->device, flock->descriptor_pool, flock->host);
+    }
+    if (flock->layout != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineLayout(flock->device, flock->layout, flock->host);
+    }
+    if (flock->set_layout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(flock->device, flock->set_layout, flock->host);
+    }
+
+    VkBuffer buffers[STORAGE_BUFFERS] =
+    {
+        flock->state[0], flock->state[1], flock->sorted,
+        flock->cell_count, flock->cell_start, flock->boid_cell
+    };
+    for (int b = 0; b < STORAGE_BUFFERS; b++)
+    {
+        if (buffers[b] != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(flock->device, buffers[b], flock->host);
+        }
+    }
+    gpu_linear_destroy(&flock->memory);
+
+    memset(flock, 0, sizeof(struct gpu_flock));
+}
+
+// make compute writes visible to the next compute pass
+static void compute_barrier(VkCommandBuffer command_buffer)
+{
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void gpu_flock_record(struct gpu_flock * flock, VkCommandBuffer command_buffer,
+        const struct boid_params * params, float dt)
+{
+    struct flock_push push =
+    {
+        { params->bounds[0], params->bounds[1], params->bounds[2], 1.0f / flock->cell },
+        { flock->dims[0], flock->dims[1], flock->dims[2], flock->count },
+        { params->neighbour_radius * params->neighbour_radius,
+          params->separation_radius * params->separation_radius,
+          params->min_speed, params->max_speed },
+        { params->separation_weight, params->alignment_weight,
+          params->cohesion_weight, dt }
+    };
+    uint32_t groups = (flock->count + GROUP_SIZE - 1) / GROUP_SIZE;
+
+    // with frames in flight an earlier frame's draw may still be reading
+    // the state this step overwrites, and its steer pass the cell counts.
+    // the earlier step's writes to both must also land before the fill and
+    // this step's passes write them again
+    VkMemoryBarrier in_barrier = {0};
+    in_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    in_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    in_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT |
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &in_barrier, 0, NULL, 0, NULL);
+
+    // zero the cell counts, then hand them to the count pass
+    vkCmdFillBuffer(command_buffer, flock->cell_count, 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier clear_barrier = {0};
+    clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 1, &clear_barrier, 0, NULL, 0, NULL);
+
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+            flock->layout, 0, 1, &flock->sets[flock->current], 0, NULL);
+    vkCmdPushConstants(command_buffer, flock->layout, VK_SHADER_STAGE_COMPUTE_BIT,
+            0, sizeof(push), &push);
+
+    const uint32_t dispatches[GPU_FLOCK_PASSES] = { groups, 1, groups, groups };
+    for (int p = 0; p < GPU_FLOCK_PASSES; p++)
+    {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, flock->pipelines[p]);
+        vkCmdDispatch(command_buffer, dispatches[p], 1, 1);
+        if (p + 1 < GPU_FLOCK_PASSES) { compute_barrier(command_buffer); }
+    }
+
+    // the new state is read by the next step, the vertex stage and readbacks
+    VkMemoryBarrier out_barrier = {0};
+    out_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    out_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    out_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT |
+        VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT |
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0, 1, &out_barrier, 0, NULL, 0, NULL);
+
+    flock->current = !flock->current;
+}
+
+VkBuffer gpu_flock_state(const struct gpu_flock * flock)
+{
+    return flock->state[flock->current];
+}
+
+int gpu_flock_read(struct gpu_flock * flock, VkCommandPool command_pool,
+        VkQueue queue, struct boid_state * out)
+{
+    VkDeviceSize size = sizeof(struct gpu_boid) * (VkDeviceSize) flock->count;
+    VkBuffer staging;
+    struct gpu_allocation staging_memory;
+    if (!create_staging(flock, size, &staging, &staging_memory)) { return 0; }
+
+    VkCommandBuffer command_buffer = begin_one_shot(flock->device, command_pool);
+    if (command_buffer == VK_NULL_HANDLE)
+    {
+        gpu_destroy_buffer(flock->allocator, staging, &staging_memory);
+        return 0;
+    }
+    VkBufferCopy region = { 0, 0, size };
+    vkCmdCopyBuffer(command_buffer, flock->state[flock->current], staging, 1, &region);
+    VkResult result = end_one_shot(flock->device, command_pool, queue, command_buffer);
+
+    if (result == VK_SUCCESS)
+    {
+        const struct gpu_boid * boids = (const struct gpu_boid *) staging_memory.mapped;
+        for (int i = 0; i < flock->count; i++)
+        {
+            out->px[i] = boids[i].position[0];
+            out->py[i] = boids[i].position[1];
+            out->pz[i] = boids[i].position[2];
+            out->vx[i] = boids[i].velocity[0];
+            out->vy[i] = boids[i].velocity[1];
+            out->vz[i] = boids[i].velocity[2];
+        }
+    }
+
+    gpu_destroy_buffer(flock->allocator, staging, &staging_memory);
+    return result == VK_SUCCESS;
+}
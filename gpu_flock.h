@@ -0,0 +1,80 @@
+/*
+   gpu_flock.h
+   flock update as vulkan compute dispatches over storage buffers
+*/
+
+#ifndef GPU_FLOCK
+#define GPU_FLOCK
+
+#include <vulkan.h>
+
+#include "boids.h"
+#include "gpu_alloc.h"
+
+// compute passes of one step, in dispatch order
+enum gpu_flock_pass
+{
+    GPU_FLOCK_COUNT = 0,        // cell of every boid and its slot in the cell
+    GPU_FLOCK_SCAN,             // cell counts to cell starts
+    GPU_FLOCK_SCATTER,          // boids into cell order
+    GPU_FLOCK_STEER,            // the three rules and integration
+    GPU_FLOCK_PASSES
+};
+
+// per boid layout of the state buffers, std430 struct Boid in the shaders
+struct gpu_boid
+{
+    float position[4];          // xyz, w = 1
+    float velocity[4];          // xyz, w = 0
+};
+
+struct gpu_flock
+{
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // the allocator's, for every object
+
+    int count;
+    int cells;
+    float cell;
+    int dims[3];
+
+    // double buffered state, also usable as per instance vertex input so
+    // the vertex stage reads the simulation output where it lies
+    VkBuffer state[2];
+    int current;                // index of the latest state
+
+    VkBuffer sorted, cell_count, cell_start, boid_cell;
+    struct gpu_linear memory;   // all six buffers, they live and die together
+
+    VkDescriptorSetLayout set_layout;
+    VkPipelineLayout layout;
+    VkPipeline pipelines[GPU_FLOCK_PASSES];
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet sets[2];    // sets[i] reads state[i] and writes the other
+};
+
+// build the buffers and pipelines for the boids in initial and upload their
+// current state. pipelines come from pipeline_cache when it is not
+// VK_NULL_HANDLE. returns 0 on failure, after cleaning up
+int gpu_flock_create(struct gpu_flock * flock, struct gpu_allocator * allocator,
+        VkDevice device, VkCommandPool command_pool, VkQueue queue,
+        VkPipelineCache pipeline_cache, const struct boids * initial, const struct boid_params * params);
+
+void gpu_flock_destroy(struct gpu_flock * flock);
+
+// record one step of dt seconds into command_buffer and flip the state.
+// ends with the new state visible to compute, vertex input and transfers
+void gpu_flock_record(struct gpu_flock * flock, VkCommandBuffer command_buffer,
+        const struct boid_params * params, float dt);
+
+// buffer holding the latest state, for binding as instance vertex input
+VkBuffer gpu_flock_state(const struct gpu_flock * flock);
+
+// copy the latest state back into out (count boids, structure of arrays).
+// only meant for comparing with the cpu simulation, it stalls the queue
+int gpu_flock_read(struct gpu_flock * flock, VkCommandPool command_pool,
+        VkQueue queue, struct boid_state * out);
+
+
+#endif
@@ -0,0 +1,131 @@
+/*
+   gpu_timer.c
+   per frame gpu stage times from timestamp queries
+
+   gpu ticks have no relation to the cpu clock, so a frame's stages are
+   placed in the trace relative to its first timestamp, starting when the
+   cpu began recording it. durations are exact, positions only show order
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gpu_timer.h"
+
+#define QUERIES (2 * GPU_TIMER_STAGES)
+
+static uint32_t query(int slot, enum profile_stage stage, int end)
+{
+    return (uint32_t) (slot * QUERIES + 2 * (stage - PROFILE_FIRST_GPU_STAGE) + end);
+}
+
+int gpu_timer_create(struct gpu_timer * t, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, uint32_t valid_bits, int frames)
+{
+    memset(t, 0, sizeof(struct gpu_timer));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if (valid_bits == 0 || properties.limits.timestampPeriod <= 0.0f ||
+        frames < 1 || frames > FRAMES_MAX)
+    {
+        printf("gpu timer: no timestamps on this queue, gpu stages not timed\n");
+        return 0;
+    }
+
+    VkQueryPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    pool_info.queryCount = QUERIES * frames;
+    if (vkCreateQueryPool(device, &pool_info, host, &t->pool) != VK_SUCCESS)
+    {
+        printf("Error: couldnt create timestamp query pool\n");
+        t->pool = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    t->device = device;
+    t->host = host;
+    t->frames = frames;
+    t->ns_per_tick = properties.limits.timestampPeriod;
+    t->mask = valid_bits >= 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << valid_bits) - 1);
+    return 1;
+}
+
+void gpu_timer_destroy(struct gpu_timer * t)
+{
+    if (t->pool != VK_NULL_HANDLE) { vkDestroyQueryPool(t->device, t->pool, t->host); }
+    memset(t, 0, sizeof(struct gpu_timer));
+}
+
+// the slot's fence has been waited, so everything it wrote is available
+static void collect(struct gpu_timer * t, int slot)
+{
+    // stages not timed in the frame stay unavailable, VK_NOT_READY then
+    // just means their results were not written
+    uint64_t ticks[QUERIES];
+    VkResult result = vkGetQueryPoolResults(t->device, t->pool,
+            query(slot, PROFILE_FIRST_GPU_STAGE, 0), QUERIES, sizeof(ticks), ticks,
+            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS && result != VK_NOT_READY) { return; }
+
+    uint64_t first = UINT64_MAX;
+    for (int s = 0; s < GPU_TIMER_STAGES; s++)
+    {
+        if ((t->written[slot] & (1u << s)) && (ticks[2 * s] & t->mask) < first)
+        {
+            first = ticks[2 * s] & t->mask;
+        }
+    }
+
+    for (int s = 0; s < GPU_TIMER_STAGES; s++)
+    {
+        if (!(t->written[slot] & (1u << s))) { continue; }
+        uint64_t begin = ticks[2 * s] & t->mask;
+        uint64_t end = ticks[2 * s + 1] & t->mask;
+        if (end < begin) { continue; }
+
+        uint64_t start_ns = t->recorded_ns[slot] + (uint64_t) ((begin - first) * t->ns_per_tick);
+        profile_record_gpu(PROFILE_FIRST_GPU_STAGE + s, start_ns,
+                start_ns + (uint64_t) ((end - begin) * t->ns_per_tick), t->frame[slot]);
+    }
+}
+
+void gpu_timer_begin_frame(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, uint32_t frame)
+{
+    if (t->pool == VK_NULL_HANDLE) { return; }
+
+    if (t->written[slot] != 0) { collect(t, slot); }
+    vkCmdResetQueryPool(command_buffer, t->pool, query(slot, PROFILE_FIRST_GPU_STAGE, 0), QUERIES);
+    t->written[slot] = 0;
+    t->frame[slot] = frame;
+    t->recorded_ns[slot] = profile_now();
+}
+
+void gpu_timer_flush(struct gpu_timer * t)
+{
+    for (int slot = 0; t->pool != VK_NULL_HANDLE && slot < t->frames; slot++)
+    {
+        if (t->written[slot] != 0) { collect(t, slot); }
+        t->written[slot] = 0;
+    }
+}
+
+void gpu_timer_begin(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, enum profile_stage stage)
+{
+    if (t->pool == VK_NULL_HANDLE) { return; }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, t->pool,
+            query(slot, stage, 0));
+}
+
+// bottom of pipe, so the stamp lands once all the stage's work is done
+void gpu_timer_end(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, enum profile_stage stage)
+{
+    if (t->pool == VK_NULL_HANDLE) { return; }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, t->pool,
+            query(slot, stage, 1));
+    t->written[slot] |= 1u << (stage - PROFILE_FIRST_GPU_STAGE);
+}
@@ -0,0 +1,56 @@
+/*
+   gpu_timer.h
+   per frame gpu stage times from timestamp queries
+*/
+
+#ifndef GPU_TIMER
+#define GPU_TIMER
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#include "frames.h"
+#include "profile.h"
+
+#define GPU_TIMER_STAGES (PROFILE_STAGES - PROFILE_FIRST_GPU_STAGE)
+
+// a begin and end timestamp per gpu stage per frame slot. a slot's results
+// are read when the slot comes round again, after its fence, so reading
+// never waits on the gpu
+struct gpu_timer
+{
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // NULL is fine
+    VkQueryPool pool;
+    int frames;
+    double ns_per_tick;         // timestampPeriod
+    uint64_t mask;              // timestampValidBits of the queue
+
+    uint32_t written[FRAMES_MAX];       // stages timed in the slot's last use
+    uint32_t frame[FRAMES_MAX];         // and the frame number it was
+    uint64_t recorded_ns[FRAMES_MAX];   // cpu time its recording began
+};
+
+// timer for frames slots on a queue with valid_bits of timestamp.
+// returns 0 when the queue or device cannot time, the timer then does nothing
+int gpu_timer_create(struct gpu_timer * t, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, uint32_t valid_bits, int frames);
+
+void gpu_timer_destroy(struct gpu_timer * t);
+
+// at the start of slot's command buffer, once its fence is done: hand the
+// slot's last results to profile and reset its queries
+void gpu_timer_begin_frame(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, uint32_t frame);
+
+// hand every slot's results to profile, once the device is idle
+void gpu_timer_flush(struct gpu_timer * t);
+
+// bracket a gpu stage (PROFILE_GPU_*) recorded into command_buffer
+void gpu_timer_begin(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, enum profile_stage stage);
+void gpu_timer_end(struct gpu_timer * t, VkCommandBuffer command_buffer,
+        int slot, enum profile_stage stage);
+
+
+#endif
@@ -0,0 +1,195 @@
+/*
+   grid.c
+   uniform spatial hash grid for boid neighbour queries
+
+   with cells no smaller than the neighbour radius everything a boid can see
+   lies in the 27 cells around it. cells are numbered x fastest, so each
+   row of 3 cells is one contiguous range of the sorted arrays and a query
+   is at most 9 ranges the steering kernels can sweep with vector loads
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grid.h"
+
+// cap on cells per boid, a tiny radius in a huge world would otherwise
+// spend more time clearing empty cells than sorting boids
+#define CELLS_PER_BOID 4
+#define MIN_CELLS 4096
+
+void grid_init(struct grid * grid)
+{
+    memset(grid, 0, sizeof(struct grid));
+}
+
+void grid_free(struct grid * grid)
+{
+    free(grid->start);
+    free(grid->cell_of);
+    free(grid->order);
+    free(grid->sorted.px); free(grid->sorted.py); free(grid->sorted.pz);
+    free(grid->sorted.vx); free(grid->sorted.vy); free(grid->sorted.vz);
+    grid_init(grid);
+}
+
+// aligned replacement for an array that needs to grow, contents are lost
+static int grow(float ** array, int capacity)
+{
+    free(*array);
+    size_t bytes = sizeof(float) * (size_t) capacity;
+    bytes = (bytes + BOIDS_ALIGN - 1) / BOIDS_ALIGN * BOIDS_ALIGN;
+    *array = aligned_alloc(BOIDS_ALIGN, bytes);
+    return *array != NULL;
+}
+
+static int reserve(struct grid * grid, int cells, int count)
+{
+    if (cells + 1 > grid->cell_capacity)
+    {
+        // a failure leaves nothing usable, so the next call starts over
+        grid->cell_capacity = 0;
+        free(grid->start);
+        grid->start = malloc(sizeof(int) * (cells + 1));
+        if (grid->start == NULL) { return 0; }
+        grid->cell_capacity = cells + 1;
+    }
+
+    if (count > grid->boid_capacity)
+    {
+        grid->boid_capacity = 0;
+        free(grid->cell_of);
+        free(grid->order);
+        grid->cell_of = malloc(sizeof(int) * count);
+        grid->order = malloc(sizeof(int) * count);
+
+        struct boid_state * s = &grid->sorted;
+        if (grid->cell_of == NULL || grid->order == NULL ||
+            !grow(&s->px, count) || !grow(&s->py, count) || !grow(&s->pz, count) ||
+            !grow(&s->vx, count) || !grow(&s->vy, count) || !grow(&s->vz, count))
+        {
+            return 0;
+        }
+        grid->boid_capacity = count;
+    }
+
+    return 1;
+}
+
+static inline int clamp_cell(int c, int dim)
+{
+    return c < 0 ? 0 : c >= dim ? dim - 1 : c;
+}
+
+int grid_layout(int count, float radius, const float bounds[3], float * cell, int dims[3])
+{
+    // grow the cell size while there would be too many cells
+    long limit = (long) count * CELLS_PER_BOID;
+    if (limit < MIN_CELLS) { limit = MIN_CELLS; }
+
+    float size = radius > 0.0f ? radius : 1.0f;
+    for (;;)
+    {
+        long cells = 1;
+        for (int a = 0; a < 3; a++)
+        {
+            dims[a] = (int) (bounds[a] / size) + 1;
+            cells *= dims[a];
+        }
+        if (cells <= limit)
+        {
+            *cell = size;
+            return (int) cells;
+        }
+        size *= 1.25f;
+    }
+}
+
+int grid_build(struct grid * grid, const struct boid_state * s, int count,
+        float radius, const float bounds[3])
+{
+    grid->cells = grid_layout(count, radius, bounds, &grid->cell, grid->dims);
+    grid->inv_cell = 1.0f / grid->cell;
+
+    if (!reserve(grid, grid->cells, count))
+    {
+        printf("Error: couldnt allocate grid for %d boids\n", count);
+        return 0;
+    }
+
+    // count boids per cell
+    int * start = grid->start;
+    memset(start, 0, sizeof(int) * (grid->cells + 1));
+
+    for (int i = 0; i < count; i++)
+    {
+        int cx = clamp_cell((int) (s->px[i] * grid->inv_cell), grid->dims[0]);
+        int cy = clamp_cell((int) (s->py[i] * grid->inv_cell), grid->dims[1]);
+        int cz = clamp_cell((int) (s->pz[i] * grid->inv_cell), grid->dims[2]);
+        int c = (cz * grid->dims[1] + cy) * grid->dims[0] + cx;
+        grid->cell_of[i] = c;
+        start[c + 1]++;
+    }
+
+    // prefix sum into start offsets
+    for (int c = 0; c < grid->cells; c++)
+    {
+        start[c + 1] += start[c];
+    }
+
+    // scatter, using the counts of the next cell as a moving cursor
+    for (int i = 0; i < count; i++)
+    {
+        int k = start[grid->cell_of[i]]++;
+        grid->order[k] = i;
+    }
+
+    // the scatter advanced every start to the next cell's, shift them back
+    memmove(start + 1, start, sizeof(int) * grid->cells);
+    start[0] = 0;
+
+    // gather the state into cell order
+    struct boid_state * d = &grid->sorted;
+    for (int k = 0; k < count; k++)
+    {
+        int i = grid->order[k];
+        d->px[k] = s->px[i]; d->py[k] = s->py[i]; d->pz[k] = s->pz[i];
+        d->vx[k] = s->vx[i]; d->vy[k] = s->vy[i]; d->vz[k] = s->vz[i];
+    }
+
+    return 1;
+}
+
+int grid_query(const struct grid * grid, float x, float y, float z,
+        int ranges[GRID_MAX_RANGES][2])
+{
+    int cx = clamp_cell((int) (x * grid->inv_cell), grid->dims[0]);
+    int cy = clamp_cell((int) (y * grid->inv_cell), grid->dims[1]);
+    int cz = clamp_cell((int) (z * grid->inv_cell), grid->dims[2]);
+
+    int x0 = cx > 0 ? cx - 1 : 0;
+    int x1 = cx < grid->dims[0] - 1 ? cx + 1 : cx;
+    int n = 0;
+
+    for (int gz = cz - 1; gz <= cz + 1; gz++)
+    {
+        if (gz < 0 || gz >= grid->dims[2]) { continue; }
+        for (int gy = cy - 1; gy <= cy + 1; gy++)
+        {
+            if (gy < 0 || gy >= grid->dims[1]) { continue; }
+
+            int row = (gz * grid->dims[1] + gy) * grid->dims[0];
+            int begin = grid->start[row + x0];
+            int end = grid->start[row + x1 + 1];
+            if (begin < end)
+            {
+                ranges[n][0] = begin;
+                ranges[n][1] = end;
+                n++;
+            }
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,53 @@
+/*
+   grid.h
+   uniform spatial hash grid for boid neighbour queries
+*/
+
+#ifndef GRID
+#define GRID
+
+#include "boids.h"
+
+// most contiguous ranges a neighbour query returns: the 3x3 rows of cells
+// around a point, each row being 3 adjacent cells stored back to back
+#define GRID_MAX_RANGES 9
+
+// boids sorted by cell. rebuilt every step with a counting sort into flat
+// arrays that only grow, so steady state steps allocate nothing
+struct grid
+{
+    float cell;                 // cell edge, at least the neighbour radius
+    float inv_cell;
+    int dims[3];                // cells per axis
+    int cells;
+
+    int * start;                // cells + 1 offsets into the sorted arrays
+    int * cell_of;              // cell of each boid, by original index
+    int * order;                // original index of each sorted boid
+    struct boid_state sorted;   // positions and velocities in cell order
+
+    int cell_capacity;
+    int boid_capacity;
+};
+
+// empty grid, storage is allocated by the first build
+void grid_init(struct grid * grid);
+
+void grid_free(struct grid * grid);
+
+// cell edge and cells per axis a grid uses for count boids, returns the
+// number of cells. shared with the gpu flock so both grids agree
+int grid_layout(int count, float radius, const float bounds[3], float * cell, int dims[3]);
+
+// sort count boids of s into cells of at least radius over a world of
+// bounds. returns 0 if memory ran out
+int grid_build(struct grid * grid, const struct boid_state * s, int count,
+        float radius, const float bounds[3]);
+
+// ranges [ranges[i][0], ranges[i][1]) of grid->sorted holding every boid in
+// the cells around x, y, z, returns how many ranges were written
+int grid_query(const struct grid * grid, float x, float y, float z,
+        int ranges[GRID_MAX_RANGES][2]);
+
+
+#endif
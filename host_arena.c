@@ -0,0 +1,225 @@
+/*
+   host_arena.c
+   VkAllocationCallbacks backed by an arena of size classes
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host_arena.h"
+
+#define SMALLEST 32             // class 0 block, header included
+#define ALIGNMENT 16            // of every class payload
+#define LARGE 0xffffffffu       // class of a block from malloc
+
+// sits right before every payload, keeping it 16 byte aligned
+struct header
+{
+    uint32_t class;             // size class or LARGE
+    uint32_t size;              // bytes asked for
+    void * base;                // LARGE: what malloc returned
+};
+
+_Static_assert(sizeof(struct header) <= ALIGNMENT, "header must fit the alignment");
+
+static struct header * header_of(void * memory)
+{
+    return (struct header *) ((uint8_t *) memory - ALIGNMENT);
+}
+
+static size_t class_bytes(int class)
+{
+    return (size_t) SMALLEST << class;
+}
+
+// smallest class holding size bytes after the header, or -1
+static int class_of(size_t size)
+{
+    for (int c = 0; c < HOST_ARENA_CLASSES; c++)
+    {
+        if (size + ALIGNMENT <= class_bytes(c)) { return c; }
+    }
+    return -1;
+}
+
+// callers hold the lock -------------------------------------------------------
+
+static void * carve(struct host_arena * arena, int class)
+{
+    size_t bytes = class_bytes(class);
+    if (arena->chunk == NULL || arena->chunk_used + bytes > HOST_ARENA_CHUNK)
+    {
+        // the tail of the old chunk is lost, at most one block of each size
+        uint8_t * chunk = malloc(HOST_ARENA_CHUNK);
+        if (chunk == NULL) { return NULL; }
+        *(uint8_t **) chunk = arena->chunk;
+        arena->chunk = chunk;
+        arena->chunk_used = ALIGNMENT;
+        arena->stats.chunks++;
+        arena->stats.chunk_bytes += HOST_ARENA_CHUNK;
+    }
+
+    void * block = arena->chunk + arena->chunk_used;
+    arena->chunk_used += bytes;
+    return block;
+}
+
+static void * allocate(struct host_arena * arena, size_t size, size_t alignment)
+{
+    struct header * header;
+    int class = class_of(size);
+    if (class >= 0 && alignment <= ALIGNMENT)
+    {
+        header = arena->free_lists[class];
+        if (header != NULL)
+        {
+            arena->free_lists[class] = header->base;
+        }
+        else if ((header = carve(arena, class)) == NULL)
+        {
+            return NULL;
+        }
+        header->class = class;
+    }
+    else
+    {
+        // room to align the payload with the header still in front of it
+        size_t align = alignment > ALIGNMENT ? alignment : ALIGNMENT;
+        uint8_t * base = malloc(size + align + ALIGNMENT);
+        if (base == NULL) { return NULL; }
+        uintptr_t payload = ((uintptr_t) base + ALIGNMENT + align - 1) & ~(uintptr_t) (align - 1);
+        header = header_of((void *) payload);
+        header->class = LARGE;
+        header->base = base;
+        arena->stats.large++;
+    }
+
+    header->size = (uint32_t) size;
+    arena->stats.allocations++;
+    arena->stats.bytes_in_use += size;
+    if (arena->stats.bytes_in_use > arena->stats.peak_bytes)
+    {
+        arena->stats.peak_bytes = arena->stats.bytes_in_use;
+    }
+    return (uint8_t *) header + ALIGNMENT;
+}
+
+static void release(struct host_arena * arena, void * memory)
+{
+    struct header * header = header_of(memory);
+    arena->stats.frees++;
+    arena->stats.bytes_in_use -= header->size;
+
+    if (header->class == LARGE)
+    {
+        free(header->base);
+        return;
+    }
+
+    // the free list threads through the headers
+    header->base = arena->free_lists[header->class];
+    arena->free_lists[header->class] = header;
+}
+
+// callbacks -------------------------------------------------------------------
+
+static void * VKAPI_CALL arena_allocation(void * user, size_t size, size_t alignment,
+        VkSystemAllocationScope scope)
+{
+    (void) scope;
+    struct host_arena * arena = user;
+    if (size == 0 || size > UINT32_MAX) { return NULL; }
+
+    pthread_mutex_lock(&arena->lock);
+    void * memory = allocate(arena, size, alignment);
+    pthread_mutex_unlock(&arena->lock);
+    return memory;
+}
+
+static void * VKAPI_CALL arena_reallocation(void * user, void * original, size_t size,
+        size_t alignment, VkSystemAllocationScope scope)
+{
+    struct host_arena * arena = user;
+    if (original == NULL) { return arena_allocation(user, size, alignment, scope); }
+
+    pthread_mutex_lock(&arena->lock);
+    void * memory = NULL;
+    struct header * header = header_of(original);
+    if (size == 0)
+    {
+        release(arena, original);
+    }
+    else if (header->class != LARGE && alignment <= ALIGNMENT &&
+        size + ALIGNMENT <= class_bytes(header->class))
+    {
+        // still fits its block
+        arena->stats.bytes_in_use += size;
+        arena->stats.bytes_in_use -= header->size;
+        header->size = (uint32_t) size;
+        memory = original;
+    }
+    else if (size <= UINT32_MAX && (memory = allocate(arena, size, alignment)) != NULL)
+    {
+        memcpy(memory, original, header->size < size ? header->size : size);
+        release(arena, original);
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return memory;
+}
+
+static void VKAPI_CALL arena_free(void * user, void * memory)
+{
+    struct host_arena * arena = user;
+    if (memory == NULL) { return; }
+
+    pthread_mutex_lock(&arena->lock);
+    release(arena, memory);
+    pthread_mutex_unlock(&arena->lock);
+}
+
+// public api ------------------------------------------------------------------
+
+int host_arena_create(struct host_arena * arena)
+{
+    memset(arena, 0, sizeof(struct host_arena));
+    if (pthread_mutex_init(&arena->lock, NULL) != 0)
+    {
+        printf("Error: couldnt create host arena lock\n");
+        return 0;
+    }
+
+    arena->callbacks.pUserData = arena;
+    arena->callbacks.pfnAllocation = arena_allocation;
+    arena->callbacks.pfnReallocation = arena_reallocation;
+    arena->callbacks.pfnFree = arena_free;
+    return 1;
+}
+
+void host_arena_destroy(struct host_arena * arena)
+{
+    if (arena->callbacks.pUserData == NULL) { return; }
+
+    if (arena->stats.bytes_in_use > 0)
+    {
+        printf("Error: host arena freed with %lu bytes in use\n",
+                (unsigned long) arena->stats.bytes_in_use);
+    }
+
+    // large blocks still out are lost with their owner, chunks all go
+    while (arena->chunk != NULL)
+    {
+        uint8_t * previous = *(uint8_t **) arena->chunk;
+        free(arena->chunk);
+        arena->chunk = previous;
+    }
+    pthread_mutex_destroy(&arena->lock);
+    memset(arena, 0, sizeof(struct host_arena));
+}
+
+void host_arena_stats(struct host_arena * arena, struct host_arena_stats * stats)
+{
+    pthread_mutex_lock(&arena->lock);
+    *stats = arena->stats;
+    pthread_mutex_unlock(&arena->lock);
+}
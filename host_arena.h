@@ -0,0 +1,57 @@
+/*
+   host_arena.h
+   VkAllocationCallbacks backed by an arena of size classes
+*/
+
+#ifndef HOST_ARENA
+#define HOST_ARENA
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan.h>
+
+#define HOST_ARENA_CHUNK (64 << 10)
+#define HOST_ARENA_CLASSES 8        // 32 to 4096 byte blocks, header included
+
+struct host_arena_stats
+{
+    uint64_t allocations;       // pfnAllocation calls and growing reallocs
+    uint64_t frees;
+    uint64_t large;             // allocations too big or too aligned for a class
+    size_t bytes_in_use;        // bytes asked for and not yet freed
+    size_t peak_bytes;
+    size_t chunk_bytes;         // memory taken from malloc for classes
+    int chunks;
+};
+
+// vulkan's host side objects are small and many: a driver allocates a few
+// hundred bytes per pipeline, descriptor pool or fence. they come out of
+// big chunks in power of two classes, freed blocks go back on their class
+// list and chunks are only returned when the arena goes. bigger or over
+// aligned requests go straight to malloc. callbacks can be called from any
+// thread, so the arena takes a lock
+struct host_arena
+{
+    VkAllocationCallbacks callbacks;    // pass &arena.callbacks to vulkan
+
+    pthread_mutex_t lock;
+    uint8_t * chunk;            // newest chunk, each starts with a pointer
+                                // to the one before
+    size_t chunk_used;
+    void * free_lists[HOST_ARENA_CLASSES];
+
+    struct host_arena_stats stats;
+};
+
+// set up the arena and its callbacks. returns 0 on failure
+int host_arena_create(struct host_arena * arena);
+
+// only once vulkan is done with every object allocated through it
+void host_arena_destroy(struct host_arena * arena);
+
+// a consistent copy of the stats
+void host_arena_stats(struct host_arena * arena, struct host_arena_stats * stats);
+
+
+#endif
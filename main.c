@@ -45,9 +45,29 @@
 #include <vulkan.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "perlin.h"
+#include "pool.h"
+#include "boids.h"
+#include "gpu_flock.h"
+#include "upload_ring.h"
+#include "render.h"
+#include "cull.h"
+#include "swapchain.h"
+#include "frames.h"
+#include "offscreen.h"
+#include "pipeline_cache.h"
+#include "gpu_alloc.h"
+#include "host_arena.h"
+#include "profile.h"
+#include "gpu_timer.h"
+#include "noise_texture.h"
+#include "snapshot.h"
+#include "sim_thread.h"
 
 // globals and macros --------------------------------------------------------
 
@@ -64,9 +84,751 @@ const int SCREEN_HEIGHT = 480;
 		exit(1);															\
 	}
 
-// min and max from freebsd
-#define MIN(a,b) (((a)<(b))?(a):(b))
-#define MAX(a,b) (((a)>(b))?(a):(b))
+#define DEFAULT_BOIDS 4096
+#define SIM_DT (1.0f / 60.0f)
+#define COMPARE_STEPS 100
+#define COMPARE_EPSILON 1e-3f   // world units apart after one step, at most
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define DEFAULT_STEPS 600
+#define PROFILE_SUMMARY_MS 5000.0
+#define WIND_SCROLL 12.0f   // wind field texels per simulated second
+#define SHADER_DIR "shaders/"
+
+// milliseconds since some fixed point
+static double now_ms(void)
+{
+    return 1000.0 * SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
+}
+
+// when main started, startup is measured from here
+static double launch_ms;
+static uint64_t launch_ns;  // the same in profile_now's clock
+
+// host side allocations of the instance and device, see host_arena.h. it
+// must outlive every vulkan object, so it lives as long as the program
+static struct host_arena host;
+
+// device memory and host arena use, at the end of a run
+static void print_memory(const struct gpu_allocator * allocator)
+{
+    struct gpu_allocator_stats gpu;
+    struct host_arena_stats arena;
+    gpu_allocator_stats(allocator, &gpu);
+    host_arena_stats(&host, &arena);
+
+    printf("device memory: %d allocations in %d blocks (%d dedicated), "
+            "%lu of %lu KiB used, %.0f%% of the free space fragmented\n",
+            gpu.allocations, gpu.blocks, gpu.dedicated,
+            (unsigned long) (gpu.used_bytes >> 10), (unsigned long) (gpu.block_bytes >> 10),
+            100.0f * gpu.fragmentation);
+    printf("host arena: %lu KiB in use (peak %lu) in %d chunks, %lu allocations, "
+            "%lu frees, %lu too large for a class\n",
+            (unsigned long) (arena.bytes_in_use >> 10), (unsigned long) (arena.peak_bytes >> 10),
+            arena.chunks, (unsigned long) arena.allocations,
+            (unsigned long) arena.frees, (unsigned long) arena.large);
+}
+
+// where the wind field is at step. it drifts with simulated time, so every
+// run and mode sees the same field
+static void wind_at(uint32_t step, float * y, float * x)
+{
+    float t = step * SIM_DT;
+    *y = 0.5f * WIND_SCROLL * t;
+    *x = WIND_SCROLL * t;
+}
+
+// scroll the wind field to where it is at step and record its upload
+static int record_wind(struct noise_texture * noise, struct gpu_timer * timer,
+        VkCommandBuffer command_buffer, int slot, uint32_t step)
+{
+    float y, x;
+    wind_at(step, &y, &x);
+    uint64_t start = profile_begin();
+    gpu_timer_begin(timer, command_buffer, slot, PROFILE_GPU_NOISE);
+    int texels = noise_texture_scroll(noise, command_buffer, slot, y, x);
+    gpu_timer_end(timer, command_buffer, slot, PROFILE_GPU_NOISE);
+    profile_end(PROFILE_NOISE, start);
+    return texels >= 0;
+}
+
+static void print_wind(const struct noise_texture * noise, uint64_t frames)
+{
+    const struct noise_texture_stats * s = &noise->stats;
+    printf("wind field: %lu updates (%lu full) in %lu regions, %.1f texels/frame uploaded\n",
+            (unsigned long) s->updates, (unsigned long) s->full, (unsigned long) s->regions,
+            frames > 0 ? (double) s->texels / frames : 0.0);
+}
+
+// how the simulation thread kept its timestep, and how often the render
+// loop and it missed each other
+static void print_sim(const struct sim_thread * sim, double ms)
+{
+    struct sim_thread_stats s;
+    sim_thread_get_stats(sim, &s);
+    printf("simulation: %lu steps (%.1f Hz), %lu overran, %lu dropped, "
+            "%lu never drawn, %lu of %lu frames without a new step\n",
+            (unsigned long) s.steps, ms > 0.0 ? 1000.0 * s.steps / ms : 0.0,
+            (unsigned long) s.overruns, (unsigned long) s.dropped,
+            (unsigned long) s.unseen, (unsigned long) s.stale, (unsigned long) s.reads);
+}
+
+// draw count records of source from instances at offset, through the cull
+// pass when there is one
+static void record_draw(struct renderer * renderer, struct cull * cull,
+        struct gpu_timer * timer, VkCommandBuffer command_buffer, int slot, uint32_t image,
+        enum render_source source, VkBuffer instances, VkDeviceSize offset, uint32_t count)
+{
+    if (cull->device != VK_NULL_HANDLE)
+    {
+        gpu_timer_begin(timer, command_buffer, slot, PROFILE_GPU_CULL);
+        cull_record(cull, renderer, command_buffer, slot, instances, offset, count);
+        gpu_timer_end(timer, command_buffer, slot, PROFILE_GPU_CULL);
+    }
+
+    gpu_timer_begin(timer, command_buffer, slot, PROFILE_GPU_DRAW);
+    if (cull->device != VK_NULL_HANDLE)
+    {
+        render_record_culled(renderer, command_buffer, image, source, cull);
+    }
+    else
+    {
+        render_record(renderer, command_buffer, image, source, instances, offset, count);
+    }
+    gpu_timer_end(timer, command_buffer, slot, PROFILE_GPU_DRAW);
+}
+
+static void print_cull(const struct cull * cull)
+{
+    const struct cull_stats * s = &cull->stats;
+    if (cull->device == VK_NULL_HANDLE || s->frames == 0) { return; }
+
+    double n = (double) s->frames;
+    printf("cull: %.0f boids/frame, drawn %.0f (%.0f full, %.0f quads), culled %.0f "
+            "(%.0f out of view, %.0f under a pixel)\n",
+            s->boids / n, (s->drawn[RENDER_LOD_FULL] + s->drawn[RENDER_LOD_QUAD]) / n,
+            s->drawn[RENDER_LOD_FULL] / n, s->drawn[RENDER_LOD_QUAD] / n,
+            (s->outside + s->small) / n, s->outside / n, s->small / n);
+}
+
+// time from launch to the first step, and whether pipelines came out of a
+// warm cache, which is most of the difference between runs
+static void log_startup(const char * mode, const struct pipeline_cache * cache)
+{
+    if (cache->handle == VK_NULL_HANDLE)
+    {
+        printf("%s: startup %.1f ms, no pipeline cache\n", mode, now_ms() - launch_ms);
+        return;
+    }
+    printf("%s: startup %.1f ms, %s pipeline cache (%lu bytes loaded)\n", mode,
+            now_ms() - launch_ms, cache->warm ? "warm" : "cold",
+            (unsigned long) cache->loaded_bytes);
+}
+
+// launch until the first frame went to the gpu, what startup work is
+// judged by. only the first call of a run counts
+static void log_first_frame(const char * mode)
+{
+    static int logged;
+    if (logged) { return; }
+    logged = 1;
+
+    if (profile_enabled) { profile_record(PROFILE_FIRST_FRAME, launch_ns, profile_now()); }
+    printf("%s: first frame %.1f ms after launch\n", mode, now_ms() - launch_ms);
+}
+
+// largest position difference between two states of count boids
+static float max_difference(const struct boid_state * a, const struct boid_state * b, int count)
+{
+    float worst = 0.0f;
+    for (int i = 0; i < count; i++)
+    {
+        worst = fmaxf(worst, fabsf(a->px[i] - b->px[i]));
+        worst = fmaxf(worst, fabsf(a->py[i] - b->py[i]));
+        worst = fmaxf(worst, fabsf(a->pz[i] - b->pz[i]));
+    }
+    return worst;
+}
+
+// submit count gpu flock steps in one command buffer and wait for them
+static VkResult gpu_flock_steps(struct gpu_flock * flock, VkCommandPool command_pool,
+        VkQueue queue, const struct boid_params * params, int count)
+{
+    VkCommandBuffer command_buffer = begin_one_shot(flock->device, command_pool);
+    if (command_buffer == VK_NULL_HANDLE) { return VK_ERROR_OUT_OF_HOST_MEMORY; }
+    for (int i = 0; i < count; i++)
+    {
+        gpu_flock_record(flock, command_buffer, params, SIM_DT);
+    }
+    return end_one_shot(flock->device, command_pool, queue, command_buffer);
+}
+
+// step the cpu and gpu flocks side by side from the same start and report
+// how far apart they end up and what a step costs on each. neighbour sums
+// run in a different order on the gpu, so the first step should agree to
+// float rounding, within COMPARE_EPSILON or the comparison fails. the
+// flocks then drift apart chaotically, so the later figure is only shown
+static int compare_flock(struct boids * cpu, const struct boid_params * params,
+        struct gpu_allocator * allocator, VkDevice device,
+        VkCommandPool command_pool, VkQueue queue, VkPipelineCache pipeline_cache)
+{
+    struct gpu_flock flock;
+    if (!gpu_flock_create(&flock, allocator, device, command_pool, queue,
+                pipeline_cache, cpu, params))
+    {
+        return 0;
+    }
+
+    // an empty flock just to own the readback arrays
+    struct boids * readback = boids_create(cpu->count);
+    struct pool * pool = pool_create(0);
+    int ok = readback != NULL && pool != NULL;
+    struct boid_state * out = ok ? (struct boid_state *) boids_current(readback) : NULL;
+
+    // one step each from the same state
+    ok = ok && boids_step(cpu, params, SIM_DT, pool) &&
+        gpu_flock_steps(&flock, command_pool, queue, params, 1) == VK_SUCCESS &&
+        gpu_flock_read(&flock, command_pool, queue, out);
+    if (ok)
+    {
+        float worst = max_difference(boids_current(cpu), out, cpu->count);
+        ok = worst <= COMPARE_EPSILON;
+        printf("compare: %d boids, max difference after 1 step %g: %s\n",
+                cpu->count, worst, ok ? "ok" : "FAIL");
+    }
+
+    // the rest timed, gpu steps go out in a single submission
+    double cpu_start = now_ms();
+    for (int i = 1; ok && i < COMPARE_STEPS; i++)
+    {
+        ok = boids_step(cpu, params, SIM_DT, pool);
+    }
+    double cpu_ms = now_ms() - cpu_start;
+
+    double gpu_start = now_ms();
+    ok = ok && gpu_flock_steps(&flock, command_pool, queue, params, COMPARE_STEPS - 1) == VK_SUCCESS;
+    double gpu_ms = now_ms() - gpu_start;
+
+    ok = ok && gpu_flock_read(&flock, command_pool, queue, out);
+    if (ok)
+    {
+        printf("compare: max difference after %d steps %g\n",
+                COMPARE_STEPS, max_difference(boids_current(cpu), out, cpu->count));
+        printf("compare: cpu %.3f ms/step (%d threads), gpu %.3f ms/step\n",
+                cpu_ms / (COMPARE_STEPS - 1), pool_threads(pool),
+                gpu_ms / (COMPARE_STEPS - 1));
+    }
+    else
+    {
+        printf("Error: flock comparison failed\n");
+    }
+
+    pool_destroy(pool);
+    boids_destroy(readback);
+    gpu_flock_destroy(&flock);
+    return ok;
+}
+
+// command line ----------------------------------------------------------------
+
+struct options
+{
+    int gpu_sim;                // step the flock in compute shaders
+    int compare;                // check the gpu step against the cpu and exit
+    int headless;               // no window or swapchain
+    int cpu_only;               // headless without vulkan at all
+    int boid_count;
+    int frames_in_flight;
+    int no_cull;                // one direct draw of every boid, no cull pass
+    int steps;                  // headless run length
+    const char * frames_dir;    // headless: write every frame here as ppm
+    const char * state_path;    // headless: write the final state here
+    const char * load_path;     // start from this snapshot, not a spawn
+    const char * record_path;   // headless cpu: snapshot the start, then every step
+    const char * replay_path;   // redo and check a recording, then exit
+    uint64_t first_step;        // steps the loaded flock had taken
+    int profile;                // time stages, summaries while running
+    const char * profile_csv;   // write the stage times here at exit
+    const char * profile_trace; // same as chrome trace json
+};
+
+static int parse_options(struct options * opt, int argc, char ** argv)
+{
+    opt->boid_count = DEFAULT_BOIDS;
+    opt->frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+    opt->steps = DEFAULT_STEPS;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int more = i + 1 < argc;
+        if (strcmp(argv[i], "--gpu-sim") == 0) { opt->gpu_sim = 1; }
+        else if (strcmp(argv[i], "--compare") == 0) { opt->compare = 1; }
+        else if (strcmp(argv[i], "--headless") == 0) { opt->headless = 1; }
+        else if (strcmp(argv[i], "--cpu") == 0) { opt->cpu_only = 1; }
+        else if (strcmp(argv[i], "--boids") == 0 && more) { opt->boid_count = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--frames") == 0 && more) { opt->frames_in_flight = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--no-cull") == 0) { opt->no_cull = 1; }
+        else if (strcmp(argv[i], "--steps") == 0 && more) { opt->steps = atoi(argv[++i]); }
+        else if (strcmp(argv[i], "--save-frames") == 0 && more) { opt->frames_dir = argv[++i]; }
+        else if (strcmp(argv[i], "--save-state") == 0 && more) { opt->state_path = argv[++i]; }
+        else if (strcmp(argv[i], "--load-state") == 0 && more) { opt->load_path = argv[++i]; }
+        else if (strcmp(argv[i], "--record") == 0 && more) { opt->record_path = argv[++i]; }
+        else if (strcmp(argv[i], "--replay") == 0 && more) { opt->replay_path = argv[++i]; }
+        else if (strcmp(argv[i], "--profile") == 0) { opt->profile = 1; }
+        else if (strcmp(argv[i], "--profile-csv") == 0 && more) { opt->profile_csv = argv[++i]; }
+        else if (strcmp(argv[i], "--profile-trace") == 0 && more) { opt->profile_trace = argv[++i]; }
+        else
+        {
+            printf("usage: %s [--gpu-sim] [--compare] [--boids n] [--frames n] [--no-cull]\n"
+                   "       [--load-state file]\n"
+                   "       [--headless [--cpu [--record file]] [--steps n] [--save-frames dir]\n"
+                   "                   [--save-state file]]\n"
+                   "       [--profile] [--profile-csv file] [--profile-trace file]\n"
+                   "       %s --replay file\n",
+                   argv[0], argv[0]);
+            return 0;
+        }
+    }
+
+    // --cpu implies no window either, and recording only happens there
+    if (opt->cpu_only) { opt->headless = 1; }
+    if (opt->record_path != NULL && !opt->cpu_only)
+    {
+        printf("Error: --record needs --headless --cpu\n");
+        return 0;
+    }
+    profile_enable(opt->profile || opt->profile_csv != NULL || opt->profile_trace != NULL);
+    return 1;
+}
+
+// final summary and exports of the stage times, when asked for
+static int finish_profile(const struct options * opt)
+{
+    int ok = 1;
+    if (opt->profile)
+    {
+        printf("stage times:\n");
+        profile_summary(stdout);
+    }
+    if (opt->profile_csv != NULL) { ok = profile_write_csv(opt->profile_csv) && ok; }
+    if (opt->profile_trace != NULL) { ok = profile_write_trace(opt->profile_trace) && ok; }
+    return ok;
+}
+
+// snapshots -------------------------------------------------------------------
+
+// a flock from the snapshot at path instead of spawning one, sized to it
+static struct boids * load_state(struct options * opt, struct boid_params * params)
+{
+    struct snapshot snapshot;
+    if (!snapshot_open(&snapshot, opt->load_path)) { return NULL; }
+
+    double start = now_ms();
+    struct boids * boids = boids_create(snapshot.header->count);
+    if (boids != NULL && !snapshot_restore(&snapshot, boids, params))
+    {
+        boids_destroy(boids);
+        boids = NULL;
+    }
+    if (boids != NULL)
+    {
+        opt->boid_count = boids->count;
+        opt->first_step = snapshot.header->step;
+        printf("loaded %d boids at step %lu from %s in %.2f ms\n", boids->count,
+                (unsigned long) opt->first_step, opt->load_path, now_ms() - start);
+    }
+    snapshot_close(&snapshot);
+    return boids;
+}
+
+// redo the steps recorded in the snapshot at path and check each one
+static int replay(const char * path)
+{
+    struct snapshot snapshot;
+    if (!snapshot_open(&snapshot, path)) { return 0; }
+
+    struct boids * boids = boids_create(snapshot.header->count);
+    struct pool * pool = pool_create(0);
+    int matched = -1;
+    double start = now_ms();
+    if (boids != NULL && pool != NULL)
+    {
+        matched = snapshot_replay(&snapshot, boids, pool);
+    }
+    double ms = now_ms() - start;
+
+    int ok = matched == snapshot.record_count;
+    if (matched >= 0)
+    {
+        printf("replay: %d boids, %d of %d steps match%s, %.3f ms/step\n",
+                snapshot.header->count, matched, snapshot.record_count,
+                ok ? "" : ", diverged after that",
+                ms / (snapshot.record_count > 0 ? snapshot.record_count : 1));
+    }
+    pool_destroy(pool);
+    boids_destroy(boids);
+    snapshot_close(&snapshot);
+    return ok;
+}
+
+// startup thread --------------------------------------------------------------
+
+// work that needs nothing from sdl or vulkan, or only the device, runs on a
+// second thread while the main thread brings those up. a phase is joined
+// before anything it made is touched, which is all the synchronization:
+// until then the main thread keeps off the allocator, queue and command
+// pool a phase is using
+struct startup
+{
+    pthread_t thread;
+    int running;
+    int (*phase)(struct startup *);
+    int ok;
+    double busy_ms;             // phases' time on the thread
+    double waited_ms;           // main thread's time in startup_join
+
+    // preload: the flock, the spir-v and the first wind window
+    struct options * opt;
+    struct boid_params * params;
+    struct boids * boids;
+    struct noise_prefill wind;
+
+    // pipelines: the renderer's and gpu flock's, once the device exists
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    VkCommandPool command_pool;
+    VkQueue queue;
+    VkPipelineCache pipeline_cache;
+    VkFormat format;
+    struct renderer * renderer;
+    struct gpu_flock * flock;
+};
+
+static void * startup_main(void * arg)
+{
+    struct startup * s = arg;
+    double start = now_ms();
+    s->ok = s->phase(s);
+    s->busy_ms += now_ms() - start;
+    return NULL;
+}
+
+// run phase on the startup thread, or right here if no thread can start
+static void startup_begin(struct startup * s, int (*phase)(struct startup *))
+{
+    s->phase = phase;
+    s->running = pthread_create(&s->thread, NULL, startup_main, s) == 0;
+    if (!s->running) { startup_main(s); }
+}
+
+// wait for the phase, returns 0 if it failed
+static int startup_join(struct startup * s)
+{
+    if (s->running)
+    {
+        double start = now_ms();
+        pthread_join(s->thread, NULL);
+        s->waited_ms += now_ms() - start;
+        s->running = 0;
+    }
+    return s->ok;
+}
+
+// the flock, loaded or spawned, and what drawing it will need
+static int preload(struct startup * s)
+{
+    uint64_t t = profile_begin();
+    struct options * opt = s->opt;
+    int ok = 1;
+    if (opt->load_path != NULL)
+    {
+        s->boids = load_state(opt, s->params);
+        ok = s->boids != NULL;
+    }
+    else
+    {
+        s->boids = boids_create(opt->boid_count);
+        ok = s->boids != NULL &&
+            boids_spawn(s->boids, s->params, opt->boid_count, 1) == opt->boid_count;
+        if (!ok) { printf("Error: couldnt spawn %d boids\n", opt->boid_count); }
+    }
+
+    if (ok && !opt->cpu_only)
+    {
+        float y, x;
+        wind_at(0, &y, &x);
+        shader_preload(SHADER_DIR);
+        ok = noise_prefill_create(&s->wind, 0, 0, y, x);
+    }
+    profile_end(PROFILE_PRELOAD, t);
+    return ok;
+}
+
+// the window's pipelines, while the main thread makes the swapchain
+static int build_pipelines(struct startup * s)
+{
+    uint64_t t = profile_begin();
+    int ok = render_create(s->renderer, s->allocator, s->device, s->command_pool,
+            s->queue, s->pipeline_cache, s->format, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, s->params);
+    if (ok && s->opt->gpu_sim)
+    {
+        // its state buffers are the per instance vertex input of the draw
+        ok = gpu_flock_create(s->flock, s->allocator, s->device, s->command_pool,
+                s->queue, s->pipeline_cache, s->boids, s->params);
+    }
+    profile_end(PROFILE_PIPELINES, t);
+    return ok;
+}
+
+// how much of the startup work the main thread did not wait for
+static void log_overlap(const struct startup * s)
+{
+    printf("startup thread: %.1f ms of work, %.1f ms waited for\n",
+            s->busy_ms, s->waited_ms);
+}
+
+// headless --------------------------------------------------------------------
+
+// step the cpu flock as fast as the pool goes, no sdl or vulkan at all
+static int run_cpu_headless(const struct options * opt, struct boids * boids,
+        const struct boid_params * params)
+{
+    struct pool * pool = pool_create(0);
+    if (pool == NULL) { return 0; }
+
+    // the starting state, then a record after every step
+    struct snapshot_recorder recorder = {0};
+    int ok = 1;
+    if (opt->record_path != NULL)
+    {
+        ok = snapshot_write(opt->record_path, boids, params, NULL, NULL, opt->first_step) &&
+            snapshot_recorder_open(&recorder, opt->record_path);
+    }
+
+    double start = now_ms();
+    printf("headless cpu: startup %.1f ms\n", start - launch_ms);
+    for (int i = 0; ok && i < opt->steps; i++)
+    {
+        profile_frame(i);
+        uint64_t t = profile_begin();
+        ok = boids_step(boids, params, SIM_DT, pool);
+        profile_end(PROFILE_SIMULATE, t);
+
+        if (ok && recorder.file != NULL)
+        {
+            ok = snapshot_record(&recorder, boids, params, SIM_DT);
+        }
+    }
+    double ms = now_ms() - start;
+    ok = snapshot_recorder_close(&recorder) && ok;
+
+    printf("headless cpu: %d boids, %d steps, %.3f ms/step (%d threads)\n",
+            boids->count, opt->steps, ms / (opt->steps > 0 ? opt->steps : 1),
+            pool_threads(pool));
+    pool_destroy(pool);
+
+    if (ok && opt->state_path != NULL)
+    {
+        ok = snapshot_write(opt->state_path, boids, params, NULL, NULL,
+                opt->first_step + opt->steps);
+    }
+    return ok;
+}
+
+// step and draw into offscreen images at full speed, no window, swapchain
+// or vsync. frames are written out once their fence comes round again, so
+// the gpu keeps working on later frames meanwhile
+static int run_headless(const struct options * opt, struct gpu_allocator * allocator,
+        VkDevice device, VkCommandPool command_pool, VkQueue queue, uint32_t timestamp_bits,
+        const struct pipeline_cache * cache, struct boids * boids,
+        const struct boid_params * params, struct startup * startup)
+{
+    struct gpu_flock flock = {0};
+    struct upload_ring ring = {0};
+    struct renderer renderer = {0};
+    struct offscreen offscreen = {0};
+    struct frames frames = {0};
+    struct gpu_timer timer = {0};
+    struct noise_texture noise = {0};
+    struct cull cull = {0};
+    struct pool * pool = NULL;
+    int written[FRAMES_MAX];    // step drawn into each target, -1 for none
+    char path[4096];
+
+    uint64_t t = profile_begin();
+    int ok = render_create(&renderer, allocator, device, command_pool, queue,
+                cache->handle, OFFSCREEN_FORMAT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, params);
+    if (ok && opt->gpu_sim)
+    {
+        ok = gpu_flock_create(&flock, allocator, device, command_pool, queue,
+                cache->handle, boids, params);
+    }
+    profile_end(PROFILE_PIPELINES, t);
+
+    t = profile_begin();
+    ok = ok && frames_create(&frames, device, allocator->host, command_pool,
+                opt->frames_in_flight) &&
+        offscreen_create(&offscreen, allocator, device,
+                SCREEN_WIDTH, SCREEN_HEIGHT, frames.count) &&
+        render_set_target(&renderer, offscreen.extent, offscreen.images, offscreen.count, 0) &&
+        noise_texture_create(&noise, allocator, device, 0, 0, frames.count);
+    if (ok)
+    {
+        noise_texture_use_prefill(&noise, &startup->wind);
+        render_set_noise(&renderer, &noise);
+    }
+    shader_preload_free();
+    if (ok && !opt->gpu_sim)
+    {
+        // the cpu flock steps over every core, as run_cpu_headless does
+        pool = pool_create(0);
+        ok = pool != NULL && upload_ring_create(&ring, allocator,
+                sizeof(struct Instance) * boids->count, frames.count,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    }
+    if (ok && !opt->no_cull)
+    {
+        ok = cull_create(&cull, allocator, device, cache->handle,
+                opt->gpu_sim ? RENDER_GPU_STATE : RENDER_INSTANCES, boids->count, frames.count);
+    }
+    if (ok && profile_enabled)
+    {
+        gpu_timer_create(&timer, allocator->physical_device, device, allocator->host,
+                timestamp_bits, frames.count);
+    }
+    profile_end(PROFILE_RESOURCES, t);
+
+    for (int i = 0; i < FRAMES_MAX; i++) { written[i] = -1; }
+
+    if (ok)
+    {
+        log_startup("headless", cache);
+        log_overlap(startup);
+    }
+    double start = now_ms();
+    for (int step = 0; ok && step <= opt->steps; step++)
+    {
+        profile_frame(step);
+        t = profile_begin();
+        struct frame * frame = frames_begin(&frames);
+        profile_end(PROFILE_WAIT, t);
+        if (frame == NULL) { ok = 0; break; }
+        int target = frames.current;
+
+        // this target's last frame is done, write it before reusing it
+        if (written[target] >= 0 && opt->frames_dir != NULL)
+        {
+            snprintf(path, sizeof(path), "%s/frame_%05d.ppm", opt->frames_dir, written[target]);
+            ok = offscreen_write_ppm(&offscreen, target, path);
+        }
+        written[target] = -1;
+        if (step == opt->steps || !ok) { break; }
+
+        VkCommandBuffer command_buffer = frame->command_buffer;
+        gpu_timer_begin_frame(&timer, command_buffer, target, step);
+        if (!record_wind(&noise, &timer, command_buffer, target, step)) { ok = 0; break; }
+        if (opt->gpu_sim)
+        {
+            t = profile_begin();
+            gpu_timer_begin(&timer, command_buffer, target, PROFILE_GPU_SIMULATE);
+            gpu_flock_record(&flock, command_buffer, params, SIM_DT);
+            gpu_timer_end(&timer, command_buffer, target, PROFILE_GPU_SIMULATE);
+            record_draw(&renderer, &cull, &timer, command_buffer, target, target,
+                    RENDER_GPU_STATE, gpu_flock_state(&flock), 0, boids->count);
+            profile_end(PROFILE_RECORD, t);
+        }
+        else
+        {
+            t = profile_begin();
+            ok = boids_step(boids, params, SIM_DT, pool);
+            profile_end(PROFILE_SIMULATE, t);
+
+            t = profile_begin();
+            VkDeviceSize offset;
+            upload_ring_begin(&ring, target);
+            struct Instance * instances = upload_ring_alloc(&ring,
+                    sizeof(struct Instance) * boids->count, sizeof(struct Instance), &offset);
+            if (!ok || instances == NULL) { ok = 0; break; }
+            render_pack(instances, boids_current(boids), boids->count, params);
+            upload_ring_end(&ring);
+            profile_end(PROFILE_UPLOAD, t);
+
+            t = profile_begin();
+            record_draw(&renderer, &cull, &timer, command_buffer, target, target,
+                    RENDER_INSTANCES, ring.buffer, offset, boids->count);
+            profile_end(PROFILE_RECORD, t);
+        }
+
+        if (opt->frames_dir != NULL)
+        {
+            gpu_timer_begin(&timer, command_buffer, target, PROFILE_GPU_COPY);
+            offscreen_record_copy(&offscreen, command_buffer, target);
+            gpu_timer_end(&timer, command_buffer, target, PROFILE_GPU_COPY);
+            written[target] = step;
+        }
+
+        t = profile_begin();
+        ok = frames_submit(&frames, queue, frame, 0) == VK_SUCCESS;
+        profile_end(PROFILE_SUBMIT, t);
+        if (ok) { log_first_frame("headless"); }
+    }
+    vkDeviceWaitIdle(device);
+    double ms = now_ms() - start;
+    gpu_timer_flush(&timer);
+    cull_flush(&cull);
+
+    // the last frames in flight were never come round to again
+    for (int i = 0; ok && i < frames.count; i++)
+    {
+        if (written[i] < 0) { continue; }
+        snprintf(path, sizeof(path), "%s/frame_%05d.ppm", opt->frames_dir, written[i]);
+        ok = offscreen_write_ppm(&offscreen, i, path);
+    }
+
+    if (ok)
+    {
+        printf("headless %s: %d boids, %d frames, %.3f ms/frame\n",
+                opt->gpu_sim ? "gpu" : "cpu", boids->count, opt->steps,
+                ms / (opt->steps > 0 ? opt->steps : 1));
+    }
+
+    if (ok && opt->state_path != NULL)
+    {
+        if (opt->gpu_sim)
+        {
+            ok = gpu_flock_read(&flock, command_pool, queue,
+                    (struct boid_state *) boids_current(boids));
+        }
+        ok = ok && snapshot_write(opt->state_path, boids, params, &noise.ctx, NULL,
+                opt->first_step + opt->steps);
+    }
+
+    print_wind(&noise, opt->steps);
+    print_cull(&cull);
+    print_memory(allocator);
+    gpu_timer_destroy(&timer);
+    cull_destroy(&cull);
+    gpu_flock_destroy(&flock);
+    upload_ring_destroy(&ring);
+    render_destroy(&renderer);
+    noise_texture_destroy(&noise);
+    offscreen_destroy(&offscreen);
+    frames_destroy(&frames);
+    pool_destroy(pool);
+    return ok;
+}
+
+// the device and what every mode shares on it, once whatever ran on it is
+// gone. the cache is saved first, pipelines built on a failed run are still
+// good for the next one
+static void destroy_device(VkDevice device, VkCommandPool command_pool,
+        struct pipeline_cache * pipeline_cache, struct gpu_allocator * allocator)
+{
+    pipeline_cache_save(pipeline_cache);
+    pipeline_cache_destroy(pipeline_cache);
+    gpu_allocator_destroy(allocator);
+    vkDestroyCommandPool(device, command_pool, &host.callbacks);
+    vkDestroyDevice(device, &host.callbacks);
+}
 
 // main ----------------------------------------------------------------------
 
@@ -74,49 +836,96 @@ int main(int argc, char** argv)
 {
     // sdl vars
     SDL_Window * win = NULL;
-    SDL_Surface * surf = NULL;
 
     // vk vars
 	VkInstance instance;
     VkPhysicalDevice physical_device;
     VkDevice device;
     VkQueue queue;
-    VkSemaphore image_available;
-    VkSemaphore rendering_finished;
     VkCommandPool command_pool;
     VkSurfaceKHR vk_surf;
-    VkSwapchainKHR swapchain;
-    VkImage * swapchain_images = NULL;
+    struct swapchain swapchain = {0};
+    struct frames frames = {0};
+    struct pipeline_cache pipeline_cache = {0};
+    struct gpu_allocator allocator = {0};
+    struct gpu_timer timer = {0};
+    struct noise_texture noise = {0};
 
 
 	uint32_t physical_device_count = 0;
     uint32_t extension_count = 0;
-    char * extension_names = NULL;
+    const char ** extension_names = NULL;
+    const char * device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+    // flock vars
+    struct options opt = {0};
+    launch_ms = now_ms();
+    launch_ns = profile_now();
+    struct boid_params params;
+    struct boids * boids = NULL;
+    struct gpu_flock flock = {0};
+    struct upload_ring ring = {0};
+    struct renderer renderer = {0};
+    struct cull cull = {0};
+    struct startup startup = {0};
+    int status = 0;
+
+    if (!parse_options(&opt, argc, argv)) { return 1; }
+
+    if (opt.replay_path != NULL) { return replay(opt.replay_path) ? 0 : 1; }
+
+    // the flock, shaders and wind field get going while sdl and vulkan come
+    // up. the main thread keeps off opt.boid_count and params until joined
+    boid_params_default(&params);
+    startup.opt = &opt;
+    startup.params = &params;
+    startup_begin(&startup, preload);
+
+    // cpu only, nothing to draw with
+    if (opt.cpu_only)
+    {
+        if (!startup_join(&startup)) { return 1; }
+        boids = startup.boids;
+        int ok = run_cpu_headless(&opt, boids, &params);
+        ok = finish_profile(&opt) && ok;
+        boids_destroy(boids);
+        return ok ? 0 : 1;
+    }
 
     // initialize SDL ---------------------------------------------------------
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0 )
+    // headless needs no video, just the timer
+    if (opt.headless)
+    {
+        if (SDL_Init(SDL_INIT_TIMER) < 0)
+        {
+            printf("SDL failed to initialize. SDL_Error: %s\n", SDL_GetError());
+            return die(win, 1);
+        }
+    }
+    else if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0 )
     {
         printf("SDL failed to initialize. SDL_Error: %s\n", SDL_GetError());
         return die(win, 1);
     }
 
     // create SDL window
-    win = SDL_CreateWindow(
+    if (!opt.headless) win = SDL_CreateWindow(
             "Hello World", 
             SDL_WINDOWPOS_UNDEFINED, 
             SDL_WINDOWPOS_UNDEFINED,
             SCREEN_WIDTH,
             SCREEN_HEIGHT,
-            SDL_WINDOW_SHOWN );
+            SDL_WINDOW_SHOWN | SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE );
 
-    if (win == NULL)
+    if (!opt.headless && win == NULL)
     {
         printf("Window could not be created. SDL_Error: %s\n", SDL_GetError());
         return die(win, 1);
     }
 
-    surf = SDL_GetWindowSurface(win);
+    // no SDL_GetWindowSurface, a software surface cant share the window
+    // with a vulkan swapchain
 
     // initialize Vulkan ------------------------------------------------------
 
@@ -132,10 +941,17 @@ int main(int argc, char** argv)
 		VK_MAKE_VERSION(1,2,170) 			// vulkan API version
 	};
 
-    // get vk extensions for SDL compatibility (first count, then names)
-    SDL_Vulkan_GetInstanceExtensions(win, &extension_count, NULL);
-    SDL_Vulkan_GetInstanceExtensions(win, &extension_count, 
-            (const char **) &extension_names); // need malloc?
+    // get vk extensions for SDL compatibility (first count, then names),
+    // headless needs no surface so no extensions at all
+    if (!opt.headless)
+    {
+        SDL_Vulkan_GetInstanceExtensions(win, &extension_count, NULL);
+    }
+    extension_names = malloc(sizeof(const char *) * (extension_count + 1));
+    if (!opt.headless)
+    {
+        SDL_Vulkan_GetInstanceExtensions(win, &extension_count, extension_names);
+    }
 
 	// define vulkan instance (state machine) data frame
 	const VkInstanceCreateInfo instance_info =
@@ -147,15 +963,20 @@ int main(int argc, char** argv)
 		0,										// enabled layer count
 		0,										// enabled layer names
 		extension_count,						// enabled extension count	
-	    (const char * const *) extension_names	// enabled extension names
+	    extension_names							// enabled extension names
 	};
 
-	// create instance of vulkan
-	TRY(vkCreateInstance(&instance_info, 0, &instance));
+	// create instance of vulkan, its host allocations and the device's
+	// come out of the arena
+    uint64_t phase = profile_begin();
+    if (!host_arena_create(&host)) { return die(win, 1); }
+	TRY(vkCreateInstance(&instance_info, &host.callbacks, &instance));
+    profile_end(PROFILE_INSTANCE, phase);
 
     // get our device and make a queue ----------------------------------------
 
 	// get physical devices, first calling enumerate for count, then for handles
+    phase = profile_begin();
 	TRY(vkEnumeratePhysicalDevices(instance, &physical_device_count, NULL));
 	VkPhysicalDevice * const physical_devices = (VkPhysicalDevice *) 
 		malloc( sizeof(VkPhysicalDevice) * physical_device_count );
@@ -166,6 +987,7 @@ int main(int argc, char** argv)
 	uint32_t physical_device_index = 0;
 	uint32_t queue_family_index = 0;
     uint8_t queue_count = 0;
+    uint32_t timestamp_bits = 0;
 
 	for (uint32_t i = 0; i < physical_device_count; i++)
 	{
@@ -187,20 +1009,27 @@ int main(int argc, char** argv)
 			queue_family_properties			// memory we just allocated
 		);
         
-		// iterate over queue families to find a graphics capable one
+		// iterate over queue families to find one for both drawing and the
+		// flock compute passes, so they share a queue and need no transfers
+		const VkQueueFlags wanted = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
 		for(uint32_t j = 0; j < queue_family_properties_count; j++)
 		{
-			if((VK_QUEUE_GRAPHICS_BIT & queue_family_properties[j].queueFlags) != 0)
+			if((wanted & queue_family_properties[j].queueFlags) == wanted)
 			{
 				graphics_bit = 1;
                 queue_family_index = j;
                 physical_device_index = i;
 				queue_count = queue_family_properties[j].queueCount;
+                timestamp_bits = queue_family_properties[j].timestampValidBits;
                 break;
 			}
         }
 
-        if (graphics_bit != 1) { continue; } // failed to find gfx
+        if (graphics_bit != 1) // failed to find gfx
+        {
+            free(queue_family_properties);
+            continue;
+        }
 
         // create logical device
         const float queue_priority = 1.0f; // one normalized float / queue
@@ -223,8 +1052,8 @@ int main(int argc, char** argv)
             &device_queue_info,    					// pointer to array of create infos
             0,										// enabled layers
             0,										// ppEnabledLayerNames
-            extension_count,						// enabled extension count
-            (const char * const *) extension_names,	// enabled extension names
+            opt.headless ? 0 : 1,					// enabled extension count
+            device_extensions,						// enabled extension names
             0										// enabled physical device features
         };
 
@@ -233,7 +1062,7 @@ int main(int argc, char** argv)
         vkCreateDevice(
                 physical_devices[physical_device_index], // physical device
                 &device_info,                            // device info above
-                NULL,                                    // alloc callbk ptr
+                &host.callbacks,                         // alloc callbk ptr
                 &device );                               // logical device 
 
 		// create logical queue
@@ -242,43 +1071,74 @@ int main(int argc, char** argv)
                 queue_family_index,
                 0,                  // queue_index (of queue_count, 1)
                 &queue );
-
-        // create semaphores ------------------------------------------------
-        VkSemaphoreCreateInfo semaphore_info;
-        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        if ( vkCreateSemaphore(
-                    device, 
-                    &semaphore_info, 
-                    NULL, 
-                    &image_available ) != VK_SUCCESS || 
-             vkCreateSemaphore(
-                    device, 
-                    &semaphore_info, 
-                    NULL, 
-                    &rendering_finished ) != VK_SUCCESS )
-        {
-            printf("failed to create semaphores\n");
-            die(win, 0);
-        }
+        profile_end(PROFILE_DEVICE, phase);
 
         // create command pool -----------------------------------------------
-        VkCommandPoolCreateInfo command_pool_info;
+        VkCommandPoolCreateInfo command_pool_info = {0};
         command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
         command_pool_info.queueFamilyIndex = queue_family_index;
         
         if ( vkCreateCommandPool( 
                     device,
                     &command_pool_info,
-                    NULL,
+                    &host.callbacks,
                     &command_pool ) != VK_SUCCESS )
         {
             printf("Failed to create command pool.\n");
-            die(win, 0);
+            vkDestroyDevice(device, &host.callbacks);
+            free(queue_family_properties);
+            status = 1;
+            break;
         } 
 
+        // device memory comes out of large blocks, not an allocation
+        // per buffer or image
+        gpu_allocator_create(&allocator, physical_device, device, 0, &host.callbacks);
+
+        // pipelines build from the last run's cache when it is for this
+        // device and driver. without one they just compile from scratch
+        pipeline_cache_create(&pipeline_cache, physical_device, device, &host.callbacks,
+                PIPELINE_CACHE_PATH);
+
+        free(queue_family_properties);
+
+        // everything from here on wants the flock. every mode ends by
+        // tearing down the device and breaking out of the loop, the flock
+        // and whatever else the preload made are freed after it
+        if (!startup_join(&startup))
+        {
+            destroy_device(device, command_pool, &pipeline_cache, &allocator);
+            status = 1;
+            break;
+        }
+        boids = startup.boids;
+
+        // cpu against gpu flock, no presentation needed
+        if (opt.compare)
+        {
+            int ok = compare_flock(boids, &params, &allocator, device,
+                    command_pool, queue, pipeline_cache.handle);
+            destroy_device(device, command_pool, &pipeline_cache, &allocator);
+            status = ok ? 0 : 1;
+            break;
+        }
+
+        // offscreen targets instead of a window
+        if (opt.headless)
+        {
+            int ok = run_headless(&opt, &allocator, device, command_pool, queue,
+                    timestamp_bits, &pipeline_cache, boids, &params, &startup);
+            ok = finish_profile(&opt) && ok;
+            destroy_device(device, command_pool, &pipeline_cache, &allocator);
+            status = ok ? 0 : 1;
+            break;
+        }
+
         // KHR surface world // swapchain creation ---------------------------
 
         // create vulkan surface, check compatibility with queue family
+        phase = profile_begin();
         SDL_Vulkan_CreateSurface(win, instance, &vk_surf);
         VkBool32 khr_support;
         vkGetPhysicalDeviceSurfaceSupportKHR(
@@ -286,236 +1146,302 @@ int main(int argc, char** argv)
                 queue_family_index,
                 vk_surf,
                 &khr_support );
-        if (khr_support != VK_TRUE) { die(win, 1); }
 
-        // get the surface's capabilities
-        VkSurfaceCapabilitiesKHR surface_capabilities;
-        if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-                physical_device,
-                vk_surf,
-                &surface_capabilities ) != VK_SUCCESS) 
-        { 
-            printf("Error: couldnt get surface capabilities. \n");
-            die (win, 1); 
-        }
+        // from here a failure skips the render loop, the teardown after it
+        // copes with whatever was not made
+        int ok = khr_support == VK_TRUE;
+        if (!ok) { printf("Error: couldnt present to the window's surface\n"); }
+
+        // pipelines only need the surface's format, so they build on the
+        // startup thread meanwhile. it has the allocator, queue and command
+        // pool to itself until joined
+        startup.allocator = &allocator;
+        startup.device = device;
+        startup.command_pool = command_pool;
+        startup.queue = queue;
+        startup.pipeline_cache = pipeline_cache.handle;
+        startup.format = swapchain_pick_format(physical_device, vk_surf).format;
+        startup.renderer = &renderer;
+        startup.flock = &flock;
+        if (ok) { startup_begin(&startup, build_pipelines); }
+
+        // pick a format, size and low latency present mode, see swapchain.c
+        int drawable_width, drawable_height;
+        SDL_Vulkan_GetDrawableSize(win, &drawable_width, &drawable_height);
+        ok = ok && swapchain_create(&swapchain, physical_device, device, &host.callbacks,
+                vk_surf, drawable_width, drawable_height);
 
-        // get the surface's supported color formats
-        uint32_t format_count;
-        if (vkGetPhysicalDeviceSurfaceFormatsKHR(
-                physical_device,
-                vk_surf,
-                &format_count,
-                NULL ) != VK_SUCCESS) 
-        { 
-            printf("Error: couldnt get surface format count. \n");
-            die (win, 1); 
-        }
+        // swapchain complete!
+        profile_end(PROFILE_SWAPCHAIN, phase);
 
-        VkSurfaceFormatKHR * surface_formats = 
-            malloc(sizeof(VkSurfaceFormatKHR) * format_count); // not freed
-        if (vkGetPhysicalDeviceSurfaceFormatsKHR(
-                physical_device,
-                vk_surf,
-                &format_count,
-                surface_formats ) != VK_SUCCESS) 
-        { 
-            printf("Error: couldnt get surface formats . \n");
-            die (win, 1); 
-        }
+        // renderer and gpu flock --------------------------------------------
 
-        // find surface's supported presentation modes
-        uint32_t present_mode_count;
-        if (vkGetPhysicalDeviceSurfacePresentModesKHR(
-                physical_device,
-                vk_surf,
-                &present_mode_count,
-                NULL ) != VK_SUCCESS) 
-        { 
-            printf("Error: couldnt get presentation mode count. \n");
-            die (win, 1); 
-        }
+        // always joined, the thread may still be using the device. a
+        // renderer or flock it left half made is torn down with the rest
+        ok = startup_join(&startup) && ok;
+        shader_preload_free();
 
-        VkPresentModeKHR * present_modes = 
-            malloc(sizeof(VkPresentModeKHR) * format_count); // not freed
-        if (vkGetPhysicalDeviceSurfacePresentModesKHR(
-                physical_device,
-                vk_surf,
-                &present_mode_count,
-                present_modes ) != VK_SUCCESS) 
-        { 
-            printf("Error: couldnt get presentation modes. \n");
-            die (win, 1); 
+        // create vertex buffer ----------------------------------------------
+        
+        // cpu boids go up through a mapped ring, one slice per frame in
+        // flight, so writing a frame never waits on the one being drawn
+        if (ok && !opt.gpu_sim)
+        {
+            ok = upload_ring_create(&ring, &allocator,
+                    sizeof(struct Instance) * opt.boid_count, opt.frames_in_flight,
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
         }
 
-        // determine number of images in the swapchain
-        uint32_t image_count = surface_capabilities.minImageCount + 1;
-        if (surface_capabilities.maxImageCount != 0 && 
-                image_count > surface_capabilities.maxImageCount)
+        // create uniform buffer ---------------------------------------------
+
+        // the camera is the only per frame uniform, it goes in push constants
+
+        // frames in flight -------------------------------------------------
+
+        phase = profile_begin();
+        ok = ok && render_set_target(&renderer, swapchain.extent, swapchain.images,
+                    swapchain.image_count, 0) &&
+            frames_create(&frames, device, &host.callbacks, command_pool, opt.frames_in_flight) &&
+            noise_texture_create(&noise, &allocator, device, 0, 0, frames.count) &&
+            (opt.no_cull || cull_create(&cull, &allocator, device, pipeline_cache.handle,
+                    opt.gpu_sim ? RENDER_GPU_STATE : RENDER_INSTANCES, opt.boid_count,
+                    frames.count));
+        if (ok)
+        {
+            noise_texture_use_prefill(&noise, &startup.wind);
+            render_set_noise(&renderer, &noise);
+        }
+        if (ok && profile_enabled)
         {
-            image_count = surface_capabilities.maxImageCount;
+            gpu_timer_create(&timer, physical_device, device, &host.callbacks,
+                    timestamp_bits, frames.count);
         }
+        profile_end(PROFILE_RESOURCES, phase);
+
+        log_startup("startup", &pipeline_cache);
+        log_overlap(&startup);
 
-        // select a surface format -------------------------
-        VkSurfaceFormatKHR surface_format;
+        // simulation thread ------------------------------------------------
 
-        // if undefined, try standard 32 bit color
-        if (format_count == 1 && surface_formats[0].format == VK_FORMAT_UNDEFINED)
+        // cpu boids step at SIM_DT on their own thread from here on, so a
+        // slow frame does not hold up the simulation nor a slow step the
+        // frame. boids belong to it until it is stopped, one that fails to
+        // start hands them straight back
+        struct sim_thread sim = {0};
+        struct pool * sim_pool = NULL;
+        if (ok && !opt.gpu_sim)
         {
-            surface_format.format = VK_FORMAT_R8G8B8A8_UNORM; 
-            surface_format.colorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR;
+            sim_pool = pool_create(0);
+            ok = sim_pool != NULL && sim_thread_start(&sim, boids, &params, SIM_DT, sim_pool);
         }
-        else 
+
+        // render loop -------------------------------------------------------
+
+        // the cpu records frame n + 1 while the gpu draws frame n, up to
+        // opt.frames_in_flight frames ahead
+        double loop_start = now_ms();
+        double summary_at = loop_start + PROFILE_SUMMARY_MS;
+        int resized = 0;
+        for (int running = ok; running; )
         {
-            // try to find standard 32 bit color
-            int standard_found = 0;
-            for (int i = 0; i < format_count; i++)
+            uint32_t frame_number = (uint32_t) frames.stats.frames;
+            profile_frame(frame_number);
+            if (opt.profile && now_ms() >= summary_at)
+            {
+                profile_summary(stdout);
+                if (!opt.gpu_sim) { print_sim(&sim, now_ms() - loop_start); }
+                summary_at = now_ms() + PROFILE_SUMMARY_MS;
+            }
+
+            uint64_t t = profile_begin();
+            SDL_Event event;
+            while (SDL_PollEvent(&event))
             {
-                if (surface_formats[i].format == VK_FORMAT_R8G8B8A8_UNORM)
+                if (event.type == SDL_QUIT) { running = 0; }
+                if (event.type == SDL_WINDOWEVENT &&
+                    event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
                 {
-                    surface_format = surface_formats[i];
-                    standard_found = 1;
-                    break;
+                    resized = 1;
                 }
             }
+            profile_end(PROFILE_EVENTS, t);
 
-            // if you cant, just take the first available format
-            if (standard_found != 0)
+            // rebuild the swapchain and framebuffers, the old ones live on
+            // until the frames already submitted with them are done
+            if (resized)
             {
-                surface_format = surface_formats[0];
+                SDL_Vulkan_GetDrawableSize(win, &drawable_width, &drawable_height);
+                int result = swapchain_recreate(&swapchain, drawable_width,
+                        drawable_height, frames.serial);
+                if (result == 0) { break; }
+                if (result < 0)
+                {
+                    // minimized, nothing to draw into
+                    SDL_Delay(16);
+                    continue;
+                }
+                if (!render_set_target(&renderer, swapchain.extent, swapchain.images,
+                            swapchain.image_count, frames.serial))
+                {
+                    break;
+                }
+                resized = 0;
             }
-        }
-        
-        // select a swapchain size ------------------------
-        VkExtent2D swap_extent;
 
-        if (surface_capabilities.currentExtent.width == -1)
-        {
-            swap_extent.width = MIN( 
-                    MAX(SCREEN_WIDTH, surface_capabilities.minImageExtent.width), 
-                    surface_capabilities.maxImageExtent.width);
+            t = profile_begin();
+            struct frame * frame = frames_wait(&frames);
+            profile_end(PROFILE_WAIT, t);
+            if (frame == NULL) { break; }
+            swapchain_collect(&swapchain, frames.completed);
+            render_collect(&renderer, frames.completed);
 
-            swap_extent.height = MIN( 
-                    MAX(SCREEN_HEIGHT, surface_capabilities.minImageExtent.height), 
-                    surface_capabilities.maxImageExtent.height);
-        }
+            if (!opt.gpu_sim && !sim_thread_ok(&sim)) { break; }
 
-        // select a surface transform (hopefully none)  ----
-        VkSurfaceTransformFlagBitsKHR surface_transform;
-        if (surface_capabilities.supportedTransforms & 
-                VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-        {
-            surface_transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-        } else
-        {
-            surface_transform = surface_capabilities.currentTransform;
-        }
+            uint32_t image;
+            VkResult acquired = vkAcquireNextImageKHR(device, swapchain.handle, UINT64_MAX,
+                    frame->image_available, VK_NULL_HANDLE, &image);
+            if (acquired == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                resized = 1;
+                continue;
+            }
+            if (acquired < VK_SUCCESS) { break; }
+
+            // only now is the frame sure to be submitted
+            if (!frames_record(frame)) { break; }
+            VkCommandBuffer command_buffer = frame->command_buffer;
+            int slot = frames.current;
+            gpu_timer_begin_frame(&timer, command_buffer, slot, frame_number);
+
+            // the wind follows the step on screen: the gpu flock takes one
+            // a frame, the cpu one whatever the thread last published
+            uint32_t step = frame_number;
+            const struct sim_frame * latest = NULL;
+            float alpha = 0.0f;
+            if (!opt.gpu_sim)
+            {
+                latest = sim_thread_latest(&sim, &alpha);
+                step = (uint32_t) latest->step;
+            }
+            if (!record_wind(&noise, &timer, command_buffer, slot, step)) { break; }
+            if (opt.gpu_sim)
+            {
+                // the step's output is the draw's instance buffer
+                t = profile_begin();
+                gpu_timer_begin(&timer, command_buffer, slot, PROFILE_GPU_SIMULATE);
+                gpu_flock_record(&flock, command_buffer, &params, SIM_DT);
+                gpu_timer_end(&timer, command_buffer, slot, PROFILE_GPU_SIMULATE);
+                record_draw(&renderer, &cull, &timer, command_buffer, slot, image,
+                        RENDER_GPU_STATE, gpu_flock_state(&flock), 0, opt.boid_count);
+                profile_end(PROFILE_RECORD, t);
+            }
+            else
+            {
+                // this frame's slice is free, its fence was waited on above
+                t = profile_begin();
+                VkDeviceSize offset;
+                upload_ring_begin(&ring, slot);
+                struct Instance * instances = upload_ring_alloc(&ring,
+                        sizeof(struct Instance) * opt.boid_count, sizeof(struct Instance), &offset);
+                if (instances == NULL) { break; }
+                // the newest step, blended in from the one before
+                render_pack_lerp(instances, &latest->prev, &latest->state,
+                        opt.boid_count, alpha, &params);
+                upload_ring_end(&ring);
+                profile_end(PROFILE_UPLOAD, t);
+
+                t = profile_begin();
+                record_draw(&renderer, &cull, &timer, command_buffer, slot, image,
+                        RENDER_INSTANCES, ring.buffer, offset, opt.boid_count);
+                profile_end(PROFILE_RECORD, t);
+            }
 
-        // select a presentation mode (prefer mailbox -> triple buffered?)
-        VkPresentModeKHR present_mode;
-        int mailbox = 0;
-        for(int i = 0; i < present_mode_count; i++)
-        {
-            if (present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+            t = profile_begin();
+            int submitted = frames_submit(&frames, queue, frame, 1) == VK_SUCCESS;
+            profile_end(PROFILE_SUBMIT, t);
+            if (!submitted) { break; }
+
+            VkPresentInfoKHR present_info = {0};
+            present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            present_info.waitSemaphoreCount = 1;
+            present_info.pWaitSemaphores = &frame->render_finished;
+            present_info.swapchainCount = 1;
+            present_info.pSwapchains = &swapchain.handle;
+            present_info.pImageIndices = &image;
+            t = profile_begin();
+            VkResult presented = vkQueuePresentKHR(queue, &present_info);
+            profile_end(PROFILE_PRESENT, t);
+            log_first_frame("startup");
+            if (presented == VK_ERROR_OUT_OF_DATE_KHR || presented == VK_SUBOPTIMAL_KHR)
             {
-                present_mode = present_modes[i];
-                mailbox = 1;
+                resized = 1;
+            }
+            else if (presented != VK_SUCCESS)
+            {
+                break;
             }
-        }
-        if (mailbox == 0)
-        {
-            present_mode = VK_PRESENT_MODE_FIFO_KHR;
         }
 
-        // actually create swapchain with given specifications ---------
-
-        VkSwapchainCreateInfoKHR swapchain_info;
-        swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-        swapchain_info.surface = vk_surf;
-        swapchain_info.minImageCount = image_count;
-        swapchain_info.imageFormat = surface_format.format;
-        swapchain_info.imageColorSpace = surface_format.colorSpace;
-		swapchain_info.imageExtent = swap_extent;
-		swapchain_info.imageArrayLayers = 1;
-		swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-		swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		swapchain_info.queueFamilyIndexCount = 0;
-		swapchain_info.pQueueFamilyIndices = NULL;
-		swapchain_info.preTransform = surface_transform;
-		swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-		swapchain_info.presentMode = present_mode;
-		swapchain_info.clipped = VK_TRUE;
-		swapchain_info.oldSwapchain = VK_NULL_HANDLE; // ?
-
-        if ( vkCreateSwapchainKHR(
-                    device, 
-                    &swapchain_info,
-                    NULL,
-                    &swapchain ) != VK_SUCCESS )
+        double loop_ms = now_ms() - loop_start;
+        if (!opt.gpu_sim)
         {
-            die(win, 0);
+            if (ok) { print_sim(&sim, loop_ms); }
+            sim_thread_stop(&sim);
+            pool_destroy(sim_pool);
         }
-
-        // get swapchain image count, then set the image count  --------------
-        uint32_t actual_image_count = 0;
-        // get number
-        if( vkGetSwapchainImagesKHR(
-                    device, 
-                    swapchain,
-                    &actual_image_count,
-                    swapchain_images) != VK_SUCCESS ||
-            actual_image_count == 0)
+        if (frames.stats.frames > 0)
         {
-            die(win, 0);
+            printf("frames: %lu in flight %d, %.3f ms/frame, %lu waits on the gpu (%.3f ms/wait)\n",
+                    (unsigned long) frames.stats.frames, frames.count,
+                    loop_ms / frames.stats.frames, (unsigned long) frames.stats.waits,
+                    frames.stats.waits > 0 ? frames.stats.wait_ms / frames.stats.waits : 0.0);
         }
 
-        // proceed with creating actual_image_count swapchain images
-        swapchain_images = malloc( actual_image_count * sizeof(VkImage) );
-        if( vkGetSwapchainImagesKHR(
-                    device, 
-                    swapchain,
-                    &actual_image_count,
-                    swapchain_images) != VK_SUCCESS )
+        vkDeviceWaitIdle(device);
+        gpu_timer_flush(&timer);
+        cull_flush(&cull);
+
+        if (!opt.gpu_sim)
         {
-            die(win, 0);
+            // a slice is only rewritten after its frame's fence, so every
+            // wait on the gpu was a ring wrap
+            printf("upload: %lu frames, %lu bytes/frame (peak %lu), %lu ring-wrap waits\n",
+                    (unsigned long) ring.stats.frames,
+                    (unsigned long) ring.stats.frame_bytes,
+                    (unsigned long) ring.stats.peak_frame_bytes,
+                    (unsigned long) frames.stats.waits);
         }
-
-        // swapchain complete!
-
-        // create vertex buffer ----------------------------------------------
-        
-        // placeholder triangle vertices
-
-
-        // create uniform buffer ---------------------------------------------
-
-
-
-
-
-                    
-
-		// allocate memory
-        //const VkDeviceSize memory_size;
-        //for (uint32_t k = 0; k & lt;
-
-
-		// make in/out buffers out of memory
-                
-		// command buffer
-		// shaders??
-		// compile shaders
-
-		// free loop's resources
-        free(queue_family_properties);
-
-        SDL_Delay(3000);
+        print_wind(&noise, frames.stats.frames);
+        print_cull(&cull);
+        print_memory(&allocator);
+        finish_profile(&opt);
+        gpu_timer_destroy(&timer);
+        cull_destroy(&cull);
+        frames_destroy(&frames);
+        render_destroy(&renderer);
+        noise_texture_destroy(&noise);
+        swapchain_destroy(&swapchain);
+        upload_ring_destroy(&ring);
+        gpu_flock_destroy(&flock);
+        vkDestroySurfaceKHR(instance, vk_surf, NULL);
+        destroy_device(device, command_pool, &pipeline_cache, &allocator);
+        status = ok ? 0 : 1;
+        break;
     }
 
-	// free resources
+	// free resources, whichever way the loop was left. no usable device
+    // means the preload was never joined, and a wind prefill only goes to
+    // the texture once a mode has used it
 	free(physical_devices);
-    //vkDestroyDevice(device);
-
-    return die(win, 0);
+    free(extension_names);
+    startup_join(&startup);
+    shader_preload_free();
+    noise_prefill_destroy(&startup.wind);
+    boids_destroy(startup.boids);
+    vkDestroyInstance(instance, &host.callbacks);
+    host_arena_destroy(&host);
+
+    return die(win, status);
 }
 
 
@@ -0,0 +1,346 @@
+/*
+   noise_cache.c
+   chunked tile cache for noise fields much larger than the window
+
+   tiles live in one preallocated block. a chained hash table maps
+   (chunk, seed, fractal config) keys to slots and an intrusive doubly
+   linked list keeps the slots in recency order, all as flat index arrays
+   so nothing is allocated after creation
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "noise_cache.h"
+
+#define NONE -1
+
+struct slot
+{
+    struct noise_tile_key key;
+    int chain;              // next slot in the same hash bucket
+    int prev, next;         // lru list, head is the most recent
+};
+
+struct noise_cache
+{
+    int tile;
+    int capacity;
+    int count;
+
+    uint8_t * data;         // capacity tiles of tile * tile bytes
+    struct slot * slots;
+    int * buckets;          // power of two count, holds slot indices
+    unsigned bucket_mask;
+
+    int head, tail;         // lru ends
+    int free_slot;          // next never used slot
+
+    struct noise_cache_stats stats;
+};
+
+// floor division so negative pixels land in negative chunks
+static int floor_div(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static void make_key(struct noise_tile_key * key, const perlin_ctx * ctx,
+        const struct fractal * f, int chunk_y, int chunk_x)
+{
+    memset(key, 0, sizeof(struct noise_tile_key));
+    key->chunk_y = chunk_y;
+    key->chunk_x = chunk_x;
+    key->seed = ctx->seed;
+    if (f != NULL)
+    {
+        key->mode = f->mode;
+        key->octaves = f->octaves;
+        key->lacunarity = f->lacunarity;
+        key->gain = f->gain;
+    }
+}
+
+static int key_equal(const struct noise_tile_key * a, const struct noise_tile_key * b)
+{
+    return memcmp(a, b, sizeof(struct noise_tile_key)) == 0;
+}
+
+// fnv-1a over the key's bytes, keys are zeroed so padding is stable
+static unsigned key_hash(const struct noise_tile_key * key)
+{
+    const uint8_t * bytes = (const uint8_t *) key;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(struct noise_tile_key); i++)
+    {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// lru list -------------------------------------------------------------------
+
+static void lru_unlink(struct noise_cache * cache, int i)
+{
+    struct slot * s = &cache->slots[i];
+    if (s->prev != NONE) { cache->slots[s->prev].next = s->next; }
+    else { cache->head = s->next; }
+    if (s->next != NONE) { cache->slots[s->next].prev = s->prev; }
+    else { cache->tail = s->prev; }
+}
+
+static void lru_push_front(struct noise_cache * cache, int i)
+{
+    struct slot * s = &cache->slots[i];
+    s->prev = NONE;
+    s->next = cache->head;
+    if (cache->head != NONE) { cache->slots[cache->head].prev = i; }
+    cache->head = i;
+    if (cache->tail == NONE) { cache->tail = i; }
+}
+
+// hash table -----------------------------------------------------------------
+
+static int table_find(struct noise_cache * cache, const struct noise_tile_key * key)
+{
+    int i = cache->buckets[key_hash(key) & cache->bucket_mask];
+    while (i != NONE && !key_equal(&cache->slots[i].key, key))
+    {
+        i = cache->slots[i].chain;
+    }
+    return i;
+}
+
+static void table_remove(struct noise_cache * cache, int i)
+{
+    int * link = &cache->buckets[key_hash(&cache->slots[i].key) & cache->bucket_mask];
+    while (*link != i) { link = &cache->slots[*link].chain; }
+    *link = cache->slots[i].chain;
+}
+
+static void table_insert(struct noise_cache * cache, int i)
+{
+    int * bucket = &cache->buckets[key_hash(&cache->slots[i].key) & cache->bucket_mask];
+    cache->slots[i].chain = *bucket;
+    *bucket = i;
+}
+
+// tiles ----------------------------------------------------------------------
+
+static uint8_t * slot_data(const struct noise_cache * cache, int i)
+{
+    return cache->data + (size_t) i * cache->tile * cache->tile;
+}
+
+// grab a slot for key, evicting the least recently used tile if full
+static int slot_claim(struct noise_cache * cache, const struct noise_tile_key * key)
+{
+    int i;
+    if (cache->free_slot < cache->capacity)
+    {
+        i = cache->free_slot++;
+        cache->count++;
+    }
+    else
+    {
+        i = cache->tail;
+        lru_unlink(cache, i);
+        table_remove(cache, i);
+        cache->stats.evictions++;
+    }
+
+    cache->slots[i].key = *key;
+    table_insert(cache, i);
+    lru_push_front(cache, i);
+    return i;
+}
+
+static void generate(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int i)
+{
+    const struct noise_tile_key * key = &cache->slots[i].key;
+    int t = cache->tile;
+
+    if (f == NULL)
+    {
+        perlin_fill_grid(ctx, slot_data(cache, i), t, t,
+                key->chunk_y * t, key->chunk_x * t, t);
+    }
+    else
+    {
+        fractal_fill_grid(ctx, f, slot_data(cache, i), t, t,
+                key->chunk_y * t, key->chunk_x * t, t);
+    }
+}
+
+// slot holding the tile, generating it if needed. counts a hit or a miss
+// unless prefetching, when only generated tiles are counted
+static int lookup(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int chunk_y, int chunk_x, int prefetch)
+{
+    struct noise_tile_key key;
+    make_key(&key, ctx, f, chunk_y, chunk_x);
+
+    int i = table_find(cache, &key);
+    if (i != NONE)
+    {
+        if (!prefetch)
+        {
+            cache->stats.hits++;
+            lru_unlink(cache, i);
+            lru_push_front(cache, i);
+        }
+        return i;
+    }
+
+    if (prefetch) { cache->stats.prefetches++; }
+    else { cache->stats.misses++; }
+
+    i = slot_claim(cache, &key);
+    generate(cache, ctx, f, i);
+    return i;
+}
+
+// public api -----------------------------------------------------------------
+
+struct noise_cache * noise_cache_create(size_t budget, int tile)
+{
+    if (tile <= 0) { tile = NOISE_CACHE_TILE; }
+
+    size_t tile_bytes = (size_t) tile * tile;
+    int capacity = budget / tile_bytes > 0 ? (int) (budget / tile_bytes) : 1;
+
+    unsigned buckets = 1;
+    while (buckets < (unsigned) capacity * 2) { buckets <<= 1; }
+
+    struct noise_cache * cache = calloc(1, sizeof(struct noise_cache));
+    if (cache == NULL) { return NULL; }
+
+    cache->tile = tile;
+    cache->capacity = capacity;
+    cache->data = malloc(tile_bytes * capacity);
+    cache->slots = calloc(capacity, sizeof(struct slot));
+    cache->buckets = malloc(sizeof(int) * buckets);
+    cache->bucket_mask = buckets - 1;
+
+    if (cache->data == NULL || cache->slots == NULL || cache->buckets == NULL)
+    {
+        printf("Error: couldnt allocate %zu byte noise cache\n", tile_bytes * capacity);
+        noise_cache_destroy(cache);
+        return NULL;
+    }
+
+    for (unsigned b = 0; b < buckets; b++) { cache->buckets[b] = NONE; }
+    cache->head = cache->tail = NONE;
+
+    return cache;
+}
+
+void noise_cache_destroy(struct noise_cache * cache)
+{
+    if (cache == NULL) { return; }
+    free(cache->buckets);
+    free(cache->slots);
+    free(cache->data);
+    free(cache);
+}
+
+int noise_cache_tile(const struct noise_cache * cache)
+{
+    return cache->tile;
+}
+
+const uint8_t * noise_cache_get(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int chunk_y, int chunk_x)
+{
+    return slot_data(cache, lookup(cache, ctx, f, chunk_y, chunk_x, 0));
+}
+
+void noise_cache_read(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, int stride)
+{
+    if (width <= 0 || height <= 0) { return; }
+
+    int t = cache->tile;
+    int cy0 = floor_div(origin_y, t), cy1 = floor_div(origin_y + height - 1, t);
+    int cx0 = floor_div(origin_x, t), cx1 = floor_div(origin_x + width - 1, t);
+
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        // rows of this chunk inside the window, in pixel coordinates
+        int y0 = cy * t > origin_y ? cy * t : origin_y;
+        int y1 = (cy + 1) * t < origin_y + height ? (cy + 1) * t : origin_y + height;
+
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            int x0 = cx * t > origin_x ? cx * t : origin_x;
+            int x1 = (cx + 1) * t < origin_x + width ? (cx + 1) * t : origin_x + width;
+
+            const uint8_t * src = noise_cache_get(cache, ctx, f, cy, cx);
+            for (int y = y0; y < y1; y++)
+            {
+                memcpy(out + (size_t) (y - origin_y) * stride + (x0 - origin_x),
+                       src + (size_t) (y - cy * t) * t + (x0 - cx * t),
+                       x1 - x0);
+            }
+        }
+    }
+}
+
+void noise_cache_prefetch(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int width, int height, int origin_y,
+        int origin_x, int dy, int dx)
+{
+    if (width <= 0 || height <= 0) { return; }
+
+    int t = cache->tile;
+    int y = origin_y + dy;
+    int x = origin_x + dx;
+    int cy0 = floor_div(y, t), cy1 = floor_div(y + height - 1, t);
+    int cx0 = floor_div(x, t), cx1 = floor_div(x + width - 1, t);
+
+    for (int cy = cy0; cy <= cy1; cy++)
+    {
+        for (int cx = cx0; cx <= cx1; cx++)
+        {
+            lookup(cache, ctx, f, cy, cx, 1);
+        }
+    }
+}
+
+void noise_cache_each(const struct noise_cache * cache,
+        void (*fn)(void * arg, const struct noise_tile_key * key, const uint8_t * tile),
+        void * arg)
+{
+    for (int i = cache->tail; i != NONE; i = cache->slots[i].prev)
+    {
+        fn(arg, &cache->slots[i].key, slot_data(cache, i));
+    }
+}
+
+void noise_cache_put(struct noise_cache * cache, const struct noise_tile_key * key,
+        const uint8_t * tile)
+{
+    int i = table_find(cache, key);
+    if (i != NONE)
+    {
+        lru_unlink(cache, i);
+        lru_push_front(cache, i);
+    }
+    else
+    {
+        i = slot_claim(cache, key);
+    }
+    memcpy(slot_data(cache, i), tile, (size_t) cache->tile * cache->tile);
+}
+
+void noise_cache_get_stats(const struct noise_cache * cache,
+        struct noise_cache_stats * stats)
+{
+    *stats = cache->stats;
+    stats->tiles = cache->count;
+    stats->capacity = cache->capacity;
+    stats->bytes = (size_t) cache->capacity * cache->tile * cache->tile;
+}
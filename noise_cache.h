@@ -0,0 +1,86 @@
+/*
+   noise_cache.h
+   chunked tile cache for noise fields much larger than the window
+*/
+
+#ifndef NOISE_CACHE
+#define NOISE_CACHE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fractal.h"
+#include "perlin.h"
+
+// default tile edge in pixels, 64x64 bytes = 4KB per tile
+#define NOISE_CACHE_TILE 64
+
+// counters for sizing the cache
+struct noise_cache_stats
+{
+    uint64_t hits;          // lookups served from the cache
+    uint64_t misses;        // lookups that had to generate their tile
+    uint64_t prefetches;    // tiles generated ahead of time
+    uint64_t evictions;     // tiles dropped to stay within budget
+    int tiles;              // tiles currently held
+    int capacity;           // tiles the budget allows
+    size_t bytes;           // memory held by tile data
+};
+
+// what a cached tile was generated from, fractal fields are 0 for plain
+// perlin(). zero the whole key before filling it, it is hashed as bytes
+struct noise_tile_key
+{
+    int chunk_y, chunk_x;
+    uint32_t seed;
+    int mode;
+    int octaves;            // 0 for plain perlin()
+    float lacunarity, gain;
+};
+
+struct noise_cache;
+
+// create a cache holding as many tile x tile byte tiles as fit in budget
+// bytes (at least one). tile <= 0 uses NOISE_CACHE_TILE. all memory is
+// allocated up front, least recently used tiles are evicted when full
+struct noise_cache * noise_cache_create(size_t budget, int tile);
+
+void noise_cache_destroy(struct noise_cache * cache);
+
+// tile edge in pixels
+int noise_cache_tile(const struct noise_cache * cache);
+
+// tile at chunk (chunk_y, chunk_x) of the field given by ctx's seed and f,
+// or plain perlin() if f is NULL. generated on a miss. the pointer is
+// tile x tile bytes, row major, and valid until the next call on the cache
+const uint8_t * noise_cache_get(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int chunk_y, int chunk_x);
+
+// copy a width x height window at pixel origin_y, origin_x through the
+// cache into out, whose rows are stride bytes apart
+void noise_cache_read(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, int stride);
+
+// generate the tiles a width x height window at origin_y, origin_x will
+// need once it has moved by dy, dx pixels, so panning finds them ready
+void noise_cache_prefetch(struct noise_cache * cache, const perlin_ctx * ctx,
+        const struct fractal * f, int width, int height, int origin_y,
+        int origin_x, int dy, int dx);
+
+// call fn for every tile held, least recently used first, so putting them
+// back in that order into another cache restores the recency too
+void noise_cache_each(const struct noise_cache * cache,
+        void (*fn)(void * arg, const struct noise_tile_key * key, const uint8_t * tile),
+        void * arg);
+
+// store a tile generated elsewhere (ie loaded from a snapshot) under key,
+// tile x tile bytes row major, evicting as a miss would. counts nothing
+void noise_cache_put(struct noise_cache * cache, const struct noise_tile_key * key,
+        const uint8_t * tile);
+
+void noise_cache_get_stats(const struct noise_cache * cache,
+        struct noise_cache_stats * stats);
+
+
+#endif
@@ -0,0 +1,292 @@
+/*
+   noise_texture.c
+   perlin wind field in a toroidally addressed gpu texture, updated by scrolling
+
+   the texture is a size x size window onto the endless field, addressed
+   modulo size in both directions. when the window moves by dy, dx only the
+   dy rows and dx columns it uncovers are generated, into this frame's
+   staging slice, and copied over the texels that went out of view. a band
+   that crosses the wrap becomes up to four copy regions, all recorded in
+   one vkCmdCopyBufferToImage, so a frame costs at most one pair of
+   barriers and one copy however it scrolled. the first window can be
+   generated ahead of time, see noise_prefill_create
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "noise_texture.h"
+
+// two bands of at most four regions each
+#define MAX_REGIONS 8
+
+static int create_image(struct noise_texture * t)
+{
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = NOISE_TEXTURE_FORMAT;
+    image_info.extent = (VkExtent3D) { (uint32_t) t->size, (uint32_t) t->size, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(t->device, &image_info, t->host, &t->image) != VK_SUCCESS)
+    {
+        t->image = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    if (!gpu_bind_image(t->allocator, t->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                &t->memory))
+    {
+        return 0;
+    }
+
+    VkImageViewCreateInfo view_info = {0};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = t->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = NOISE_TEXTURE_FORMAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    if (vkCreateImageView(t->device, &view_info, t->host, &t->view) != VK_SUCCESS)
+    {
+        t->view = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    // repeat is what makes the wrapped window read as one piece
+    VkSamplerCreateInfo sampler_info = {0};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    if (vkCreateSampler(t->device, &sampler_info, t->host, &t->sampler) != VK_SUCCESS)
+    {
+        t->sampler = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+int noise_texture_create(struct noise_texture * t, struct gpu_allocator * allocator,
+        VkDevice device, uint32_t seed, int size, int frames)
+{
+    memset(t, 0, sizeof(struct noise_texture));
+    t->allocator = allocator;
+    t->device = device;
+    t->host = allocator->host;
+    t->size = size > 0 ? size : NOISE_TEXTURE_SIZE;
+    perlin_ctx_init(&t->ctx, seed);
+
+    if ((t->size & (t->size - 1)) != 0)
+    {
+        printf("Error: noise texture size %d is not a power of two\n", t->size);
+        return 0;
+    }
+
+    // a frame uploads at most the whole window, plus alignment of two bands
+    VkDeviceSize slice = (VkDeviceSize) t->size * t->size + 8;
+    if (!create_image(t) ||
+        !upload_ring_create(&t->staging, allocator, slice, frames,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT))
+    {
+        printf("Error: couldnt create %dx%d noise texture\n", t->size, t->size);
+        noise_texture_destroy(t);
+        return 0;
+    }
+
+    return 1;
+}
+
+void noise_texture_destroy(struct noise_texture * t)
+{
+    if (t->device == VK_NULL_HANDLE) { return; }
+
+    noise_prefill_destroy(&t->prefill);
+    upload_ring_destroy(&t->staging);
+    if (t->sampler != VK_NULL_HANDLE) { vkDestroySampler(t->device, t->sampler, t->host); }
+    if (t->view != VK_NULL_HANDLE) { vkDestroyImageView(t->device, t->view, t->host); }
+    if (t->image != VK_NULL_HANDLE) { vkDestroyImage(t->device, t->image, t->host); }
+    gpu_free(t->allocator, &t->memory);
+
+    memset(t, 0, sizeof(struct noise_texture));
+}
+
+int noise_prefill_create(struct noise_prefill * p, uint32_t seed, int size, float y, float x)
+{
+    memset(p, 0, sizeof(struct noise_prefill));
+    p->seed = seed;
+    p->size = size > 0 ? size : NOISE_TEXTURE_SIZE;
+    p->origin_y = (int) floorf(y);
+    p->origin_x = (int) floorf(x);
+
+    p->texels = malloc((size_t) p->size * p->size);
+    if (p->texels == NULL)
+    {
+        printf("Error: couldnt allocate %dx%d noise window\n", p->size, p->size);
+        return 0;
+    }
+
+    perlin_ctx ctx;
+    perlin_ctx_init(&ctx, seed);
+    perlin_fill_grid(&ctx, p->texels, p->size, p->size, p->origin_y, p->origin_x, p->size);
+    return 1;
+}
+
+void noise_prefill_destroy(struct noise_prefill * p)
+{
+    free(p->texels);
+    memset(p, 0, sizeof(struct noise_prefill));
+}
+
+void noise_texture_use_prefill(struct noise_texture * t, struct noise_prefill * p)
+{
+    noise_prefill_destroy(&t->prefill);
+    t->prefill = *p;
+    memset(p, 0, sizeof(struct noise_prefill));
+}
+
+// generate the h x w field pixels at y, x into staging and add the regions
+// that copy them to their wrapped texels. 0 if the slice is full
+static int stage_band(struct noise_texture * t, int y, int x, int h, int w,
+        VkBufferImageCopy * regions, int * region_count)
+{
+    if (h <= 0 || w <= 0) { return 1; }
+
+    VkDeviceSize offset;
+    uint8_t * band = upload_ring_alloc(&t->staging, (VkDeviceSize) h * w, 4, &offset);
+    if (band == NULL) { return 0; }
+
+    // the whole window, maybe generated already
+    const struct noise_prefill * p = &t->prefill;
+    if (p->texels != NULL && p->seed == t->ctx.seed && p->size == t->size &&
+        h == t->size && w == t->size && y == p->origin_y && x == p->origin_x)
+    {
+        memcpy(band, p->texels, (size_t) h * w);
+    }
+    else
+    {
+        perlin_fill_grid(&t->ctx, band, w, h, y, x, w);
+    }
+
+    // split where the band crosses the texture's edge
+    int mask = t->size - 1;
+    int ty = y & mask, tx = x & mask;
+    int rows[2] = { h < t->size - ty ? h : t->size - ty, 0 };
+    int cols[2] = { w < t->size - tx ? w : t->size - tx, 0 };
+    rows[1] = h - rows[0];
+    cols[1] = w - cols[0];
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            if (rows[i] == 0 || cols[j] == 0) { continue; }
+
+            int band_y = i == 0 ? 0 : rows[0];
+            int band_x = j == 0 ? 0 : cols[0];
+            VkBufferImageCopy * r = &regions[(*region_count)++];
+            memset(r, 0, sizeof(VkBufferImageCopy));
+            r->bufferOffset = offset + (VkDeviceSize) band_y * w + band_x;
+            r->bufferRowLength = (uint32_t) w;
+            r->bufferImageHeight = (uint32_t) h;
+            r->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            r->imageSubresource.layerCount = 1;
+            r->imageOffset = (VkOffset3D) { j == 0 ? tx : 0, i == 0 ? ty : 0, 0 };
+            r->imageExtent = (VkExtent3D) { (uint32_t) cols[j], (uint32_t) rows[i], 1 };
+        }
+    }
+
+    t->stats.texels += (uint64_t) h * w;
+    return 1;
+}
+
+int noise_texture_scroll(struct noise_texture * t, VkCommandBuffer command_buffer,
+        int slot, float y, float x)
+{
+    int size = t->size;
+    int origin_y = (int) floorf(y), origin_x = (int) floorf(x);
+    int dy = origin_y - t->origin_y, dx = origin_x - t->origin_x;
+    t->scroll_y = y;
+    t->scroll_x = x;
+
+    VkBufferImageCopy regions[MAX_REGIONS];
+    int region_count = 0;
+    uint64_t texels = t->stats.texels;
+    int full = !t->valid || abs(dy) >= size || abs(dx) >= size;
+    int ok = 1;
+
+    upload_ring_begin(&t->staging, slot);
+    if (full)
+    {
+        ok = stage_band(t, origin_y, origin_x, size, size, regions, &region_count);
+    }
+    else
+    {
+        // rows uncovered at the top or bottom, across the new window
+        int row_y = dy > 0 ? t->origin_y + size : origin_y;
+        ok = stage_band(t, row_y, origin_x, abs(dy), size, regions, &region_count);
+
+        // columns uncovered at a side, over the rows both windows share
+        int kept_y = dy > 0 ? origin_y : t->origin_y;
+        int col_x = dx > 0 ? t->origin_x + size : origin_x;
+        ok = ok && stage_band(t, kept_y, col_x, size - abs(dy), abs(dx),
+                regions, &region_count);
+    }
+    upload_ring_end(&t->staging);
+    noise_prefill_destroy(&t->prefill);
+
+    if (!ok)
+    {
+        t->stats.texels = texels;
+        return -1;
+    }
+    t->origin_y = origin_y;
+    t->origin_x = origin_x;
+    if (region_count == 0) { return 0; }
+
+    // the draws of earlier frames are done reading before the copy writes,
+    // and the copy is done before this frame's draw samples
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = t->valid ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = t->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    vkCmdPipelineBarrier(command_buffer,
+            t->valid ? VK_PIPELINE_STAGE_VERTEX_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    vkCmdCopyBufferToImage(command_buffer, t->staging.buffer, t->image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t) region_count, regions);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    t->valid = 1;
+    t->stats.updates++;
+    t->stats.full += full;
+    t->stats.regions += region_count;
+    return (int) (t->stats.texels - texels);
+}
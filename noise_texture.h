@@ -0,0 +1,96 @@
+/*
+   noise_texture.h
+   perlin wind field in a toroidally addressed gpu texture, updated by scrolling
+*/
+
+#ifndef NOISE_TEXTURE
+#define NOISE_TEXTURE
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#include "gpu_alloc.h"
+#include "perlin.h"
+#include "upload_ring.h"
+
+// default edge in texels, a power of two. 256x256 R8 is 64KB
+#define NOISE_TEXTURE_SIZE 256
+#define NOISE_TEXTURE_FORMAT VK_FORMAT_R8_UNORM
+
+struct noise_texture_stats
+{
+    uint64_t updates;           // frames that uploaded anything
+    uint64_t full;              // of them, whole texture refreshes
+    uint64_t regions;           // copy regions recorded
+    uint64_t texels;            // texels generated and uploaded
+};
+
+// the first window of a texture, generated ahead of time on any thread,
+// before the texture or even the device exists
+struct noise_prefill
+{
+    uint8_t * texels;           // size x size, NULL once used
+    uint32_t seed;
+    int size;
+    int origin_y, origin_x;
+};
+
+// a size x size window of the infinite perlin() field. field pixel y, x
+// lives at texel y & (size - 1), x & (size - 1), so moving the window only
+// replaces the rows and columns it uncovers and a repeating sampler reads
+// the window straight through the wrap
+struct noise_texture
+{
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // the allocator's, for every object
+    perlin_ctx ctx;
+    int size;
+
+    VkImage image;
+    struct gpu_allocation memory;
+    VkImageView view;
+    VkSampler sampler;          // linear, repeat
+
+    // generated rows and columns, one slice per frame in flight
+    struct upload_ring staging;
+
+    int valid;                  // the texture holds the window below
+    int origin_y, origin_x;     // field pixel at the window's corner
+    float scroll_y, scroll_x;   // scroll position of the last update
+
+    struct noise_prefill prefill;   // see noise_texture_use_prefill
+
+    struct noise_texture_stats stats;
+};
+
+// texture of size (0 for NOISE_TEXTURE_SIZE) texels square of the field of
+// seed, staged through frames slices. returns 0 on failure, after cleaning up
+int noise_texture_create(struct noise_texture * t, struct gpu_allocator * allocator,
+        VkDevice device, uint32_t seed, int size, int frames);
+
+// the gpu must be done with the texture
+void noise_texture_destroy(struct noise_texture * t);
+
+// generate the window of the field of seed that noise_texture_scroll to
+// y, x uploads first, size as for noise_texture_create. returns 0 if out
+// of memory
+int noise_prefill_create(struct noise_prefill * p, uint32_t seed, int size, float y, float x);
+
+void noise_prefill_destroy(struct noise_prefill * p);
+
+// hand p over to t, its texels replace generating the first full window
+// when seed, size and position match. t frees them after the first scroll
+void noise_texture_use_prefill(struct noise_texture * t, struct noise_prefill * p);
+
+// move the window to field position y, x and record into command_buffer,
+// outside a render pass, the copies of whatever it uncovered. slot is the
+// frame in flight, its fence must be done. upload cost follows the distance
+// moved, a jump of a whole window or more refreshes everything. y and x
+// stay >= 0, where perlin_fill_grid agrees with perlin(). returns the
+// texels uploaded, -1 if the staging slice was full
+int noise_texture_scroll(struct noise_texture * t, VkCommandBuffer command_buffer,
+        int slot, float y, float x);
+
+
+#endif
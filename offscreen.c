@@ -0,0 +1,176 @@
+/*
+   offscreen.c
+   render targets without a window, read back for writing to disk
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "offscreen.h"
+#include "util.h"
+
+static int create_image(struct offscreen * o, int i)
+{
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = OFFSCREEN_FORMAT;
+    image_info.extent = (VkExtent3D) { o->extent.width, o->extent.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(o->device, &image_info, o->host, &o->images[i]) != VK_SUCCESS)
+    {
+        o->images[i] = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    return gpu_bind_image(o->allocator, o->images[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &o->image_memory[i]);
+}
+
+// the readback buffers are all the same size and one per frame, a pool of
+// count slots holds them
+static int create_readbacks(struct offscreen * o)
+{
+    VkBufferCreateInfo buffer_info = {0};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = 4 * (VkDeviceSize) o->extent.width * o->extent.height;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    for (int i = 0; i < o->count; i++)
+    {
+        if (vkCreateBuffer(o->device, &buffer_info, o->host, &o->readback[i]) != VK_SUCCESS)
+        {
+            o->readback[i] = VK_NULL_HANDLE;
+            return 0;
+        }
+    }
+
+    // cached memory makes the cpu reads fast, coherent saves invalidating
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(o->device, o->readback[0], &requirements);
+    VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (!gpu_pool_create(&o->readback_pool, o->allocator, requirements.size,
+                requirements.alignment, o->count, requirements.memoryTypeBits,
+                host | VK_MEMORY_PROPERTY_HOST_CACHED_BIT) &&
+        !gpu_pool_create(&o->readback_pool, o->allocator, requirements.size,
+                requirements.alignment, o->count, requirements.memoryTypeBits, host))
+    {
+        return 0;
+    }
+
+    for (int i = 0; i < o->count; i++)
+    {
+        if (!gpu_pool_alloc(&o->readback_pool, &requirements, &o->readback_memory[i]) ||
+            vkBindBufferMemory(o->device, o->readback[i], o->readback_memory[i].memory,
+                o->readback_memory[i].offset) != VK_SUCCESS)
+        {
+            return 0;
+        }
+        o->mapped[i] = o->readback_memory[i].mapped;
+    }
+    return 1;
+}
+
+int offscreen_create(struct offscreen * o, struct gpu_allocator * allocator,
+        VkDevice device, uint32_t width, uint32_t height, int count)
+{
+    memset(o, 0, sizeof(struct offscreen));
+    o->allocator = allocator;
+    o->device = device;
+    o->host = allocator->host;
+    o->extent = (VkExtent2D) { width, height };
+    o->count = count;
+
+    int ok = count >= 1 && count <= FRAMES_MAX;
+    for (int i = 0; ok && i < count; i++)
+    {
+        ok = create_image(o, i);
+    }
+    if (!ok || !create_readbacks(o))
+    {
+        printf("Error: couldnt create %ux%u offscreen target\n", width, height);
+        offscreen_destroy(o);
+        return 0;
+    }
+
+    return 1;
+}
+
+void offscreen_destroy(struct offscreen * o)
+{
+    if (o->device == VK_NULL_HANDLE) { return; }
+
+    for (int i = 0; i < o->count; i++)
+    {
+        if (o->readback[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyBuffer(o->device, o->readback[i], o->host);
+        }
+        if (o->images[i] != VK_NULL_HANDLE) { vkDestroyImage(o->device, o->images[i], o->host); }
+        gpu_free(o->allocator, &o->image_memory[i]);
+    }
+    gpu_pool_destroy(&o->readback_pool);
+
+    memset(o, 0, sizeof(struct offscreen));
+}
+
+void offscreen_record_copy(struct offscreen * o, VkCommandBuffer command_buffer, int target)
+{
+    VkBufferImageCopy region = {0};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = (VkExtent3D) { o->extent.width, o->extent.height, 1 };
+    vkCmdCopyImageToBuffer(command_buffer, o->images[target],
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, o->readback[target], 1, &region);
+
+    // make the copy visible to the host once the fence signals
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+int offscreen_write_ppm(const struct offscreen * o, int target, const char * path)
+{
+    FILE * file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return 0;
+    }
+
+    uint32_t width = o->extent.width, height = o->extent.height;
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    // rgba rows to rgb
+    uint8_t * row = malloc(3 * width);
+    const uint8_t * pixels = o->mapped[target];
+    int ok = row != NULL;
+    for (uint32_t y = 0; ok && y < height; y++)
+    {
+        const uint8_t * src = pixels + 4 * (size_t) width * y;
+        for (uint32_t x = 0; x < width; x++)
+        {
+            row[3 * x + 0] = src[4 * x + 0];
+            row[3 * x + 1] = src[4 * x + 1];
+            row[3 * x + 2] = src[4 * x + 2];
+        }
+        ok = fwrite(row, 3, width, file) == width;
+    }
+
+    free(row);
+    if (fclose(file) != 0) { ok = 0; }
+    if (!ok) { printf("Error: couldnt write %s\n", path); }
+    return ok;
+}
@@ -0,0 +1,51 @@
+/*
+   offscreen.h
+   render targets without a window, read back for writing to disk
+*/
+
+#ifndef OFFSCREEN
+#define OFFSCREEN
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#include "frames.h"
+#include "gpu_alloc.h"
+
+#define OFFSCREEN_FORMAT VK_FORMAT_R8G8B8A8_UNORM
+
+// one color image and readback buffer per frame in flight, so frames keep
+// overlapping while earlier ones are copied out
+struct offscreen
+{
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // the allocator's, for every object
+    VkExtent2D extent;
+    int count;
+
+    VkImage images[FRAMES_MAX];
+    struct gpu_allocation image_memory[FRAMES_MAX];
+    VkBuffer readback[FRAMES_MAX];
+    struct gpu_pool readback_pool;  // a slot per readback
+    struct gpu_allocation readback_memory[FRAMES_MAX];
+    uint8_t * mapped[FRAMES_MAX];   // persistently mapped readback
+};
+
+// count width x height targets. returns 0 on failure
+int offscreen_create(struct offscreen * o, struct gpu_allocator * allocator,
+        VkDevice device, uint32_t width, uint32_t height, int count);
+
+// the device must be idle
+void offscreen_destroy(struct offscreen * o);
+
+// record the copy of target into its readback buffer, after a render pass
+// that left it in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+void offscreen_record_copy(struct offscreen * o, VkCommandBuffer command_buffer, int target);
+
+// write target's readback as a binary ppm, once its frame's fence is done.
+// returns 0 on failure
+int offscreen_write_ppm(const struct offscreen * o, int target, const char * path);
+
+
+#endif
@@ -7,7 +7,8 @@
 #include <math.h>
 #include "perlin.h"
 
-int permutation [] = { 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 
+// reference permutation, used as is for seed 0 and shuffled for the others
+static const uint8_t permutation [] = { 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194, 233, 7, 225, 140, 36, 
                       103, 30, 69, 142, 8, 99, 37, 240, 21, 10, 23, 190, 6, 148, 247, 120, 234, 75, 0, 
                       26, 197, 62, 94, 252, 219, 203, 117, 35, 11, 32, 57, 177, 33, 88, 237, 149, 56, 
                       87, 174, 20, 125, 136, 171, 168, 68, 175, 74, 165, 71, 134, 139, 48, 27, 166, 
@@ -24,7 +25,7 @@ int permutation [] = { 151, 160, 137, 91, 90, 15, 131, 13, 201, 95, 96, 53, 194,
                       93, 222, 114, 67, 29, 24, 72, 243, 141, 128, 195, 78, 66, 215, 61, 156, 180 };
 
 
-vec2 gradients [] = 
+static const vec2 gradients [] = 
 {
     (vec2) {.x =  1, .y =  0 },
     (vec2) {.x =  0, .y =  1 },
@@ -36,6 +37,55 @@ vec2 gradients [] =
     (vec2) {.x =   SQRT22, .y = -SQRT22}
 };
 
+// next value of a xorshift32 generator, plenty for shuffling 256 entries
+static uint32_t xorshift32(uint32_t * state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// build a context for seed, 0 gives the reference permutation
+void perlin_ctx_init(perlin_ctx * ctx, uint32_t seed)
+{
+    ctx->seed = seed;
+
+    for (int i = 0; i < 256; i++)
+    {
+        ctx->perm[i] = permutation[i];
+    }
+
+    // fisher yates shuffle of the reference table for any other seed
+    if (seed != 0)
+    {
+        uint32_t state = seed;
+        for (int i = 255; i > 0; i--)
+        {
+            int j = xorshift32(&state) % (i + 1);
+            uint8_t tmp = ctx->perm[i];
+            ctx->perm[i] = ctx->perm[j];
+            ctx->perm[j] = tmp;
+        }
+    }
+
+    // double the table so perm[perm[x] + y] never needs wrapping
+    for (int i = 0; i < 256; i++)
+    {
+        ctx->perm[256 + i] = ctx->perm[i];
+    }
+    for (int i = 512; i < (int) sizeof(ctx->perm); i++)
+    {
+        ctx->perm[i] = 0;
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        ctx->gradients[i] = gradients[i];
+    }
+}
+
 // linear interpolation
 float lerp(float a, float b, float t)
 {
@@ -43,16 +93,16 @@ float lerp(float a, float b, float t)
 }
 
 // yields deterministic random gradient using hashtables 
-vec2 get_gradient(int y, int x)
+vec2 get_gradient(const perlin_ctx * ctx, int y, int x)
 {
-    return gradients[permutation[(permutation[x % 256] + y) % 256] % 8];
+    return ctx->gradients[ctx->perm[ctx->perm[x & 255] + (y & 255)] & 7];
 }
 
 // dot distance and gradient vectors
-float distance_dot_gradient(int y, int x, float gy, float gx)
+float distance_dot_gradient(const perlin_ctx * ctx, int y, int x, float gy, float gx)
 {
     // retrieve gradient at our coordinates
-    vec2 gradient = get_gradient(y, x);
+    vec2 gradient = get_gradient(ctx, y, x);
 
     // compute distance vector
     float dy = gy - (float) y;
@@ -64,7 +114,7 @@ float distance_dot_gradient(int y, int x, float gy, float gx)
 }
 
 // compute perlin noise at coordinates y, x
-float perlin_raw(float y, float x) 
+float perlin_raw(const perlin_ctx * ctx, float y, float x) 
 {
     // get points of the grid square
     int y1 = (int)y;
@@ -82,15 +132,15 @@ float perlin_raw(float y, float x)
     float g1, g2, i1, i2;
 
     //printf("g\n");
-    g1 = distance_dot_gradient(y1, x1, y, x); 
-    g2 = distance_dot_gradient(y2, x1, y, x); 
+    g1 = distance_dot_gradient(ctx, y1, x1, y, x); 
+    g2 = distance_dot_gradient(ctx, y2, x1, y, x); 
     i1 = lerp(g1, g2, wy);
     //printf("g1: %5f\n", g1);
     //printf("g2: %5f\n", g2);
     //printf("i1: %5f\n", i1);
 
-    g1 = distance_dot_gradient(y1, x2, y, x); 
-    g2 = distance_dot_gradient(y2, x2, y, x); 
+    g1 = distance_dot_gradient(ctx, y1, x2, y, x); 
+    g2 = distance_dot_gradient(ctx, y2, x2, y, x); 
     i2 = lerp(g1, g2, wy);
     //printf("g1: %5f\n", g1);
     //printf("g2: %5f\n", g2);
@@ -101,17 +151,136 @@ float perlin_raw(float y, float x)
     return lerp(i1, i2, wx); 
 }
 
+// clamp perlins range from +/-sqrt2/2 to 0 to 255
+static inline int quantize(float raw)
+{
+    return ((SQRT22 + raw) / 2 / SQRT22 * 255);
+}
+
 // returns perlin noise value from 0 to 255 given integer coordinates
-int perlin(int y, int x)
+int perlin(const perlin_ctx * ctx, int y, int x)
 {
-    // convert integer coordinates into suitable floats (using seed?)
+    // convert integer coordinates into suitable floats
     float yf = (y + 0.5) / 8;
     float xf = (x + 0.5) / 8;
 
     // get raw perlin noise value
-    float raw = perlin_raw(yf, xf);
-    int quantized = ((SQRT22 + raw) / 2 / SQRT22 * 255);
+    float raw = perlin_raw(ctx, yf, xf);
+    return quantize(raw);
+}
+
+// fills a width x height window of perlin() values starting at pixel
+// (origin_y, origin_x) into out, whose rows are stride bytes apart.
+// windows the lookup tables cover go through perlin_fill_lut, the rest
+// walk the lattice row by row so every pixel in a cell shares that cell's
+// four gradients, and do the same float math as perlin() so the output
+// is identical to calling it per pixel
+void perlin_fill_grid(const perlin_ctx * ctx, uint8_t * out,
+        int width, int height, int origin_y, int origin_x, int stride)
+{
+    if (origin_y >= 0 && origin_x >= 0 &&
+        origin_y <= PERLIN_LUT_LIMIT - height && origin_x <= PERLIN_LUT_LIMIT - width)
+    {
+        perlin_fill_lut(ctx, out, width, height, origin_y, origin_x, stride, 8);
+        return;
+    }
+
+    for (int row = 0; row < height; row++)
+    {
+        // everything that depends on y is shared by the whole row
+        float yf = (origin_y + row + 0.5) / 8;
+        int y1 = (int)yf;
+        int y2 = y1 + 1;
+        float wy = yf - (float) y1;
+        float dy2 = yf - (float) y2;
+
+        uint8_t * dst = out + (size_t) row * stride;
+
+        // gradients of the current cell, refetched when x crosses into a new one
+        int have_cell = 0;
+        int x1 = 0;
+        vec2 g11, g21, g12, g22;
+
+        for (int col = 0; col < width; col++)
+        {
+            float xf = (origin_x + col + 0.5) / 8;
+            int cell = (int)xf;
+
+            if (!have_cell || cell != x1)
+            {
+                x1 = cell;
+                g11 = get_gradient(ctx, y1, x1);
+                g21 = get_gradient(ctx, y2, x1);
+                g12 = get_gradient(ctx, y1, x1 + 1);
+                g22 = get_gradient(ctx, y2, x1 + 1);
+                have_cell = 1;
+            }
+
+            float wx = xf - (float) x1;
+            float dx2 = xf - (float) (x1 + 1);
+
+            // same dot products and lerps as perlin_raw(), the weights
+            // double as the distances to the cell's top left corner
+            float i1 = lerp(wy*g11.y + wx*g11.x, dy2*g21.y + wx*g21.x, wy);
+            float i2 = lerp(wy*g12.y + dx2*g12.x, dy2*g22.y + dx2*g22.x, wy);
+
+            dst[col] = (uint8_t) quantize(lerp(i1, i2, wx));
+        }
+    }
+}
+
+// one perlin_fill_tiled job, shared by every tile
+struct tiled_job
+{
+    const perlin_ctx * ctx;
+    uint8_t * out;
+    int width, height;
+    int origin_y, origin_x;
+    int stride;
+    int tile;
+    int tiles_x;
+};
+
+// fill one tile of a tiled job
+static void fill_tile(void * arg, int index)
+{
+    struct tiled_job * job = arg;
+
+    int ty = index / job->tiles_x * job->tile;
+    int tx = index % job->tiles_x * job->tile;
+    int h = job->height - ty < job->tile ? job->height - ty : job->tile;
+    int w = job->width - tx < job->tile ? job->width - tx : job->tile;
+
+    perlin_fill_grid(
+            job->ctx,
+            job->out + (size_t) ty * job->stride + tx,
+            w, h,
+            job->origin_y + ty,
+            job->origin_x + tx,
+            job->stride );
+}
+
+// perlin_fill_grid split into tiles spread over a worker pool
+void perlin_fill_tiled(const perlin_ctx * ctx, struct pool * pool,
+        uint8_t * out, int width, int height, int origin_y, int origin_x,
+        int stride, int tile)
+{
+    if (width <= 0 || height <= 0) { return; }
+    if (tile <= 0) { tile = PERLIN_TILE; }
+
+    struct tiled_job job =
+    {
+        .ctx = ctx,
+        .out = out,
+        .width = width,
+        .height = height,
+        .origin_y = origin_y,
+        .origin_x = origin_x,
+        .stride = stride,
+        .tile = tile,
+        .tiles_x = (width + tile - 1) / tile
+    };
+    int tiles_y = (height + tile - 1) / tile;
 
-    // clamp perlins range from +/-sqrt2/2 to 0 to 255
-    return quantized;
+    pool_run(pool, fill_tile, &job, job.tiles_x * tiles_y);
 }
@@ -6,14 +6,50 @@
 #define PERLIN
 
 #include <math.h>
+#include <stdint.h>
+
+#include "pool.h"
+#include "simd.h"
 
 #define SQRT22 0.707106781187f
 
+// max abs difference between perlin_raw and any perlin_raw_batch kernel. the
+// vector kernels do the same operations in the same order so they normally
+// agree exactly, this leaves room for the compiler fusing multiply-adds
+#define PERLIN_SIMD_EPSILON 1e-6f
+
+// default tile edge for perlin_fill_tiled, a 64x64 byte tile is 4KB so a
+// worker's output tile and the rows it touches stay in L1
+#define PERLIN_TILE 64
+
+// power of two cell edges perlin_fill_lut has tables for, as shifts (4 to
+// 32 pixels), and the pixel coordinate below which it is exact
+#define PERLIN_LUT_MIN_SHIFT 2
+#define PERLIN_LUT_MAX_SHIFT 5
+#define PERLIN_LUT_LIMIT (1 << 23)
+
 typedef struct 
 {
     float x, y;
 } vec2;
 
+// everything a noise field depends on. read only once built, so one context
+// can be shared by any number of threads and each field costs ~600 bytes
+typedef struct
+{
+    uint32_t seed;
+
+    // permutation doubled so perm[perm[x & 255] + (y & 255)] needs no modulo,
+    // plus zeroed padding so 4 byte vector gathers can read past the end
+    uint8_t perm[512 + 4];
+
+    vec2 gradients[8];
+} perlin_ctx;
+
+
+// build a context for seed. seed 0 is the reference permutation, the same
+// field perlin() always produced
+void perlin_ctx_init(perlin_ctx * ctx, uint32_t seed);
 
 // linear interpolation between floats
 float lerp(float a, float b, float t);
@@ -21,16 +57,49 @@ float lerp(float a, float b, float t);
 // yields deterministic random gradient vec2 using very arbitrary coefficients
 vec2 get_gradient_slow(int y, int x);
 
-vec2 get_gradient(int y, int x);
+vec2 get_gradient(const perlin_ctx * ctx, int y, int x);
 
 // dot distance and gradient vectors
-float distance_dot_gradient(int y, int x, float gy, float gx);
+float distance_dot_gradient(const perlin_ctx * ctx, int y, int x, float gy, float gx);
 
 // compute perlin noise at coordinates y, x
-float perlin_raw(float x, float y);
+float perlin_raw(const perlin_ctx * ctx, float y, float x);
 
 // compute noise from 0 to 255
-int perlin(int y, int x);
+int perlin(const perlin_ctx * ctx, int y, int x);
+
+// perlin() with cells of cell pixels instead of 8
+int perlin_cell(const perlin_ctx * ctx, int y, int x, int cell);
+
+// fill a caller-owned width x height buffer (rows stride bytes apart) with
+// perlin() values starting at pixel origin_y, origin_x
+void perlin_fill_grid(const perlin_ctx * ctx, uint8_t * out,
+        int width, int height, int origin_y, int origin_x, int stride);
+
+// perlin_fill_grid split into tile x tile squares spread over a worker pool.
+// tile <= 0 uses PERLIN_TILE. output is identical to perlin_fill_grid
+void perlin_fill_tiled(const perlin_ctx * ctx, struct pool * pool,
+        uint8_t * out, int width, int height, int origin_y, int origin_x,
+        int stride, int tile);
+
+// perlin_fill_grid with perlin_cell() values for a power of two cell from
+// 4 to 32, through per cell size tables instead of float math per pixel.
+// bit for bit the same as perlin_cell(), windows outside 0 to
+// PERLIN_LUT_LIMIT are computed per pixel. returns 0 for other cells
+int perlin_fill_lut(const perlin_ctx * ctx, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, int stride, int cell);
+
+// perlin_raw for n coordinate pairs at once using the vector kernel picked
+// for this cpu (see perlin_get_kernel)
+void perlin_raw_batch(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, int n);
+
+// kernel perlin_raw_batch dispatches to, the best supported one by default
+enum simd_level perlin_get_kernel(void);
+
+// force a kernel (ie SIMD_SCALAR in tests), clamped to what the cpu supports.
+// returns the kernel actually selected
+enum simd_level perlin_set_kernel(enum simd_level level);
 
 
 #endif
@@ -0,0 +1,184 @@
+/*
+   perlin_lut.c
+   table driven perlin fills for power of two lattice cells
+
+   with cell = 2^shift pixels, pixel y sits at (y + 0.5) / cell, so its cell
+   is y >> shift and its weight (y & (cell - 1) + 0.5) / cell, one of only
+   cell values. every distance, dot product and y lerp of perlin_raw then
+   comes from a small set, keyed by the pixel's offset in the cell and the
+   gradients of two corners. those are computed once with the very same
+   float operations perlin_raw does, so a pixel is two table loads, the x
+   lerp and quantize, and the output is bit for bit what perlin_raw gives.
+   each cell size is its own specialization with the shift a constant
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "perlin.h"
+
+#define INLINE static inline __attribute__((always_inline))
+
+// corner gradients are 8 vectors, so a column of a cell has 64 pairs
+#define PAIRS 64
+
+// tables of one cell size, indexed [fy][pair][fx] so the pixels of a cell
+// row read them contiguously
+struct lut
+{
+    const float * left;         // y lerp of the cell's left corners
+    const float * right;        // and of its right ones
+    const float * wx;           // x weight of each fx
+};
+
+// same as perlin.c, and lerp() inlined so the pixel loop vectorizes
+static inline int quantize(float raw)
+{
+    return ((SQRT22 + raw) / 2 / SQRT22 * 255);
+}
+
+INLINE float mix(float a, float b, float t)
+{
+    return (b - a) * t + a;
+}
+
+int perlin_cell(const perlin_ctx * ctx, int y, int x, int cell)
+{
+    return quantize(perlin_raw(ctx, (y + 0.5) / cell, (x + 0.5) / cell));
+}
+
+// every context has the reference gradients, so the tables are shared
+static void build(float * left, float * right, float * wxs, int cell)
+{
+    perlin_ctx ctx;
+    perlin_ctx_init(&ctx, 0);
+    const vec2 * g = ctx.gradients;
+
+    for (int fx = 0; fx < cell; fx++)
+    {
+        wxs[fx] = (float) ((fx + 0.5) / cell);
+    }
+
+    for (int fy = 0; fy < cell; fy++)
+    {
+        // the distances to the corners as perlin_raw finds them
+        float wy = (float) ((fy + 0.5) / cell);
+        float dy2 = wy - 1.0f;
+
+        for (int pair = 0; pair < PAIRS; pair++)
+        {
+            vec2 top = g[pair >> 3], bottom = g[pair & 7];
+            float * l = left + ((size_t) fy * PAIRS + pair) * cell;
+            float * r = right + ((size_t) fy * PAIRS + pair) * cell;
+
+            for (int fx = 0; fx < cell; fx++)
+            {
+                float wx = wxs[fx];
+                float dx2 = wx - 1.0f;
+                l[fx] = mix(wy*top.y + wx*top.x, dy2*bottom.y + wx*bottom.x, wy);
+                r[fx] = mix(wy*top.y + dx2*top.x, dy2*bottom.y + dx2*bottom.x, wy);
+            }
+        }
+    }
+}
+
+// gradient index of lattice point y, x, see get_gradient
+INLINE int gradient_index(const perlin_ctx * ctx, int y, int x)
+{
+    return ctx->perm[ctx->perm[x & 255] + (y & 255)] & 7;
+}
+
+// the fill, shift is a constant in each specialization
+INLINE void fill(const perlin_ctx * ctx, const struct lut * t, uint8_t * out,
+        int width, int height, int origin_y, int origin_x, int stride, const int shift)
+{
+    const int cell = 1 << shift;
+    const int mask = cell - 1;
+
+    for (int row = 0; row < height; row++)
+    {
+        int y = origin_y + row;
+        int y1 = y >> shift;
+        size_t fy = (size_t) (y & mask) * PAIRS;
+        uint8_t * dst = out + (size_t) row * stride;
+
+        // the right corners of one cell are the left ones of the next
+        int x = origin_x;
+        int x1 = x >> shift;
+        int left = gradient_index(ctx, y1, x1) * 8 + gradient_index(ctx, y1 + 1, x1);
+
+        for (int col = 0; col < width; )
+        {
+            int right = gradient_index(ctx, y1, x1 + 1) * 8 + gradient_index(ctx, y1 + 1, x1 + 1);
+            const float * l = t->left + (fy + left) * cell;
+            const float * r = t->right + (fy + right) * cell;
+
+            int fx = x & mask;
+            int n = cell - fx < width - col ? cell - fx : width - col;
+            for (int i = 0; i < n; i++)
+            {
+                dst[col + i] = (uint8_t) quantize(mix(l[fx + i], r[fx + i], t->wx[fx + i]));
+            }
+
+            col += n;
+            x += n;
+            x1++;
+            left = right;
+        }
+    }
+}
+
+typedef void (*fill_fn)(const perlin_ctx *, uint8_t *, int, int, int, int, int);
+
+#define SPECIALIZE(SHIFT)                                                       \
+    static float left_##SHIFT[(1 << SHIFT) * PAIRS * (1 << SHIFT)];             \
+    static float right_##SHIFT[(1 << SHIFT) * PAIRS * (1 << SHIFT)];            \
+    static float wx_##SHIFT[1 << SHIFT];                                        \
+    static pthread_once_t once_##SHIFT = PTHREAD_ONCE_INIT;                     \
+    static void build_##SHIFT(void)                                             \
+    { build(left_##SHIFT, right_##SHIFT, wx_##SHIFT, 1 << SHIFT); }             \
+    static void fill_##SHIFT(const perlin_ctx * ctx, uint8_t * out,             \
+            int width, int height, int origin_y, int origin_x, int stride)      \
+    {                                                                           \
+        static const struct lut t = { left_##SHIFT, right_##SHIFT, wx_##SHIFT };\
+        pthread_once(&once_##SHIFT, build_##SHIFT);                             \
+        fill(ctx, &t, out, width, height, origin_y, origin_x, stride, SHIFT);   \
+    }
+
+SPECIALIZE(2)
+SPECIALIZE(3)
+SPECIALIZE(4)
+SPECIALIZE(5)
+
+// indexed by shift - PERLIN_LUT_MIN_SHIFT
+static const fill_fn fill_table[] = { fill_2, fill_3, fill_4, fill_5 };
+
+int perlin_fill_lut(const perlin_ctx * ctx, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, int stride, int cell)
+{
+    int shift = 0;
+    while ((1 << shift) < cell) { shift++; }
+    if ((1 << shift) != cell || shift < PERLIN_LUT_MIN_SHIFT || shift > PERLIN_LUT_MAX_SHIFT)
+    {
+        return 0;
+    }
+    if (width <= 0 || height <= 0) { return 1; }
+
+    // outside the exact range, perlin_raw pixel by pixel
+    if (origin_y < 0 || origin_x < 0 ||
+        origin_y > PERLIN_LUT_LIMIT - height || origin_x > PERLIN_LUT_LIMIT - width)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                out[(size_t) y * stride + x] =
+                    (uint8_t) perlin_cell(ctx, origin_y + y, origin_x + x, cell);
+            }
+        }
+        return 1;
+    }
+
+    fill_table[shift - PERLIN_LUT_MIN_SHIFT](ctx, out, width, height, origin_y, origin_x, stride);
+    return 1;
+}
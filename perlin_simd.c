@@ -0,0 +1,206 @@
+/*
+   perlin_simd.c
+   vectorized perlin_raw kernels (sse2: 4 samples, avx2: 8 samples at once)
+   and the runtime dispatch between them and the scalar path
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "perlin.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PERLIN_X86
+#endif
+
+// kernel in use, picked on first use unless forced by perlin_set_kernel.
+// pool threads fill batches at once, so it is only read and written whole
+static atomic_int kernel = -1;
+
+// scalar kernel ---------------------------------------------------------------
+
+static void raw_batch_scalar(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = perlin_raw(ctx, ys[i], xs[i]);
+    }
+}
+
+#ifdef PERLIN_X86
+
+// sse2 kernel, 4 samples per iteration --------------------------------------
+
+// index of the gradient at each lane's lattice point, sse2 has no gather
+// so the lanes are hashed one by one and the gradients loaded back in
+static inline void gather_sse2(const perlin_ctx * ctx, __m128i y, __m128i x,
+        __m128 * gy, __m128 * gx)
+{
+    int32_t ya[4], xa[4];
+    _mm_storeu_si128((__m128i *) ya, y);
+    _mm_storeu_si128((__m128i *) xa, x);
+
+    vec2 g[4];
+    for (int i = 0; i < 4; i++)
+    {
+        g[i] = ctx->gradients[ctx->perm[ctx->perm[xa[i] & 255] + (ya[i] & 255)] & 7];
+    }
+
+    *gy = _mm_setr_ps(g[0].y, g[1].y, g[2].y, g[3].y);
+    *gx = _mm_setr_ps(g[0].x, g[1].x, g[2].x, g[3].x);
+}
+
+static void raw_batch_sse2(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, int n)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 y = _mm_loadu_ps(ys + i);
+        __m128 x = _mm_loadu_ps(xs + i);
+
+        // grid square corners and weights
+        __m128i y1 = _mm_cvttps_epi32(y);
+        __m128i x1 = _mm_cvttps_epi32(x);
+        __m128i y2 = _mm_add_epi32(y1, one);
+        __m128i x2 = _mm_add_epi32(x1, one);
+
+        __m128 wy = _mm_sub_ps(y, _mm_cvtepi32_ps(y1));
+        __m128 wx = _mm_sub_ps(x, _mm_cvtepi32_ps(x1));
+        __m128 dy2 = _mm_sub_ps(y, _mm_cvtepi32_ps(y2));
+        __m128 dx2 = _mm_sub_ps(x, _mm_cvtepi32_ps(x2));
+
+        // dot products in the same order as distance_dot_gradient
+        __m128 gy, gx, g1, g2, i1, i2;
+
+        gather_sse2(ctx, y1, x1, &gy, &gx);
+        g1 = _mm_add_ps(_mm_mul_ps(wy, gy), _mm_mul_ps(wx, gx));
+        gather_sse2(ctx, y2, x1, &gy, &gx);
+        g2 = _mm_add_ps(_mm_mul_ps(dy2, gy), _mm_mul_ps(wx, gx));
+        i1 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(g2, g1), wy), g1);
+
+        gather_sse2(ctx, y1, x2, &gy, &gx);
+        g1 = _mm_add_ps(_mm_mul_ps(wy, gy), _mm_mul_ps(dx2, gx));
+        gather_sse2(ctx, y2, x2, &gy, &gx);
+        g2 = _mm_add_ps(_mm_mul_ps(dy2, gy), _mm_mul_ps(dx2, gx));
+        i2 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(g2, g1), wy), g1);
+
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(i2, i1), wx), i1));
+    }
+
+    raw_batch_scalar(ctx, out + i, ys + i, xs + i, n - i);
+}
+
+// avx2 kernel, 8 samples per iteration --------------------------------------
+
+// gradient at each lane's lattice point using hardware gathers. the table
+// is bytes, so each lane gathers the 4 bytes starting at its entry and
+// keeps the low one, the padding after the table covers the last entries
+__attribute__((target("avx2")))
+static inline void gather_avx2(const perlin_ctx * ctx, __m256i y, __m256i x,
+        __m256 * gy, __m256 * gx)
+{
+    const __m256i mask = _mm256_set1_epi32(255);
+    const int * perm = (const int *) ctx->perm;
+
+    __m256i h = _mm256_i32gather_epi32(perm, _mm256_and_si256(x, mask), 1);
+    h = _mm256_add_epi32(_mm256_and_si256(h, mask), _mm256_and_si256(y, mask));
+    h = _mm256_i32gather_epi32(perm, h, 1);
+
+    // gradients are {x, y} pairs, so lane i reads floats 2g and 2g + 1
+    __m256i g = _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(7)), 1);
+    *gx = _mm256_i32gather_ps((const float *) ctx->gradients, g, 4);
+    *gy = _mm256_i32gather_ps((const float *) ctx->gradients + 1, g, 4);
+}
+
+__attribute__((target("avx2")))
+static void raw_batch_avx2(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, int n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 y = _mm256_loadu_ps(ys + i);
+        __m256 x = _mm256_loadu_ps(xs + i);
+
+        // grid square corners and weights
+        __m256i y1 = _mm256_cvttps_epi32(y);
+        __m256i x1 = _mm256_cvttps_epi32(x);
+        __m256i y2 = _mm256_add_epi32(y1, one);
+        __m256i x2 = _mm256_add_epi32(x1, one);
+
+        __m256 wy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y1));
+        __m256 wx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x1));
+        __m256 dy2 = _mm256_sub_ps(y, _mm256_cvtepi32_ps(y2));
+        __m256 dx2 = _mm256_sub_ps(x, _mm256_cvtepi32_ps(x2));
+
+        // dot products in the same order as distance_dot_gradient
+        __m256 gy, gx, g1, g2, i1, i2;
+
+        gather_avx2(ctx, y1, x1, &gy, &gx);
+        g1 = _mm256_add_ps(_mm256_mul_ps(wy, gy), _mm256_mul_ps(wx, gx));
+        gather_avx2(ctx, y2, x1, &gy, &gx);
+        g2 = _mm256_add_ps(_mm256_mul_ps(dy2, gy), _mm256_mul_ps(wx, gx));
+        i1 = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(g2, g1), wy), g1);
+
+        gather_avx2(ctx, y1, x2, &gy, &gx);
+        g1 = _mm256_add_ps(_mm256_mul_ps(wy, gy), _mm256_mul_ps(dx2, gx));
+        gather_avx2(ctx, y2, x2, &gy, &gx);
+        g2 = _mm256_add_ps(_mm256_mul_ps(dy2, gy), _mm256_mul_ps(dx2, gx));
+        i2 = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(g2, g1), wy), g1);
+
+        _mm256_storeu_ps(out + i,
+                _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(i2, i1), wx), i1));
+    }
+
+    raw_batch_scalar(ctx, out + i, ys + i, xs + i, n - i);
+}
+
+#endif
+
+// dispatch ------------------------------------------------------------------
+
+// force a kernel, falling back to the best one the cpu actually supports
+enum simd_level perlin_set_kernel(enum simd_level level)
+{
+    enum simd_level best = simd_detect();
+    enum simd_level picked = level > best ? best : level;
+    atomic_store_explicit(&kernel, picked, memory_order_relaxed);
+    return picked;
+}
+
+// kernel perlin_raw_batch uses, picking the best one on first call
+enum simd_level perlin_get_kernel(void)
+{
+    int k = atomic_load_explicit(&kernel, memory_order_relaxed);
+    if (k < 0)
+    {
+        // racing first callers detect the same level, the first one wins
+        // so a kernel forced meanwhile is kept
+        int detected = simd_detect();
+        if (!atomic_compare_exchange_strong(&kernel, &k, detected)) { return k; }
+        k = detected;
+    }
+    return k;
+}
+
+// perlin_raw over n coordinate pairs with the selected kernel
+void perlin_raw_batch(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, int n)
+{
+    switch (perlin_get_kernel())
+    {
+#ifdef PERLIN_X86
+        case SIMD_AVX2: raw_batch_avx2(ctx, out, ys, xs, n); break;
+        case SIMD_SSE2: raw_batch_sse2(ctx, out, ys, xs, n); break;
+#endif
+        default:        raw_batch_scalar(ctx, out, ys, xs, n); break;
+    }
+}
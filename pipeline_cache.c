@@ -0,0 +1,143 @@
+/*
+   pipeline_cache.c
+   VkPipelineCache kept on disk between runs
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vulkan.h>
+
+#include "util.h"
+#include "pipeline_cache.h"
+
+// the header every VkPipelineCache blob starts with, version one
+struct cache_header
+{
+    uint32_t length;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint8_t uuid[VK_UUID_SIZE];
+};
+
+// data only helps the driver that wrote it. drivers check this themselves
+// too, but not all of them gracefully, so a stale file never reaches them
+static int header_matches(const char * data, size_t size,
+        const VkPhysicalDeviceProperties * properties)
+{
+    struct cache_header header;
+    if (size < sizeof(header)) { return 0; }
+    memcpy(&header, data, sizeof(header));
+
+    return header.length >= sizeof(header) && header.length <= size &&
+        header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendor_id == properties->vendorID &&
+        header.device_id == properties->deviceID &&
+        memcmp(header.uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+int pipeline_cache_create(struct pipeline_cache * cache, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, const char * path)
+{
+    memset(cache, 0, sizeof(struct pipeline_cache));
+    cache->device = device;
+    cache->host = host;
+    cache->path = path;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    // a missing file is a cold start, read_file only complains about it
+    size_t size = 0;
+    char * data = NULL;
+    FILE * probe = fopen(path, "rb");
+    if (probe != NULL)
+    {
+        fclose(probe);
+        data = read_file(path, &size);
+    }
+
+    VkPipelineCacheCreateInfo cache_info = {0};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if (data != NULL && header_matches(data, size, &properties))
+    {
+        cache_info.initialDataSize = size;
+        cache_info.pInitialData = data;
+        cache->warm = 1;
+        cache->loaded_bytes = size;
+    }
+    else if (data != NULL)
+    {
+        printf("pipeline cache: %s is for another device or driver, rebuilding\n", path);
+    }
+
+    VkResult result = vkCreatePipelineCache(device, &cache_info, cache->host, &cache->handle);
+
+    // the driver may still refuse data that looked fine, start empty then
+    if (result != VK_SUCCESS && cache->warm)
+    {
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = NULL;
+        cache->warm = 0;
+        cache->loaded_bytes = 0;
+        result = vkCreatePipelineCache(device, &cache_info, cache->host, &cache->handle);
+    }
+    free(data);
+
+    if (result != VK_SUCCESS)
+    {
+        printf("Error: couldnt create pipeline cache\n");
+        memset(cache, 0, sizeof(struct pipeline_cache));
+        return 0;
+    }
+
+    return 1;
+}
+
+int pipeline_cache_save(struct pipeline_cache * cache)
+{
+    if (cache->handle == VK_NULL_HANDLE) { return 0; }
+
+    size_t size = 0;
+    if (vkGetPipelineCacheData(cache->device, cache->handle, &size, NULL) != VK_SUCCESS)
+    {
+        printf("Error: couldnt get pipeline cache data\n");
+        return 0;
+    }
+
+    char * data = malloc(size);
+    if (data == NULL ||
+        vkGetPipelineCacheData(cache->device, cache->handle, &size, data) != VK_SUCCESS)
+    {
+        printf("Error: couldnt get pipeline cache data\n");
+        free(data);
+        return 0;
+    }
+
+    // write next to it and rename over, so a crash never leaves half a file
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", cache->path);
+    FILE * file = fopen(temp, "wb");
+    int ok = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0) { ok = 0; }
+    ok = ok && rename(temp, cache->path) == 0;
+    free(data);
+
+    if (!ok)
+    {
+        printf("Error: couldnt write %s\n", cache->path);
+        remove(temp);
+    }
+    return ok;
+}
+
+void pipeline_cache_destroy(struct pipeline_cache * cache)
+{
+    if (cache->handle != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineCache(cache->device, cache->handle, cache->host);
+    }
+    memset(cache, 0, sizeof(struct pipeline_cache));
+}
@@ -0,0 +1,38 @@
+/*
+   pipeline_cache.h
+   VkPipelineCache kept on disk between runs
+*/
+
+#ifndef PIPELINE_CACHE
+#define PIPELINE_CACHE
+
+#include <stddef.h>
+#include <vulkan.h>
+
+#define PIPELINE_CACHE_PATH "pipeline.cache"
+
+// a pipeline cache seeded from path. the file is only used when its header
+// matches the device (vendor, device and pipeline cache uuid), otherwise the
+// cache starts empty and the file is rewritten on save
+struct pipeline_cache
+{
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // NULL is fine
+    VkPipelineCache handle;
+    const char * path;
+    int warm;                   // seeded from a valid file
+    size_t loaded_bytes;        // size of that file
+};
+
+// create the cache, reading path if it is there and valid. a missing or
+// stale file is not an error. returns 0 on failure
+int pipeline_cache_create(struct pipeline_cache * cache, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, const char * path);
+
+// write the cache back to its path. returns 0 on failure
+int pipeline_cache_save(struct pipeline_cache * cache);
+
+void pipeline_cache_destroy(struct pipeline_cache * cache);
+
+
+#endif
@@ -0,0 +1,342 @@
+/*
+   pool.c
+   persistent worker pool for data parallel jobs
+
+   workers sleep on a condition variable between jobs. pool_run hands
+   indices out through an atomic counter so faster threads simply take more
+   of them. pool_for gives every thread its own contiguous share of chunks
+   instead, which keeps neighbouring chunks on one core, and threads that
+   run dry steal half of what is left from the back of another's share
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+// one thread's share of a pool_for job, chunk indices [begin, end). owners
+// take from the front and thieves from the back, under a lock that is only
+// ever contended while stealing
+struct queue
+{
+    pthread_mutex_t lock;
+    int begin, end;
+    char pad[64];           // keep queues on separate cache lines
+};
+
+// what a worker thread needs to find its queue
+struct worker_arg
+{
+    struct pool * pool;
+    int index;
+};
+
+struct pool
+{
+    int threads;
+    pthread_t * workers;
+    struct worker_arg * args;
+    struct queue * queues;  // one per thread, the caller's last
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    // signalled when a job is posted or on shutdown
+    pthread_cond_t done;    // signalled when the last worker leaves a job
+
+    // current job, guarded by lock apart from next and the queues
+    pool_task task;         // set for pool_run jobs
+    pool_range_task range;  // set for pool_for jobs
+    void * arg;
+    int count;
+    int grain;
+    atomic_int next;        // next index to hand out
+    unsigned generation;    // bumped per job so workers see each one once
+    int busy;               // workers still inside the current job
+    int quit;
+
+    atomic_ulong steals;
+};
+
+// take indices from the current pool_run job until it runs dry
+static void drain(struct pool * pool, pool_task task, void * arg, int count)
+{
+    int i;
+    while ((i = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed)) < count)
+    {
+        task(arg, i);
+    }
+}
+
+// next chunk from the front of our own queue, or -1
+static int queue_pop(struct queue * q)
+{
+    int chunk = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->begin < q->end) { chunk = q->begin++; }
+    pthread_mutex_unlock(&q->lock);
+    return chunk;
+}
+
+// move the back half of a victim's chunks into our empty queue
+static int queue_steal(struct queue * victim, struct queue * own)
+{
+    int begin = 0, end = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    int left = victim->end - victim->begin;
+    if (left > 0)
+    {
+        end = victim->end;
+        begin = end - (left + 1) / 2;
+        victim->end = begin;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (begin == end) { return 0; }
+
+    pthread_mutex_lock(&own->lock);
+    own->begin = begin;
+    own->end = end;
+    pthread_mutex_unlock(&own->lock);
+    return 1;
+}
+
+// work through our share of the current pool_for job, then steal until
+// every queue is empty
+static void drain_chunks(struct pool * pool, int self, pool_range_task range,
+        void * arg, int count, int grain)
+{
+    struct queue * own = &pool->queues[self];
+
+    for (;;)
+    {
+        int chunk;
+        while ((chunk = queue_pop(own)) >= 0)
+        {
+            int begin = chunk * grain;
+            int end = begin + grain < count ? begin + grain : count;
+            range(arg, begin, end);
+        }
+
+        // look for a victim, starting after ourselves to spread thieves out
+        int stolen = 0;
+        for (int i = 1; i < pool->threads && !stolen; i++)
+        {
+            stolen = queue_steal(&pool->queues[(self + i) % pool->threads], own);
+        }
+        if (!stolen) { return; }
+        atomic_fetch_add_explicit(&pool->steals, 1, memory_order_relaxed);
+    }
+}
+
+static void * worker(void * data)
+{
+    struct worker_arg * self = data;
+    struct pool * pool = self->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->quit && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) { break; }
+
+        seen = pool->generation;
+        pool_task task = pool->task;
+        pool_range_task range = pool->range;
+        void * arg = pool->arg;
+        int count = pool->count;
+        int grain = pool->grain;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (range != NULL) { drain_chunks(pool, self->index, range, arg, count, grain); }
+        else { drain(pool, task, arg, count); }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0)
+        {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// spin up a pool, one thread per online cpu if threads <= 0
+struct pool * pool_create(int threads)
+{
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
+    }
+
+    struct pool * pool = calloc(1, sizeof(struct pool));
+    if (pool == NULL) { return NULL; }
+
+    pool->queues = calloc(threads, sizeof(struct queue));
+    pool->workers = malloc(sizeof(pthread_t) * threads);
+    pool->args = malloc(sizeof(struct worker_arg) * threads);
+    if (pool->queues == NULL || pool->workers == NULL || pool->args == NULL)
+    {
+        printf("Error: couldnt allocate a pool of %d threads\n", threads);
+        free(pool->queues);
+        free(pool->workers);
+        free(pool->args);
+        free(pool);
+        return NULL;
+    }
+
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+    }
+
+    // the calling thread is the last worker, so spawn one less
+    for (int i = 0; i < threads - 1; i++)
+    {
+        pool->args[i].pool = pool;
+        pool->args[i].index = i;
+        if (pthread_create(&pool->workers[i], NULL, worker, &pool->args[i]) != 0)
+        {
+            printf("Error: couldnt create pool worker %d\n", i);
+            pool->threads = i + 1;
+            break;
+        }
+    }
+
+    return pool;
+}
+
+// join the workers and free the pool
+void pool_destroy(struct pool * pool)
+{
+    if (pool == NULL) { return; }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threads - 1; i++)
+    {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    for (int i = 0; i < pool->threads; i++)
+    {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->queues);
+    free(pool->args);
+    free(pool->workers);
+    free(pool);
+}
+
+// number of threads that work on a job, the caller included
+int pool_threads(struct pool * pool)
+{
+    return pool->threads;
+}
+
+// successful steals by pool_for jobs so far
+unsigned long pool_steals(struct pool * pool)
+{
+    return atomic_load_explicit(&pool->steals, memory_order_relaxed);
+}
+
+// wake the workers on the job set up in pool, run the caller's share and
+// wait for everyone else
+static void post_and_wait(struct pool * pool)
+{
+    pool->busy = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (pool->range != NULL)
+    {
+        drain_chunks(pool, pool->threads - 1, pool->range, pool->arg,
+                pool->count, pool->grain);
+    }
+    else
+    {
+        drain(pool, pool->task, pool->arg, pool->count);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// run task over [0, count) and wait for all of it
+void pool_run(struct pool * pool, pool_task task, void * arg, int count)
+{
+    if (count <= 0) { return; }
+
+    // not worth waking anyone up
+    if (pool->threads == 1 || count == 1)
+    {
+        for (int i = 0; i < count; i++) { task(arg, i); }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->range = NULL;
+    pool->arg = arg;
+    pool->count = count;
+    atomic_store_explicit(&pool->next, 0, memory_order_relaxed);
+    post_and_wait(pool);
+}
+
+// run range over [0, count) in chunks of grain with work stealing
+void pool_for(struct pool * pool, pool_range_task range, void * arg,
+        int count, int grain)
+{
+    if (count <= 0) { return; }
+    if (grain < 1) { grain = 1; }
+
+    int chunks = (count + grain - 1) / grain;
+    if (pool->threads == 1 || chunks == 1)
+    {
+        range(arg, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    // every thread starts with an equal contiguous share of the chunks
+    for (int i = 0; i < pool->threads; i++)
+    {
+        struct queue * q = &pool->queues[i];
+        pthread_mutex_lock(&q->lock);
+        q->begin = (int) ((long) chunks * i / pool->threads);
+        q->end = (int) ((long) chunks * (i + 1) / pool->threads);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    pool->task = NULL;
+    pool->range = range;
+    pool->arg = arg;
+    pool->count = count;
+    pool->grain = grain;
+    post_and_wait(pool);
+}
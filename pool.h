@@ -0,0 +1,42 @@
+/*
+   pool.h
+   persistent worker pool for data parallel jobs
+*/
+
+#ifndef POOL
+#define POOL
+
+// runs task index for every index in [0, count) of a job
+typedef void (*pool_task)(void * arg, int index);
+
+// runs the indices [begin, end) of a job
+typedef void (*pool_range_task)(void * arg, int begin, int end);
+
+struct pool;
+
+// spin up a pool of threads workers (including the calling thread), or one
+// per online cpu if threads <= 0. create once and reuse it for every job
+struct pool * pool_create(int threads);
+
+// join the workers and free the pool
+void pool_destroy(struct pool * pool);
+
+// number of threads that work on a job, the caller included
+int pool_threads(struct pool * pool);
+
+// run task over [0, count) spread over the pool, returns once all are done.
+// the calling thread works too, so a pool of 1 runs everything inline.
+// a pool runs one job at a time, dont share it between submitting threads
+void pool_run(struct pool * pool, pool_task task, void * arg, int count);
+
+// run range over [0, count) in chunks of grain indices. each thread starts
+// on its own contiguous share and steals from the others once it is done,
+// so uneven chunk costs still balance
+void pool_for(struct pool * pool, pool_range_task range, void * arg,
+        int count, int grain);
+
+// successful steals by pool_for jobs since the pool was created
+unsigned long pool_steals(struct pool * pool);
+
+
+#endif
@@ -0,0 +1,259 @@
+/*
+   profile.c
+   stage timers into a lock-free ring, percentile summary, csv and trace export
+
+   any thread records by claiming the next slot with one fetch add and
+   writing it under a per slot sequence number, odd while being written.
+   readers copy a slot and keep it only if the sequence is the same even
+   number before and after, so a writer lapping them only costs that event.
+   nothing ever blocks a recording thread
+*/
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+
+struct slot
+{
+    _Atomic uint64_t sequence;      // 2 * index + 2 once written
+    struct profile_event event;
+};
+
+int profile_enabled = 0;
+
+static struct slot ring[PROFILE_RING];
+static _Atomic uint64_t head;
+static _Atomic uint32_t current_frame;
+static _Atomic uint32_t next_thread;
+static _Thread_local uint32_t thread_number;    // 0 until first use
+
+static struct profile_event startup[PROFILE_STARTUP_MAX];
+static _Atomic int startup_count;
+
+static const char * stage_names[PROFILE_STAGES] =
+{
+    "instance", "device", "swapchain", "pipelines", "resources", "preload", "first frame",
+    "events", "wait", "simulate", "noise", "upload", "record", "submit", "present",
+    "gpu simulate", "gpu noise", "gpu cull", "gpu draw", "gpu copy"
+};
+
+void profile_enable(int on)
+{
+    profile_enabled = on;
+}
+
+uint64_t profile_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000u + (uint64_t) t.tv_nsec;
+}
+
+void profile_frame(uint32_t frame)
+{
+    atomic_store_explicit(&current_frame, frame, memory_order_relaxed);
+}
+
+const char * profile_stage_name(enum profile_stage stage)
+{
+    return stage < PROFILE_STAGES ? stage_names[stage] : "?";
+}
+
+// recording -------------------------------------------------------------------
+
+static void push(const struct profile_event * event)
+{
+    if (event->stage < PROFILE_FIRST_FRAME_STAGE)
+    {
+        int i = atomic_fetch_add(&startup_count, 1);
+        if (i < PROFILE_STARTUP_MAX) { startup[i] = *event; }
+        return;
+    }
+
+    uint64_t index = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    struct slot * s = &ring[index & (PROFILE_RING - 1)];
+    atomic_store_explicit(&s->sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->event = *event;
+    atomic_store_explicit(&s->sequence, 2 * index + 2, memory_order_release);
+}
+
+void profile_record(enum profile_stage stage, uint64_t start_ns, uint64_t end_ns)
+{
+    if (thread_number == 0) { thread_number = atomic_fetch_add(&next_thread, 1) + 1; }
+
+    struct profile_event event =
+    {
+        start_ns, end_ns,
+        atomic_load_explicit(&current_frame, memory_order_relaxed),
+        (uint16_t) stage, (uint16_t) thread_number
+    };
+    push(&event);
+}
+
+void profile_record_gpu(enum profile_stage stage, uint64_t start_ns, uint64_t end_ns,
+        uint32_t frame)
+{
+    struct profile_event event =
+    {
+        start_ns, end_ns, frame, (uint16_t) stage, PROFILE_GPU_THREAD
+    };
+    push(&event);
+}
+
+// reading ---------------------------------------------------------------------
+
+// copy of every event still readable, startup first, oldest first. the
+// caller frees it. NULL with *count 0 when there are none
+static struct profile_event * snapshot(int * count)
+{
+    uint64_t end = atomic_load_explicit(&head, memory_order_acquire);
+    uint64_t begin = end > PROFILE_RING ? end - PROFILE_RING : 0;
+    int startups = atomic_load(&startup_count);
+    if (startups > PROFILE_STARTUP_MAX) { startups = PROFILE_STARTUP_MAX; }
+
+    *count = 0;
+    struct profile_event * events = malloc(sizeof(struct profile_event) *
+            ((size_t) (end - begin) + startups + 1));
+    if (events == NULL) { return NULL; }
+
+    memcpy(events, startup, sizeof(struct profile_event) * startups);
+    int n = startups;
+    for (uint64_t i = begin; i < end; i++)
+    {
+        struct slot * s = &ring[i & (PROFILE_RING - 1)];
+        uint64_t before = atomic_load_explicit(&s->sequence, memory_order_acquire);
+        struct profile_event event = s->event;
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = atomic_load_explicit(&s->sequence, memory_order_relaxed);
+
+        // still being written, or already overwritten by a later lap
+        if (before != 2 * i + 2 || after != before) { continue; }
+        events[n++] = event;
+    }
+
+    *count = n;
+    return events;
+}
+
+static int compare_double(const void * a, const void * b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// nearest rank percentile of sorted values
+static double percentile(const double * sorted, int n, double p)
+{
+    int rank = (int) ceil(p / 100.0 * n) - 1;
+    return sorted[rank < 0 ? 0 : rank >= n ? n - 1 : rank];
+}
+
+void profile_summary(FILE * out)
+{
+    int count;
+    struct profile_event * events = snapshot(&count);
+    double * ms = malloc(sizeof(double) * (count + 1));
+    if (events == NULL || ms == NULL)
+    {
+        free(events);
+        free(ms);
+        return;
+    }
+
+    fprintf(out, "%-14s %7s %9s %9s %9s %9s\n", "stage", "count", "mean ms", "p50", "p95", "p99");
+    for (int stage = 0; stage < PROFILE_STAGES; stage++)
+    {
+        int n = 0;
+        double total = 0.0;
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].stage != stage) { continue; }
+            ms[n] = (events[i].end_ns - events[i].start_ns) * 1e-6;
+            total += ms[n++];
+        }
+        if (n == 0) { continue; }
+
+        qsort(ms, n, sizeof(double), compare_double);
+        fprintf(out, "%-14s %7d %9.3f %9.3f %9.3f %9.3f\n", stage_names[stage], n,
+                total / n, percentile(ms, n, 50), percentile(ms, n, 95), percentile(ms, n, 99));
+    }
+
+    free(ms);
+    free(events);
+}
+
+// export ----------------------------------------------------------------------
+
+int profile_write_csv(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return 0;
+    }
+
+    int count;
+    struct profile_event * events = snapshot(&count);
+    uint64_t origin = count > 0 ? events[0].start_ns : 0;
+
+    fprintf(file, "stage,thread,frame,start_ms,duration_ms\n");
+    for (int i = 0; i < count; i++)
+    {
+        const struct profile_event * e = &events[i];
+        fprintf(file, "%s,%d,%u,%.6f,%.6f\n", stage_names[e->stage],
+                e->thread == PROFILE_GPU_THREAD ? -1 : (int) e->thread, e->frame,
+                ((int64_t) (e->start_ns - origin)) * 1e-6, (e->end_ns - e->start_ns) * 1e-6);
+    }
+    free(events);
+
+    if (fclose(file) != 0)
+    {
+        printf("Error: couldnt write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+// complete ("X") events in microseconds, one track per thread and one for
+// the gpu, in the json array format chrome://tracing and perfetto load
+int profile_write_trace(const char * path)
+{
+    FILE * file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return 0;
+    }
+
+    int count;
+    struct profile_event * events = snapshot(&count);
+    uint64_t origin = count > 0 ? events[0].start_ns : 0;
+
+    fprintf(file, "[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"gpu\"}}", PROFILE_GPU_THREAD);
+    for (int i = 0; i < count; i++)
+    {
+        const struct profile_event * e = &events[i];
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                stage_names[e->stage], e->thread,
+                ((int64_t) (e->start_ns - origin)) * 1e-3,
+                (e->end_ns - e->start_ns) * 1e-3, e->frame);
+    }
+    fprintf(file, "\n]\n");
+    free(events);
+
+    if (fclose(file) != 0)
+    {
+        printf("Error: couldnt write %s\n", path);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,100 @@
+/*
+   profile.h
+   stage timers into a lock-free ring, percentile summary, csv and trace export
+*/
+
+#ifndef PROFILE
+#define PROFILE
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROFILE_RING (1 << 16)      // events kept, a power of two
+#define PROFILE_STARTUP_MAX 32      // startup events kept
+
+enum profile_stage
+{
+    // startup, timed once and kept apart from the ring
+    PROFILE_INSTANCE,
+    PROFILE_DEVICE,                 // device selection and creation
+    PROFILE_SWAPCHAIN,
+    PROFILE_PIPELINES,              // renderer and compute pipelines
+    PROFILE_RESOURCES,              // buffers, targets, frames
+    PROFILE_PRELOAD,                // spir-v, flock and wind on the startup thread
+    PROFILE_FIRST_FRAME,            // launch until the first frame is submitted
+
+    // per frame on the cpu
+    PROFILE_EVENTS,
+    PROFILE_WAIT,                   // on the frame's fence
+    PROFILE_SIMULATE,
+    PROFILE_NOISE,
+    PROFILE_UPLOAD,
+    PROFILE_RECORD,
+    PROFILE_SUBMIT,
+    PROFILE_PRESENT,
+
+    // per frame on the gpu, from timestamp queries
+    PROFILE_GPU_SIMULATE,
+    PROFILE_GPU_NOISE,
+    PROFILE_GPU_CULL,
+    PROFILE_GPU_DRAW,
+    PROFILE_GPU_COPY,
+
+    PROFILE_STAGES
+};
+
+#define PROFILE_FIRST_FRAME_STAGE PROFILE_EVENTS
+#define PROFILE_FIRST_GPU_STAGE PROFILE_GPU_SIMULATE
+
+#define PROFILE_GPU_THREAD 0xffff   // thread of gpu events
+
+struct profile_event
+{
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t frame;
+    uint16_t stage;
+    uint16_t thread;                // small per thread number, or
+                                    // PROFILE_GPU_THREAD
+};
+
+// off unless profile_enable, timers then cost a load and a branch
+extern int profile_enabled;
+
+void profile_enable(int on);
+
+// monotonic nanoseconds
+uint64_t profile_now(void);
+
+// the frame later events belong to
+void profile_frame(uint32_t frame);
+
+// record an event, from any thread, without locking
+void profile_record(enum profile_stage stage, uint64_t start_ns, uint64_t end_ns);
+void profile_record_gpu(enum profile_stage stage, uint64_t start_ns, uint64_t end_ns,
+        uint32_t frame);
+
+// time a stage: uint64_t t = profile_begin(); ...; profile_end(stage, t);
+static inline uint64_t profile_begin(void)
+{
+    return profile_enabled ? profile_now() : 0;
+}
+
+static inline void profile_end(enum profile_stage stage, uint64_t start)
+{
+    if (profile_enabled) { profile_record(stage, start, profile_now()); }
+}
+
+const char * profile_stage_name(enum profile_stage stage);
+
+// count, mean and p50, p95, p99 in ms of every stage seen in the events
+// still in the ring, and the startup events
+void profile_summary(FILE * out);
+
+// every event kept, as csv (stage, thread, frame, start and duration in ms)
+// or chrome://tracing json. return 0 on failure
+int profile_write_csv(const char * path);
+int profile_write_trace(const char * path);
+
+
+#endif
@@ -0,0 +1,855 @@
+/*
+   render.c
+   instanced boid drawing: one shared mesh, one draw for the whole flock
+
+   every boid is an instance of a small dart mesh. the vertex shader places
+   and orients it from the per instance record, so the cpu never builds
+   per boid geometry and a million boids are still a single draw call.
+   cpu boids are packed into 16 byte records on upload, the gpu flock's
+   32 byte state is read in place through a second pipeline. both tint
+   the boids by the wind field, a scrolling noise texture sampled at each
+   boid's position. with a cull pass, see cull.c, the flock is drawn as
+   two indirect draws instead, darts near the eye and flat quads further
+   out, of only the boids in view
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cull.h"
+#include "gpu_flock.h"
+#include "render.h"
+
+#define SHADER_DIR "shaders/"
+#define DEPTH_FORMAT VK_FORMAT_D16_UNORM
+#define CAMERA_FOV 1.0f
+
+// push constants, see boid_common.glsl
+struct render_push
+{
+    float view_projection[16];
+    float bounds[4];            // xyz world size, w mesh scale
+    float noise[4];             // xy field position of the world's corner,
+                                // z field texels across the world, w 1 / size
+    float inv_max_speed;
+};
+
+// dart pointing down +z, shaded so its faces read apart, then the quad
+// lod: its outline seen from above, notched at the back
+static const struct Vertex mesh_vertices[] =
+{
+    { {  0.0f,  0.0f,  1.0f }, { 1.0f, 1.0f, 1.0f } },  // tip
+    { { -0.5f,  0.0f, -0.5f }, { 0.6f, 0.6f, 0.6f } },  // back left
+    { {  0.5f,  0.0f, -0.5f }, { 0.6f, 0.6f, 0.6f } },  // back right
+    { {  0.0f,  0.4f, -0.5f }, { 0.8f, 0.8f, 0.8f } },  // fin
+
+    { {  0.0f,  0.0f,  1.0f }, { 0.8f, 0.8f, 0.8f } },  // tip
+    { { -0.5f,  0.0f, -0.5f }, { 0.8f, 0.8f, 0.8f } },  // back left
+    { {  0.0f,  0.0f, -0.2f }, { 0.8f, 0.8f, 0.8f } },  // notch
+    { {  0.5f,  0.0f, -0.5f }, { 0.8f, 0.8f, 0.8f } },  // back right
+};
+
+// each lod's indices count from its own first vertex
+static const uint16_t mesh_indices[] =
+{
+    0, 1, 2,
+    0, 2, 3,
+    0, 3, 1,
+    1, 3, 2,
+
+    0, 1, 2,
+    0, 2, 3
+};
+
+static const struct render_mesh mesh_lods[RENDER_LODS] =
+{
+    { 12, 0, 0 },
+    { 6, 12, 4 }
+};
+
+static const char * vertex_shaders[RENDER_SOURCES] =
+{
+    SHADER_DIR "boid_packed.spv",
+    SHADER_DIR "boid_state.spv"
+};
+
+// packing --------------------------------------------------------------------
+
+static int16_t snorm16(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int16_t) lrintf(v * 32767.0f);
+}
+
+static int8_t snorm8(float v)
+{
+    v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+    return (int8_t) lrintf(v * 127.0f);
+}
+
+static uint8_t unorm8(float v)
+{
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint8_t) lrintf(v * 255.0f);
+}
+
+// one record from a position in [-1, 1] and a velocity
+static void pack_one(struct Instance * o, float x, float y, float z,
+        float vx, float vy, float vz, float inv_max)
+{
+    float speed = sqrtf(vx * vx + vy * vy + vz * vz);
+    float inv = speed > 0.0f ? 1.0f / speed : 0.0f;
+    float t = speed * inv_max;
+
+    o->position[0] = snorm16(x);
+    o->position[1] = snorm16(y);
+    o->position[2] = snorm16(z);
+    o->position[3] = 0;
+    o->heading[0] = snorm8(vx * inv);
+    o->heading[1] = snorm8(vy * inv);
+    o->heading[2] = snorm8(vz * inv);
+    o->heading[3] = snorm8(t);
+
+    // slow boids blue, fast ones orange
+    o->color[0] = unorm8(0.2f + 0.8f * t);
+    o->color[1] = unorm8(0.5f);
+    o->color[2] = unorm8(1.0f - 0.8f * t);
+    o->color[3] = 255;
+}
+
+void render_pack(struct Instance * out, const struct boid_state * s, int count,
+        const struct boid_params * params)
+{
+    // positions map the world box onto [-1, 1]
+    float sx = 2.0f / params->bounds[0];
+    float sy = 2.0f / params->bounds[1];
+    float sz = 2.0f / params->bounds[2];
+    float inv_max = 1.0f / params->max_speed;
+
+    for (int i = 0; i < count; i++)
+    {
+        pack_one(&out[i], s->px[i] * sx - 1.0f, s->py[i] * sy - 1.0f,
+                s->pz[i] * sz - 1.0f, s->vx[i], s->vy[i], s->vz[i], inv_max);
+    }
+}
+
+// a + (b - a) * t the short way round an axis that wraps at bound, so a
+// boid crossing the edge does not fly back through the whole world
+static float lerp_wrapped(float a, float b, float t, float bound)
+{
+    float d = b - a;
+    if (d > 0.5f * bound) { d -= bound; }
+    else if (d < -0.5f * bound) { d += bound; }
+
+    float v = a + d * t;
+    if (v < 0.0f) { v += bound; }
+    else if (v >= bound) { v -= bound; }
+    return v;
+}
+
+void render_pack_lerp(struct Instance * out, const struct boid_state * prev,
+        const struct boid_state * s, int count, float alpha,
+        const struct boid_params * params)
+{
+    const float * b = params->bounds;
+    float sx = 2.0f / b[0];
+    float sy = 2.0f / b[1];
+    float sz = 2.0f / b[2];
+    float inv_max = 1.0f / params->max_speed;
+
+    for (int i = 0; i < count; i++)
+    {
+        float x = lerp_wrapped(prev->px[i], s->px[i], alpha, b[0]);
+        float y = lerp_wrapped(prev->py[i], s->py[i], alpha, b[1]);
+        float z = lerp_wrapped(prev->pz[i], s->pz[i], alpha, b[2]);
+        pack_one(&out[i], x * sx - 1.0f, y * sy - 1.0f, z * sz - 1.0f,
+                s->vx[i], s->vy[i], s->vz[i], inv_max);
+    }
+}
+
+// camera ---------------------------------------------------------------------
+
+// column major out = a * b
+static void mat4_multiply(float out[16], const float a[16], const float b[16])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        for (int r = 0; r < 4; r++)
+        {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) { sum += a[k * 4 + r] * b[c * 4 + k]; }
+            out[c * 4 + r] = sum;
+        }
+    }
+}
+
+// right handed view looking from eye at target, y up
+static void mat4_look_at(float out[16], const float eye[3], const float target[3])
+{
+    float f[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+    float fl = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+    for (int i = 0; i < 3; i++) { f[i] /= fl; }
+
+    // s = f x up, with up = +y
+    float s[3] = { -f[2], 0.0f, f[0] };
+    float sl = sqrtf(s[0] * s[0] + s[2] * s[2]);
+    s[0] /= sl;
+    s[2] /= sl;
+
+    float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+    float m[16] =
+    {
+        s[0], u[0], -f[0], 0.0f,
+        s[1], u[1], -f[1], 0.0f,
+        s[2], u[2], -f[2], 0.0f,
+        -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]),
+        -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]),
+        f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2],
+        1.0f
+    };
+    memcpy(out, m, sizeof(m));
+}
+
+// vulkan clip space: y down, depth 0 to 1
+static void mat4_perspective(float out[16], float fov_y, float aspect, float near, float far)
+{
+    float t = 1.0f / tanf(fov_y * 0.5f);
+    memset(out, 0, 16 * sizeof(float));
+    out[0] = t / aspect;
+    out[5] = -t;
+    out[10] = far / (near - far);
+    out[11] = -1.0f;
+    out[14] = near * far / (near - far);
+}
+
+// fixed camera outside one corner of the world box, looking at its centre
+float render_camera(const struct renderer * r, float view_projection[16])
+{
+    const float * b = r->bounds;
+    float size = fmaxf(b[0], fmaxf(b[1], b[2]));
+    float target[3] = { 0.5f * b[0], 0.5f * b[1], 0.5f * b[2] };
+    float eye[3] = { target[0] + 0.9f * size, target[1] + 0.7f * size, target[2] + 1.3f * size };
+
+    float view[16], projection[16];
+    mat4_look_at(view, eye, target);
+    mat4_perspective(projection, CAMERA_FOV, (float) r->target.extent.width / r->target.extent.height,
+            0.5f, 5.0f * size);
+    mat4_multiply(view_projection, projection, view);
+    return 0.5f * r->target.extent.height / tanf(CAMERA_FOV * 0.5f);
+}
+
+// setup ----------------------------------------------------------------------
+
+static int create_render_pass(struct renderer * r)
+{
+    VkAttachmentDescription attachments[2] = {{0}};
+    attachments[0].format = r->format;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = r->final_layout;
+
+    attachments[1].format = DEPTH_FORMAT;
+    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference color_ref = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkAttachmentReference depth_ref = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+    VkSubpassDescription subpass = {0};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &color_ref;
+    subpass.pDepthStencilAttachment = &depth_ref;
+
+    // the image may still be read by the presentation engine, and the
+    // depth buffer is shared by every frame
+    VkSubpassDependency dependencies[2] = {{0}};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // an image copied out afterwards needs its writes ordered before the copy
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    VkRenderPassCreateInfo render_pass_info = {0};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.attachmentCount = 2;
+    render_pass_info.pAttachments = attachments;
+    render_pass_info.subpassCount = 1;
+    render_pass_info.pSubpasses = &subpass;
+    render_pass_info.dependencyCount =
+        r->final_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 2 : 1;
+    render_pass_info.pDependencies = dependencies;
+
+    return vkCreateRenderPass(r->device, &render_pass_info, r->host, &r->render_pass) == VK_SUCCESS;
+}
+
+// one combined image sampler for the wind field, written by render_set_noise
+static int create_descriptors(struct renderer * r)
+{
+    VkDescriptorSetLayoutBinding binding = {0};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info = {0};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.bindingCount = 1;
+    set_layout_info.pBindings = &binding;
+    if (vkCreateDescriptorSetLayout(r->device, &set_layout_info, r->host,
+                &r->set_layout) != VK_SUCCESS)
+    {
+        r->set_layout = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 };
+    VkDescriptorPoolCreateInfo pool_info = {0};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    if (vkCreateDescriptorPool(r->device, &pool_info, r->host, &r->descriptor_pool) != VK_SUCCESS)
+    {
+        r->descriptor_pool = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = r->descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &r->set_layout;
+    return vkAllocateDescriptorSets(r->device, &alloc_info, &r->noise_set) == VK_SUCCESS;
+}
+
+// vertex input of each source: binding 0 is the mesh, binding 1 the instances
+static void vertex_input(enum render_source source,
+        VkVertexInputBindingDescription bindings[2],
+        VkVertexInputAttributeDescription attributes[5], uint32_t * attribute_count)
+{
+    bindings[0] = (VkVertexInputBindingDescription) { 0, sizeof(struct Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+    attributes[0] = (VkVertexInputAttributeDescription) { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(struct Vertex, position) };
+    attributes[1] = (VkVertexInputAttributeDescription) { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(struct Vertex, color) };
+
+    if (source == RENDER_INSTANCES)
+    {
+        bindings[1] = (VkVertexInputBindingDescription) { 1, sizeof(struct Instance), VK_VERTEX_INPUT_RATE_INSTANCE };
+        attributes[2] = (VkVertexInputAttributeDescription) { 2, 1, VK_FORMAT_R16G16B16A16_SNORM, offsetof(struct Instance, position) };
+        attributes[3] = (VkVertexInputAttributeDescription) { 3, 1, VK_FORMAT_R8G8B8A8_SNORM, offsetof(struct Instance, heading) };
+        attributes[4] = (VkVertexInputAttributeDescription) { 4, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(struct Instance, color) };
+        *attribute_count = 5;
+    }
+    else
+    {
+        bindings[1] = (VkVertexInputBindingDescription) { 1, sizeof(struct gpu_boid), VK_VERTEX_INPUT_RATE_INSTANCE };
+        attributes[2] = (VkVertexInputAttributeDescription) { 2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(struct gpu_boid, position) };
+        attributes[3] = (VkVertexInputAttributeDescription) { 3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(struct gpu_boid, velocity) };
+        *attribute_count = 4;
+    }
+}
+
+static int create_pipelines(struct renderer * r, VkPipelineCache pipeline_cache)
+{
+    VkPushConstantRange push_range = {0};
+    push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    push_range.size = sizeof(struct render_push);
+
+    VkPipelineLayoutCreateInfo layout_info = {0};
+    layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &r->set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_range;
+    if (vkCreatePipelineLayout(r->device, &layout_info, r->host, &r->layout) != VK_SUCCESS)
+    {
+        return 0;
+    }
+
+    VkShaderModule fragment = load_shader(r->device, r->host, SHADER_DIR "boid_color.spv");
+    if (fragment == VK_NULL_HANDLE) { return 0; }
+
+    // everything but the vertex stage is shared by both pipelines
+    VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // viewport and scissor are dynamic so resizing keeps the pipelines
+    VkPipelineViewportStateCreateInfo viewport = {0};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.viewportCount = 1;
+    viewport.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo raster = {0};
+    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster.polygonMode = VK_POLYGON_MODE_FILL;
+    raster.cullMode = VK_CULL_MODE_NONE;
+    raster.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    raster.lineWidth = 1.0f;
+
+    VkPipelineMultisampleStateCreateInfo multisample = {0};
+    multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depth = {0};
+    depth.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth.depthTestEnable = VK_TRUE;
+    depth.depthWriteEnable = VK_TRUE;
+    depth.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkPipelineColorBlendAttachmentState blend_attachment = {0};
+    blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+        VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo blend = {0};
+    blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blend.attachmentCount = 1;
+    blend.pAttachments = &blend_attachment;
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamic = {0};
+    dynamic.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic.dynamicStateCount = 2;
+    dynamic.pDynamicStates = dynamic_states;
+
+    int ok = 1;
+    for (int source = 0; ok && source < RENDER_SOURCES; source++)
+    {
+        VkShaderModule vertex = load_shader(r->device, r->host, vertex_shaders[source]);
+        if (vertex == VK_NULL_HANDLE) { ok = 0; break; }
+
+        VkPipelineShaderStageCreateInfo stages[2] = {{0}};
+        stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stages[0].module = vertex;
+        stages[0].pName = "main";
+        stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        stages[1].module = fragment;
+        stages[1].pName = "main";
+
+        VkVertexInputBindingDescription bindings[2];
+        VkVertexInputAttributeDescription attributes[5];
+        uint32_t attribute_count;
+        vertex_input(source, bindings, attributes, &attribute_count);
+
+        VkPipelineVertexInputStateCreateInfo input = {0};
+        input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        input.vertexBindingDescriptionCount = 2;
+        input.pVertexBindingDescriptions = bindings;
+        input.vertexAttributeDescriptionCount = attribute_count;
+        input.pVertexAttributeDescriptions = attributes;
+
+        VkGraphicsPipelineCreateInfo pipeline_info = {0};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeline_info.stageCount = 2;
+        pipeline_info.pStages = stages;
+        pipeline_info.pVertexInputState = &input;
+        pipeline_info.pInputAssemblyState = &input_assembly;
+        pipeline_info.pViewportState = &viewport;
+        pipeline_info.pRasterizationState = &raster;
+        pipeline_info.pMultisampleState = &multisample;
+        pipeline_info.pDepthStencilState = &depth;
+        pipeline_info.pColorBlendState = &blend;
+        pipeline_info.pDynamicState = &dynamic;
+        pipeline_info.layout = r->layout;
+        pipeline_info.renderPass = r->render_pass;
+
+        ok = vkCreateGraphicsPipelines(r->device, pipeline_cache, 1, &pipeline_info,
+                r->host, &r->pipelines[source]) == VK_SUCCESS;
+        vkDestroyShaderModule(r->device, vertex, r->host);
+    }
+
+    vkDestroyShaderModule(r->device, fragment, r->host);
+    return ok;
+}
+
+// upload the mesh through a staging buffer into device local memory
+static int create_mesh(struct renderer * r, VkCommandPool command_pool, VkQueue queue)
+{
+    VkDeviceSize vertex_size = sizeof(mesh_vertices);
+    VkDeviceSize size = vertex_size + sizeof(mesh_indices);
+    r->index_offset = vertex_size;
+    memcpy(r->lods, mesh_lods, sizeof(r->lods));
+
+    if (!gpu_create_buffer(r->allocator, size,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &r->mesh, &r->mesh_memory))
+    {
+        return 0;
+    }
+
+    VkBuffer staging;
+    struct gpu_allocation staging_memory;
+    if (!gpu_create_buffer(r->allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging, &staging_memory))
+    {
+        return 0;
+    }
+
+    memcpy(staging_memory.mapped, mesh_vertices, vertex_size);
+    memcpy(staging_memory.mapped + vertex_size, mesh_indices, sizeof(mesh_indices));
+
+    VkCommandBuffer command_buffer = begin_one_shot(r->device, command_pool);
+    if (command_buffer == VK_NULL_HANDLE)
+    {
+        gpu_destroy_buffer(r->allocator, staging, &staging_memory);
+        return 0;
+    }
+    VkBufferCopy region = { 0, 0, size };
+    vkCmdCopyBuffer(command_buffer, staging, r->mesh, 1, &region);
+    VkResult result = end_one_shot(r->device, command_pool, queue, command_buffer);
+
+    gpu_destroy_buffer(r->allocator, staging, &staging_memory);
+    return result == VK_SUCCESS;
+}
+
+int render_create(struct renderer * r, struct gpu_allocator * allocator,
+        VkDevice device, VkCommandPool command_pool, VkQueue queue,
+        VkPipelineCache pipeline_cache, VkFormat format, VkImageLayout final_layout, const struct boid_params * params)
+{
+    memset(r, 0, sizeof(struct renderer));
+    r->allocator = allocator;
+    r->device = device;
+    r->host = allocator->host;
+    r->format = format;
+    r->final_layout = final_layout;
+    memcpy(r->bounds, params->bounds, sizeof(r->bounds));
+    r->max_speed = params->max_speed;
+
+    if (!create_render_pass(r) ||
+        !create_descriptors(r) ||
+        !create_pipelines(r, pipeline_cache) ||
+        !create_mesh(r, command_pool, queue))
+    {
+        printf("Error: couldnt set up the renderer\n");
+        render_destroy(r);
+        return 0;
+    }
+
+    return 1;
+}
+
+void render_set_noise(struct renderer * r, const struct noise_texture * noise)
+{
+    r->noise = noise;
+
+    VkDescriptorImageInfo image_info = {0};
+    image_info.sampler = noise->sampler;
+    image_info.imageView = noise->view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write = {0};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = r->noise_set;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(r->device, 1, &write, 0, NULL);
+}
+
+// targets --------------------------------------------------------------------
+
+static void destroy_targets(struct renderer * r, struct render_targets * t)
+{
+    VkDevice device = r->device;
+    for (uint32_t i = 0; i < t->image_count; i++)
+    {
+        if (t->framebuffers[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyFramebuffer(device, t->framebuffers[i], r->host);
+        }
+        if (t->views[i] != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(device, t->views[i], r->host);
+        }
+    }
+    free(t->framebuffers);
+    free(t->views);
+
+    if (t->depth_view != VK_NULL_HANDLE) { vkDestroyImageView(device, t->depth_view, r->host); }
+    if (t->depth != VK_NULL_HANDLE) { vkDestroyImage(device, t->depth, r->host); }
+    gpu_free(r->allocator, &t->depth_memory);
+
+    memset(t, 0, sizeof(struct render_targets));
+}
+
+static VkImageView create_view(const struct renderer * r, VkImage image, VkFormat format,
+        VkImageAspectFlags aspect)
+{
+    VkImageViewCreateInfo view_info = {0};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = format;
+    view_info.subresourceRange.aspectMask = aspect;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView view = VK_NULL_HANDLE;
+    if (vkCreateImageView(r->device, &view_info, r->host, &view) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+    return view;
+}
+
+static int create_depth(struct renderer * r, struct render_targets * t)
+{
+    VkImageCreateInfo image_info = {0};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = DEPTH_FORMAT;
+    image_info.extent = (VkExtent3D) { t->extent.width, t->extent.height, 1 };
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (vkCreateImage(r->device, &image_info, r->host, &t->depth) != VK_SUCCESS)
+    {
+        t->depth = VK_NULL_HANDLE;
+        return 0;
+    }
+
+    if (!gpu_bind_image(r->allocator, t->depth, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                &t->depth_memory))
+    {
+        return 0;
+    }
+
+    t->depth_view = create_view(r, t->depth, DEPTH_FORMAT, VK_IMAGE_ASPECT_DEPTH_BIT);
+    return t->depth_view != VK_NULL_HANDLE;
+}
+
+int render_set_target(struct renderer * r, VkExtent2D extent,
+        const VkImage * images, uint32_t count, uint64_t serial)
+{
+    // no room to park the old set, wait for the oldest to go
+    if (r->retired_count == RENDER_MAX_RETIRED)
+    {
+        vkDeviceWaitIdle(r->device);
+        render_collect(r, UINT64_MAX);
+    }
+
+    struct render_targets t = {0};
+    t.extent = extent;
+    t.views = calloc(count, sizeof(VkImageView));
+    t.framebuffers = calloc(count, sizeof(VkFramebuffer));
+    if (t.views == NULL || t.framebuffers == NULL)
+    {
+        free(t.views);
+        free(t.framebuffers);
+        return 0;
+    }
+    t.image_count = count;
+
+    if (!create_depth(r, &t))
+    {
+        destroy_targets(r, &t);
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        t.views[i] = create_view(r, images[i], r->format, VK_IMAGE_ASPECT_COLOR_BIT);
+        if (t.views[i] == VK_NULL_HANDLE)
+        {
+            destroy_targets(r, &t);
+            return 0;
+        }
+
+        VkImageView attachments[2] = { t.views[i], t.depth_view };
+        VkFramebufferCreateInfo framebuffer_info = {0};
+        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_info.renderPass = r->render_pass;
+        framebuffer_info.attachmentCount = 2;
+        framebuffer_info.pAttachments = attachments;
+        framebuffer_info.width = extent.width;
+        framebuffer_info.height = extent.height;
+        framebuffer_info.layers = 1;
+        if (vkCreateFramebuffer(r->device, &framebuffer_info, r->host,
+                    &t.framebuffers[i]) != VK_SUCCESS)
+        {
+            t.framebuffers[i] = VK_NULL_HANDLE;
+            destroy_targets(r, &t);
+            return 0;
+        }
+    }
+
+    if (r->target.image_count > 0)
+    {
+        r->target.serial = serial;
+        r->retired[r->retired_count++] = r->target;
+    }
+    r->target = t;
+    return 1;
+}
+
+void render_collect(struct renderer * r, uint64_t completed)
+{
+    int kept = 0;
+    for (int i = 0; i < r->retired_count; i++)
+    {
+        if (r->retired[i].serial <= completed)
+        {
+            destroy_targets(r, &r->retired[i]);
+        }
+        else
+        {
+            r->retired[kept++] = r->retired[i];
+        }
+    }
+    r->retired_count = kept;
+}
+
+void render_destroy(struct renderer * r)
+{
+    if (r->device == VK_NULL_HANDLE) { return; }
+
+    render_collect(r, UINT64_MAX);
+    destroy_targets(r, &r->target);
+    for (int source = 0; source < RENDER_SOURCES; source++)
+    {
+        if (r->pipelines[source] != VK_NULL_HANDLE)
+        {
+            vkDestroyPipeline(r->device, r->pipelines[source], r->host);
+        }
+    }
+    if (r->layout != VK_NULL_HANDLE) { vkDestroyPipelineLayout(r->device, r->layout, r->host); }
+    if (r->descriptor_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(r->device, r->descriptor_pool, r->host);
+    }
+    if (r->set_layout != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(r->device, r->set_layout, r->host);
+    }
+    if (r->render_pass != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(r->device, r->render_pass, r->host);
+    }
+    gpu_destroy_buffer(r->allocator, r->mesh, &r->mesh_memory);
+
+    memset(r, 0, sizeof(struct renderer));
+}
+
+// drawing --------------------------------------------------------------------
+
+// begin the pass into image and bind what every draw of source shares
+static void begin_pass(struct renderer * r, VkCommandBuffer command_buffer,
+        uint32_t image, enum render_source source)
+{
+    VkClearValue clears[2];
+    clears[0].color = (VkClearColorValue) {{ 0.02f, 0.02f, 0.05f, 1.0f }};
+    clears[1].depthStencil = (VkClearDepthStencilValue) { 1.0f, 0 };
+
+    VkRenderPassBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    begin_info.renderPass = r->render_pass;
+    begin_info.framebuffer = r->target.framebuffers[image];
+    begin_info.renderArea.extent = r->target.extent;
+    begin_info.clearValueCount = 2;
+    begin_info.pClearValues = clears;
+    vkCmdBeginRenderPass(command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkExtent2D extent = r->target.extent;
+    VkViewport viewport = { 0.0f, 0.0f, (float) extent.width, (float) extent.height, 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, extent };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    struct render_push push;
+    render_camera(r, push.view_projection);
+    push.bounds[0] = r->bounds[0];
+    push.bounds[1] = r->bounds[1];
+    push.bounds[2] = r->bounds[2];
+    push.bounds[3] = RENDER_BOID_SCALE;
+    push.inv_max_speed = 1.0f / r->max_speed;
+
+    // the world stays inside the window by enough that linear filtering,
+    // which also reads the next texel, never reaches across the wrap
+    const struct noise_texture * noise = r->noise;
+    push.noise[0] = noise->scroll_x + 1.0f;
+    push.noise[1] = noise->scroll_y + 1.0f;
+    push.noise[2] = (float) (noise->size - 3);
+    push.noise[3] = 1.0f / noise->size;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->pipelines[source]);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, r->layout,
+            0, 1, &r->noise_set, 0, NULL);
+    vkCmdPushConstants(command_buffer, r->layout, VK_SHADER_STAGE_VERTEX_BIT,
+            0, sizeof(push), &push);
+    vkCmdBindIndexBuffer(command_buffer, r->mesh, r->index_offset, VK_INDEX_TYPE_UINT16);
+}
+
+// the mesh and instances at offset as the two vertex bindings
+static void bind_instances(struct renderer * r, VkCommandBuffer command_buffer,
+        VkBuffer instances, VkDeviceSize offset)
+{
+    VkBuffer buffers[2] = { r->mesh, instances };
+    VkDeviceSize offsets[2] = { 0, offset };
+    vkCmdBindVertexBuffers(command_buffer, 0, 2, buffers, offsets);
+}
+
+void render_record(struct renderer * r, VkCommandBuffer command_buffer,
+        uint32_t image, enum render_source source, VkBuffer instances,
+        VkDeviceSize offset, uint32_t count)
+{
+    begin_pass(r, command_buffer, image, source);
+    bind_instances(r, command_buffer, instances, offset);
+
+    // the whole flock in one draw
+    const struct render_mesh * mesh = &r->lods[RENDER_LOD_FULL];
+    vkCmdDrawIndexed(command_buffer, mesh->index_count, count, mesh->first_index,
+            mesh->vertex_offset, 0);
+
+    vkCmdEndRenderPass(command_buffer);
+}
+
+void render_record_culled(struct renderer * r, VkCommandBuffer command_buffer,
+        uint32_t image, enum render_source source, const struct cull * cull)
+{
+    begin_pass(r, command_buffer, image, source);
+
+    // each lod's instances start at its own offset, so the commands keep
+    // first instance 0 and single draws need no multi draw support
+    for (int lod = 0; lod < RENDER_LODS; lod++)
+    {
+        bind_instances(r, command_buffer, cull->instances, cull_offset(cull, lod));
+        vkCmdDrawIndexedIndirect(command_buffer, cull->draws,
+                sizeof(VkDrawIndexedIndirectCommand) * lod, 1,
+                sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    vkCmdEndRenderPass(command_buffer);
+}
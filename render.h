@@ -0,0 +1,147 @@
+/*
+   render.h
+   instanced boid drawing: one shared mesh, one draw for the whole flock,
+   or one per level of detail after a cull pass
+*/
+
+#ifndef RENDER
+#define RENDER
+
+#include <vulkan.h>
+
+#include "gpu_alloc.h"
+#include "noise_texture.h"
+
+#include "boids.h"
+#include "util.h"
+
+// where the per instance data of a draw comes from
+enum render_source
+{
+    RENDER_INSTANCES = 0,       // packed struct Instance records
+    RENDER_GPU_STATE,           // struct gpu_boid, the gpu flock's state
+    RENDER_SOURCES
+};
+
+// meshes a boid can be drawn with, nearest first
+enum render_lod
+{
+    RENDER_LOD_FULL = 0,        // the dart
+    RENDER_LOD_QUAD,            // a flat two triangle outline of it
+    RENDER_LODS
+};
+
+// mesh size in world units, no vertex is further than this from a boid
+#define RENDER_BOID_SCALE 0.6f
+
+// where a lod's indices are in the shared mesh buffer
+struct render_mesh
+{
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+};
+
+struct cull;
+
+// most replaced target sets waiting for their last frame to finish
+#define RENDER_MAX_RETIRED 4
+
+// views, depth buffer and framebuffers for one set of swapchain images
+struct render_targets
+{
+    VkExtent2D extent;
+    uint32_t image_count;
+    VkImageView * views;
+    VkFramebuffer * framebuffers;
+    VkImage depth;
+    struct gpu_allocation depth_memory;
+    VkImageView depth_view;
+    uint64_t serial;            // last frame that may use them, once retired
+};
+
+struct renderer
+{
+    struct gpu_allocator * allocator;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // the allocator's, for every object
+    VkFormat format;
+    VkImageLayout final_layout; // of the color target after a frame
+    float bounds[3];            // world size, to unpack instance positions
+    float max_speed;            // for colouring by speed
+
+    VkRenderPass render_pass;
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet noise_set;  // the wind field, see render_set_noise
+    VkPipelineLayout layout;
+    VkPipeline pipelines[RENDER_SOURCES];
+
+    // shared mesh, vertices then indices in one buffer
+    VkBuffer mesh;
+    struct gpu_allocation mesh_memory;
+    VkDeviceSize index_offset;
+    struct render_mesh lods[RENDER_LODS];
+
+    const struct noise_texture * noise;
+
+    // current targets, and replaced ones still in flight
+    struct render_targets target;
+    struct render_targets retired[RENDER_MAX_RETIRED];
+    int retired_count;
+};
+
+// render pass, pipelines and mesh for drawing a flock with params into
+// images of format, left in final_layout: VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+// for a swapchain or VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL to copy out.
+// pipelines come from pipeline_cache when it is not VK_NULL_HANDLE.
+// returns 0 on failure, after cleaning up
+int render_create(struct renderer * r, struct gpu_allocator * allocator,
+        VkDevice device, VkCommandPool command_pool, VkQueue queue,
+        VkPipelineCache pipeline_cache, VkFormat format, VkImageLayout final_layout, const struct boid_params * params);
+
+// build the views, depth buffer and framebuffers for count images of
+// extent. the ones they replace are kept until the frame with serial, the
+// last that may use them, is done, so resizing never waits for the device
+int render_set_target(struct renderer * r, VkExtent2D extent,
+        const VkImage * images, uint32_t count, uint64_t serial);
+
+// sample noise as the wind field. must be set before the first
+// render_record, and the texture must outlive the renderer
+void render_set_noise(struct renderer * r, const struct noise_texture * noise);
+
+// destroy retired targets whose frames are done, completed being the
+// serial of the latest finished frame
+void render_collect(struct renderer * r, uint64_t completed);
+
+// the device must be idle
+void render_destroy(struct renderer * r);
+
+// pack count boids of s into instance records
+void render_pack(struct Instance * out, const struct boid_state * s, int count,
+        const struct boid_params * params);
+
+// pack count boids at alpha of the way from the positions of prev to those
+// of s, 0 to 1, headed as in s
+void render_pack_lerp(struct Instance * out, const struct boid_state * prev,
+        const struct boid_state * s, int count, float alpha,
+        const struct boid_params * params);
+
+// the camera's view projection for the current target, returns the
+// pixels a world unit spans at unit distance from the eye
+float render_camera(const struct renderer * r, float view_projection[16]);
+
+// record a render pass into image that draws count instances of the mesh,
+// reading source records from instances at offset. the noise texture's
+// scroll for the frame must have been recorded before
+void render_record(struct renderer * r, VkCommandBuffer command_buffer,
+        uint32_t image, enum render_source source, VkBuffer instances,
+        VkDeviceSize offset, uint32_t count);
+
+// the same pass drawing what cull_record left in cull, one indirect draw
+// per lod whatever the flock size
+void render_record_culled(struct renderer * r, VkCommandBuffer command_buffer,
+        uint32_t image, enum render_source source, const struct cull * cull);
+
+
+#endif
@@ -0,0 +1,43 @@
+// shared declarations of the boid vertex shaders, mirrors render.c
+
+// filled by render.c, see struct render_push there
+layout(push_constant) uniform Params
+{
+    mat4 view_projection;
+    vec4 bounds;    // xyz world size, w mesh scale
+    vec4 noise;     // xy field position of the world's corner, z field
+                    // texels across the world, w 1 / texture size
+    float inv_max_speed;
+} params;
+
+// wind field, a window of the noise field addressed modulo its size
+layout(set = 0, binding = 0) uniform sampler2D wind_field;
+
+// mesh vertex, binding 0
+layout(location = 0) in vec3 vertex_position;
+layout(location = 1) in vec3 vertex_color;
+
+layout(location = 0) out vec3 frag_color;
+
+// wind strength 0 to 1 over the world's ground plane
+float wind(vec3 world)
+{
+    vec2 field = params.noise.xy + world.xz / params.bounds.xz * params.noise.z;
+    return textureLod(wind_field, (field + 0.5) * params.noise.w, 0.0).r;
+}
+
+// place the mesh vertex at world, pointing along heading
+void emit(vec3 world, vec3 heading, vec3 color)
+{
+    vec3 forward = dot(heading, heading) > 1e-6 ? normalize(heading) : vec3(0.0, 0.0, 1.0);
+    vec3 up = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 right = normalize(cross(forward, up));
+    up = cross(right, forward);
+
+    vec3 local = vertex_position * params.bounds.w;
+    vec3 p = world + right * local.x + up * local.y + forward * local.z;
+
+    gl_Position = params.view_projection * vec4(p, 1.0);
+    // boids in a gust are drawn brighter
+    frag_color = vertex_color * color * (0.6 + 0.8 * wind(world));
+}
@@ -0,0 +1,16 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// boid instances from packed struct Instance records, binding 1
+
+#include "boid_common.glsl"
+
+layout(location = 2) in vec4 instance_position;    // snorm16, world box on [-1, 1]
+layout(location = 3) in vec4 instance_heading;     // snorm8, w speed / max speed
+layout(location = 4) in vec4 instance_color;       // unorm8
+
+void main()
+{
+    vec3 world = (instance_position.xyz * 0.5 + 0.5) * params.bounds.xyz;
+    emit(world, instance_heading.xyz, instance_color.rgb);
+}
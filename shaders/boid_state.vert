@@ -0,0 +1,17 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+// boid instances straight from the gpu flock's state buffer, binding 1
+
+#include "boid_common.glsl"
+
+layout(location = 2) in vec4 instance_position;    // world units
+layout(location = 3) in vec4 instance_velocity;
+
+void main()
+{
+    // same speed colouring as render_pack
+    float t = clamp(length(instance_velocity.xyz) * params.inv_max_speed, 0.0, 1.0);
+    vec3 color = vec3(0.2 + 0.8 * t, 0.5, 1.0 - 0.8 * t);
+    emit(instance_position.xyz, instance_velocity.xyz, color);
+}
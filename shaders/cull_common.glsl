@@ -0,0 +1,87 @@
+// shared declarations of the cull passes, mirrors cull.c
+
+layout(local_size_x = 256) in;
+
+// filled by cull.c, see struct cull_push there
+layout(push_constant) uniform Params
+{
+    mat4 view_projection;
+    vec4 bounds;    // xyz world size, w bounding radius of a boid
+    vec4 lod;       // x pixels per world unit at unit distance, y radius in
+                    // pixels below which a boid is skipped, z below which
+                    // it is a quad, w unused
+    uvec4 range;    // x boid count, y first input record, z output records
+                    // per lod
+} params;
+
+// a VkDrawIndexedIndirectCommand per drawn lod, five words each, then the
+// count of boids too small to draw
+layout(std430, set = 0, binding = 2) buffer Draws { uint draws[]; };
+
+#define LOD_FULL 0u
+#define LOD_QUAD 1u
+#define LOD_SMALL 2u    // in view, under a pixel
+#define LOD_CULLED 3u   // out of view
+#define DRAW_WORDS 5u
+
+shared uint group_count[3];
+shared uint group_base[3];
+
+// row i of the view projection
+vec3 row(int i)
+{
+    return vec3(params.view_projection[0][i], params.view_projection[1][i],
+                params.view_projection[2][i]);
+}
+
+// a sphere is on the inner side of a plane, distance being the plane's
+// unnormalized equation at the centre
+bool inside(float distance, vec3 normal, float radius)
+{
+    return distance >= -radius * length(normal);
+}
+
+// which lod a boid at world is drawn with, if any
+uint choose_lod(vec3 world)
+{
+    float r = params.bounds.w;
+    vec4 clip = params.view_projection * vec4(world, 1.0);
+
+    // the frustum planes are sums of the matrix rows, depth runs 0 to 1
+    bool visible =
+        inside(clip.w + clip.x, row(3) + row(0), r) &&
+        inside(clip.w - clip.x, row(3) - row(0), r) &&
+        inside(clip.w + clip.y, row(3) + row(1), r) &&
+        inside(clip.w - clip.y, row(3) - row(1), r) &&
+        inside(clip.z, row(2), r) &&
+        inside(clip.w - clip.z, row(3) - row(2), r);
+    if (!visible) { return LOD_CULLED; }
+
+    // clip w is the distance in front of the eye, a boid reaching behind
+    // it is close enough for the full mesh
+    float pixels = clip.w > r ? r * params.lod.x / clip.w : params.lod.z;
+    if (pixels < params.lod.y) { return LOD_SMALL; }
+    return pixels < params.lod.z ? LOD_QUAD : LOD_FULL;
+}
+
+// this invocation's slot among the boids of its lod. the group counts in
+// shared memory first, so only one atomic per lod per group reaches the
+// draw commands. every invocation of the group must call it
+uint compact(uint lod)
+{
+    uint local = gl_LocalInvocationIndex;
+    if (local < 3u) { group_count[local] = 0u; }
+    barrier();
+
+    uint slot = lod < 3u ? atomicAdd(group_count[lod], 1u) : 0u;
+    barrier();
+
+    if (local < 3u && group_count[local] > 0u)
+    {
+        uint counter = local < LOD_SMALL ? local * DRAW_WORDS + 1u : LOD_SMALL * DRAW_WORDS;
+        group_base[local] = atomicAdd(draws[counter], group_count[local]);
+    }
+    barrier();
+
+    return lod < 3u ? group_base[lod] + slot : 0u;
+}
@@ -0,0 +1,33 @@
+// shared declarations of the flock compute passes, mirrors boids.c
+
+struct Boid
+{
+    vec4 position;  // xyz, w unused
+    vec4 velocity;  // xyz, w unused
+};
+
+// filled by gpu_flock.c, see struct flock_push there
+layout(push_constant) uniform Params
+{
+    vec4 bounds;    // xyz world size, w 1 / cell edge
+    ivec4 dims;     // xyz cells per axis, w boid count
+    vec4 limits;    // x neighbour radius^2, y separation radius^2, z min speed, w max speed
+    vec4 weights;   // x separation, y alignment, z cohesion, w dt
+} params;
+
+layout(std430, set = 0, binding = 0) readonly buffer StateIn { Boid state_in[]; };
+layout(std430, set = 0, binding = 1) writeonly buffer StateOut { Boid state_out[]; };
+layout(std430, set = 0, binding = 2) buffer Sorted { Boid sorted[]; };
+layout(std430, set = 0, binding = 3) buffer CellCount { uint cell_count[]; };
+layout(std430, set = 0, binding = 4) buffer CellStart { uint cell_start[]; };
+layout(std430, set = 0, binding = 5) buffer BoidCell { uvec2 boid_cell[]; };
+
+ivec3 cell_coords(vec3 p)
+{
+    return clamp(ivec3(p * params.bounds.w), ivec3(0), params.dims.xyz - 1);
+}
+
+uint cell_index(ivec3 c)
+{
+    return uint((c.z * params.dims.y + c.y) * params.dims.x + c.x);
+}
@@ -0,0 +1,224 @@
+/*
+   sim_thread.c
+   the cpu flock stepped at a fixed timestep on its own thread
+
+   step n is due dt * n after the start. the thread sleeps until a step is
+   due, steps, copies the state into its back slot and swaps that into the
+   middle of the triple buffer. a slow step makes the next ones run back
+   to back until the thread has caught up, at most SIM_MAX_LAG of them.
+   the reader swaps its front slot with the middle whenever something new
+   is there, so it always draws the newest step and never waits for one
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "profile.h"
+#include "sim_thread.h"
+
+// set on the middle slot index while the reader has not taken it
+#define SIM_FRESH 4u
+
+// slots --------------------------------------------------------------------
+
+static float * alloc_array(int count)
+{
+    size_t bytes = sizeof(float) * (size_t) count;
+    bytes = (bytes + BOIDS_ALIGN - 1) / BOIDS_ALIGN * BOIDS_ALIGN;
+    return aligned_alloc(BOIDS_ALIGN, bytes ? bytes : BOIDS_ALIGN);
+}
+
+static int frame_alloc(struct sim_frame * f, int count)
+{
+    memset(f, 0, sizeof(struct sim_frame));
+    f->state.px = alloc_array(count);
+    f->state.py = alloc_array(count);
+    f->state.pz = alloc_array(count);
+    f->state.vx = alloc_array(count);
+    f->state.vy = alloc_array(count);
+    f->state.vz = alloc_array(count);
+    f->prev.px = alloc_array(count);
+    f->prev.py = alloc_array(count);
+    f->prev.pz = alloc_array(count);
+    return f->state.px && f->state.py && f->state.pz && f->state.vx &&
+        f->state.vy && f->state.vz && f->prev.px && f->prev.py && f->prev.pz;
+}
+
+static void frame_free(struct sim_frame * f)
+{
+    free(f->state.px); free(f->state.py); free(f->state.pz);
+    free(f->state.vx); free(f->state.vy); free(f->state.vz);
+    free(f->prev.px); free(f->prev.py); free(f->prev.pz);
+    memset(f, 0, sizeof(struct sim_frame));
+}
+
+// copy the flock into f, prev being the state the last step started from
+static void frame_fill(struct sim_frame * f, const struct boids * boids,
+        const struct boid_state * prev, uint64_t step, uint64_t due_ns)
+{
+    const struct boid_state * s = boids_current(boids);
+    size_t bytes = sizeof(float) * (size_t) boids->count;
+    memcpy(f->state.px, s->px, bytes);
+    memcpy(f->state.py, s->py, bytes);
+    memcpy(f->state.pz, s->pz, bytes);
+    memcpy(f->state.vx, s->vx, bytes);
+    memcpy(f->state.vy, s->vy, bytes);
+    memcpy(f->state.vz, s->vz, bytes);
+    memcpy(f->prev.px, prev->px, bytes);
+    memcpy(f->prev.py, prev->py, bytes);
+    memcpy(f->prev.pz, prev->pz, bytes);
+    f->step = step;
+    f->due_ns = due_ns;
+}
+
+// the back slot becomes the middle one, the old middle the back. if the
+// reader never took the old middle, that step was never drawn
+static void publish(struct sim_thread * s)
+{
+    unsigned old = atomic_exchange_explicit(&s->middle, s->back | SIM_FRESH,
+            memory_order_acq_rel);
+    s->back = old & ~SIM_FRESH;
+    if (old & SIM_FRESH)
+    {
+        atomic_fetch_add_explicit(&s->unseen, 1, memory_order_relaxed);
+    }
+}
+
+// thread -------------------------------------------------------------------
+
+static void sleep_until(uint64_t ns)
+{
+    struct timespec t = { (time_t) (ns / 1000000000u), (long) (ns % 1000000000u) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0) { }
+}
+
+static void * sim_main(void * arg)
+{
+    struct sim_thread * s = arg;
+    uint64_t dt_ns = (uint64_t) (s->dt * 1e9);
+    uint64_t step = 0;
+
+    // slot 0 holds the start until the reader takes a first published frame
+    uint64_t due = s->slots[0].due_ns + dt_ns;
+
+    while (atomic_load_explicit(&s->running, memory_order_relaxed))
+    {
+        uint64_t now = profile_now();
+        if (now < due)
+        {
+            sleep_until(due);
+        }
+        else if (now - due > SIM_MAX_LAG * dt_ns)
+        {
+            uint64_t behind = (now - due) / dt_ns;
+            atomic_fetch_add_explicit(&s->dropped, behind, memory_order_relaxed);
+            due += behind * dt_ns;
+        }
+
+        // the step reads the current state and writes the other, so the
+        // one it started from is still there to blend from afterwards
+        const struct boid_state * from = boids_current(s->boids);
+        uint64_t t = profile_begin();
+        if (!boids_step(s->boids, &s->params, s->dt, s->pool))
+        {
+            atomic_store(&s->failed, 1);
+            break;
+        }
+        profile_end(PROFILE_SIMULATE, t);
+
+        frame_fill(&s->slots[s->back], s->boids, from, ++step, due);
+        publish(s);
+        atomic_fetch_add_explicit(&s->steps, 1, memory_order_relaxed);
+
+        due += dt_ns;
+        if (profile_now() > due)
+        {
+            atomic_fetch_add_explicit(&s->overruns, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+// public api ---------------------------------------------------------------
+
+int sim_thread_start(struct sim_thread * s, struct boids * boids,
+        const struct boid_params * params, float dt, struct pool * pool)
+{
+    memset(s, 0, sizeof(struct sim_thread));
+    s->boids = boids;
+    s->params = *params;
+    s->dt = dt;
+    s->pool = pool;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!frame_alloc(&s->slots[i], boids->count))
+        {
+            printf("Error: couldnt allocate simulation frames for %d boids\n", boids->count);
+            sim_thread_stop(s);
+            return 0;
+        }
+    }
+
+    // the reader starts with the starting state, standing still
+    frame_fill(&s->slots[0], boids, boids_current(boids), 0, profile_now());
+    s->front = 0;
+    atomic_init(&s->middle, 1);
+    s->back = 2;
+
+    atomic_store(&s->running, 1);
+    if (pthread_create(&s->thread, NULL, sim_main, s) != 0)
+    {
+        printf("Error: couldnt start the simulation thread\n");
+        atomic_store(&s->running, 0);
+        sim_thread_stop(s);
+        return 0;
+    }
+    return 1;
+}
+
+void sim_thread_stop(struct sim_thread * s)
+{
+    if (atomic_exchange(&s->running, 0)) { pthread_join(s->thread, NULL); }
+    for (int i = 0; i < 3; i++) { frame_free(&s->slots[i]); }
+}
+
+const struct sim_frame * sim_thread_latest(struct sim_thread * s, float * alpha)
+{
+    s->reads++;
+    if (atomic_load_explicit(&s->middle, memory_order_relaxed) & SIM_FRESH)
+    {
+        // only this side clears the flag, so the exchange takes a fresh slot
+        unsigned old = atomic_exchange_explicit(&s->middle, s->front, memory_order_acq_rel);
+        s->front = old & ~SIM_FRESH;
+    }
+    else
+    {
+        s->stale++;
+    }
+
+    // display runs one step behind, reaching the frame's state when the
+    // step after it falls due
+    const struct sim_frame * f = &s->slots[s->front];
+    uint64_t now = profile_now();
+    float a = now > f->due_ns ? (float) ((now - f->due_ns) * 1e-9 / s->dt) : 0.0f;
+    *alpha = a < 1.0f ? a : 1.0f;
+    return f;
+}
+
+int sim_thread_ok(const struct sim_thread * s)
+{
+    return !atomic_load(&s->failed);
+}
+
+void sim_thread_get_stats(const struct sim_thread * s, struct sim_thread_stats * stats)
+{
+    stats->steps = atomic_load_explicit(&s->steps, memory_order_relaxed);
+    stats->overruns = atomic_load_explicit(&s->overruns, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&s->dropped, memory_order_relaxed);
+    stats->unseen = atomic_load_explicit(&s->unseen, memory_order_relaxed);
+    stats->reads = s->reads;
+    stats->stale = s->stale;
+}
@@ -0,0 +1,83 @@
+/*
+   sim_thread.h
+   the cpu flock stepped at a fixed timestep on its own thread
+*/
+
+#ifndef SIM_THREAD
+#define SIM_THREAD
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "boids.h"
+#include "pool.h"
+
+// steps due further back than this are dropped rather than caught up on,
+// so a long stall does not turn into a burst of back to back steps
+#define SIM_MAX_LAG 4
+
+// one published step: the state after it and the positions before, so a
+// reader can blend between the two
+struct sim_frame
+{
+    struct boid_state state;    // count boids after the step
+    struct boid_state prev;     // positions before it, velocities NULL
+    uint64_t step;              // steps taken, 0 for the starting state
+    uint64_t due_ns;            // when the step was due, profile_now clock
+};
+
+struct sim_thread_stats
+{
+    uint64_t steps;
+    uint64_t overruns;          // steps that ended after the next was due
+    uint64_t dropped;           // steps given up on, see SIM_MAX_LAG
+    uint64_t unseen;            // published frames replaced before a read
+    uint64_t reads;
+    uint64_t stale;             // reads with nothing newer than the last
+};
+
+// the simulation owns boids while running. frames go through three slots:
+// the thread fills its back slot, then swaps it with the middle one in a
+// single atomic exchange, marking it fresh. a reader takes the middle slot
+// the same way only when it is fresh. neither side ever waits on the other
+struct sim_thread
+{
+    struct boids * boids;
+    struct boid_params params;
+    float dt;
+    struct pool * pool;
+
+    pthread_t thread;
+    atomic_int running;
+    atomic_int failed;          // a step ran out of memory
+
+    struct sim_frame slots[3];
+    _Atomic unsigned middle;    // slot index, | SIM_FRESH when unread
+    unsigned back;              // the thread's
+    unsigned front;             // the reader's
+
+    _Atomic uint64_t steps, overruns, dropped, unseen;
+    uint64_t reads, stale;      // reader side only
+};
+
+// publish the current state of boids as step 0 and start stepping it by dt
+// seconds every dt seconds over pool (or NULL). returns 0 on failure
+int sim_thread_start(struct sim_thread * s, struct boids * boids,
+        const struct boid_params * params, float dt, struct pool * pool);
+
+// stop and join the thread, boids hold the last step taken
+void sim_thread_stop(struct sim_thread * s);
+
+// the newest published frame, without blocking. it stays untouched until
+// the next call. alpha is how far display time, one step behind, has got
+// from the frame's prev positions to its state, 0 to 1
+const struct sim_frame * sim_thread_latest(struct sim_thread * s, float * alpha);
+
+// returns 0 once a step has failed and the thread has stopped stepping
+int sim_thread_ok(const struct sim_thread * s);
+
+void sim_thread_get_stats(const struct sim_thread * s, struct sim_thread_stats * stats);
+
+
+#endif
@@ -0,0 +1,28 @@
+/*
+   simd.c
+   runtime detection of the vector instruction sets our kernels can use
+*/
+
+#include "simd.h"
+
+// best level the cpu we are running on supports
+enum simd_level simd_detect(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) { return SIMD_AVX2; }
+    if (__builtin_cpu_supports("sse2")) { return SIMD_SSE2; }
+#endif
+    return SIMD_SCALAR;
+}
+
+// human readable name of a level
+const char * simd_name(enum simd_level level)
+{
+    switch (level)
+    {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default:        return "scalar";
+    }
+}
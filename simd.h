@@ -0,0 +1,24 @@
+/*
+   simd.h
+   runtime detection of the vector instruction sets our kernels can use
+*/
+
+#ifndef SIMD
+#define SIMD
+
+// instruction sets, ordered so a higher level implies the lower ones
+enum simd_level
+{
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+// best level the cpu we are running on supports
+enum simd_level simd_detect(void);
+
+// human readable name of a level, ie "avx2"
+const char * simd_name(enum simd_level level);
+
+
+#endif
@@ -0,0 +1,381 @@
+/*
+   simplex.c
+   3D simplex noise, time as the third axis, for animating 2D fields
+
+   after Stefan Gustavson's "Simplex noise demystified". space is skewed so
+   the cube lattice becomes tetrahedra, and a sample only sums the radial
+   falloff of the 4 corners of its tetrahedron. the corner order is picked
+   with comparison masks instead of branches, so the scalar path and the
+   vector kernels take the same steps in the same order
+*/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "simplex.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMPLEX_X86
+#endif
+
+#define F3 (1.0f / 3.0f)        // skew
+#define G3 (1.0f / 6.0f)        // unskew
+#define G3_2 (2.0f / 6.0f)
+#define G3_3 0.5f
+#define RADIUS 0.6f             // squared falloff radius of a corner
+#define SCALE 32.0f             // brings the sum to about -1 to 1
+
+// samples per simplex3_fill_grid batch
+#define FILL_BATCH 64
+
+// midpoints of the cube's 12 edges, padded to 16 so a hash needs & not %
+// and to 4 floats each so a vector gather indexes them with a shift
+static const float gradients3[16][4] =
+{
+    {  1,  1,  0, 0 }, { -1,  1,  0, 0 }, {  1, -1,  0, 0 }, { -1, -1,  0, 0 },
+    {  1,  0,  1, 0 }, { -1,  0,  1, 0 }, {  1,  0, -1, 0 }, { -1,  0, -1, 0 },
+    {  0,  1,  1, 0 }, {  0, -1,  1, 0 }, {  0,  1, -1, 0 }, {  0, -1, -1, 0 },
+    {  1,  1,  0, 0 }, {  0, -1,  1, 0 }, { -1,  1,  0, 0 }, {  0, -1, -1, 0 }
+};
+
+// scalar ----------------------------------------------------------------------
+
+static inline int fast_floor(float v)
+{
+    int i = (int) v;
+    return i - (v < (float) i);
+}
+
+// gradient of lattice point i, j, k, all already & 255 plus at most 1
+static inline int hash3(const perlin_ctx * ctx, int i, int j, int k)
+{
+    return ctx->perm[i + ctx->perm[j + ctx->perm[k]]] & 15;
+}
+
+// falloff of the corner at offset x, y, t times its gradient's dot product
+static inline float corner(int g, float x, float y, float t)
+{
+    float w = RADIUS - x * x - y * y - t * t;
+    w = w > 0.0f ? w : 0.0f;
+    w = w * w;
+    return w * w * (gradients3[g][0] * x + gradients3[g][1] * y + gradients3[g][2] * t);
+}
+
+float simplex3_raw(const perlin_ctx * ctx, float y, float x, float t)
+{
+    // skew into the cube lattice to find the cell
+    float s = (x + y + t) * F3;
+    int i = fast_floor(x + s);
+    int j = fast_floor(y + s);
+    int k = fast_floor(t + s);
+
+    // and back, for the offset from the cell's origin corner
+    float u = (float) (i + j + k) * G3;
+    float x0 = x - ((float) i - u);
+    float y0 = y - ((float) j - u);
+    float t0 = t - ((float) k - u);
+
+    // which of the 6 tetrahedra: walk the axes from largest offset down
+    int xy = x0 >= y0, yt = y0 >= t0, xt = x0 >= t0;
+    int i1 = xy & xt, j1 = (!xy) & yt, k1 = (!xt) & (!yt);
+    int i2 = xy | xt, j2 = (!xy) | yt, k2 = (!xt) | (!yt);
+
+    float x1 = x0 - (float) i1 + G3, y1 = y0 - (float) j1 + G3, t1 = t0 - (float) k1 + G3;
+    float x2 = x0 - (float) i2 + G3_2, y2 = y0 - (float) j2 + G3_2, t2 = t0 - (float) k2 + G3_2;
+    float x3 = x0 - 1.0f + G3_3, y3 = y0 - 1.0f + G3_3, t3 = t0 - 1.0f + G3_3;
+
+    int ii = i & 255, jj = j & 255, kk = k & 255;
+    float n0 = corner(hash3(ctx, ii, jj, kk), x0, y0, t0);
+    float n1 = corner(hash3(ctx, ii + i1, jj + j1, kk + k1), x1, y1, t1);
+    float n2 = corner(hash3(ctx, ii + i2, jj + j2, kk + k2), x2, y2, t2);
+    float n3 = corner(hash3(ctx, ii + 1, jj + 1, kk + 1), x3, y3, t3);
+
+    return SCALE * (n0 + n1 + n2 + n3);
+}
+
+static inline int quantize(float raw)
+{
+    int v = (int) ((raw + 1.0f) * 0.5f * 255.0f);
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+int simplex3(const perlin_ctx * ctx, int y, int x, float t)
+{
+    return quantize(simplex3_raw(ctx, (y + 0.5f) / 8, (x + 0.5f) / 8, t));
+}
+
+static void raw_batch_scalar(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, const float * ts, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = simplex3_raw(ctx, ys[i], xs[i], ts[i]);
+    }
+}
+
+#ifdef SIMPLEX_X86
+
+// sse2 kernel, 4 samples per iteration --------------------------------------
+
+static inline __m128i floor_sse2(__m128 v)
+{
+    // truncation rounds negatives up, step those back one
+    __m128i i = _mm_cvttps_epi32(v);
+    __m128i above = _mm_castps_si128(_mm_cmplt_ps(v, _mm_cvtepi32_ps(i)));
+    return _mm_add_epi32(i, above);
+}
+
+// hash each lane one by one, sse2 has no gather, and load its gradient
+static inline void gradient_sse2(const perlin_ctx * ctx, __m128i i, __m128i j, __m128i k,
+        __m128 * gx, __m128 * gy, __m128 * gt)
+{
+    int32_t ia[4], ja[4], ka[4];
+    _mm_storeu_si128((__m128i *) ia, i);
+    _mm_storeu_si128((__m128i *) ja, j);
+    _mm_storeu_si128((__m128i *) ka, k);
+
+    const float * g[4];
+    for (int l = 0; l < 4; l++)
+    {
+        g[l] = gradients3[hash3(ctx, ia[l], ja[l], ka[l])];
+    }
+    *gx = _mm_setr_ps(g[0][0], g[1][0], g[2][0], g[3][0]);
+    *gy = _mm_setr_ps(g[0][1], g[1][1], g[2][1], g[3][1]);
+    *gt = _mm_setr_ps(g[0][2], g[1][2], g[2][2], g[3][2]);
+}
+
+static inline __m128 corner_sse2(__m128 gx, __m128 gy, __m128 gt,
+        __m128 x, __m128 y, __m128 t)
+{
+    __m128 w = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(RADIUS),
+                    _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(t, t));
+    w = _mm_max_ps(w, _mm_setzero_ps());
+    w = _mm_mul_ps(w, w);
+    __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gy, y)), _mm_mul_ps(gt, t));
+    return _mm_mul_ps(_mm_mul_ps(w, w), dot);
+}
+
+static void raw_batch_sse2(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, const float * ts, int n)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i mask = _mm_set1_epi32(255);
+    const __m128 g1 = _mm_set1_ps(G3), g2 = _mm_set1_ps(G3_2), g3 = _mm_set1_ps(G3_3);
+    const __m128 onef = _mm_set1_ps(1.0f);
+    int n4 = 0;
+
+    for (; n4 + 4 <= n; n4 += 4)
+    {
+        __m128 y = _mm_loadu_ps(ys + n4);
+        __m128 x = _mm_loadu_ps(xs + n4);
+        __m128 t = _mm_loadu_ps(ts + n4);
+
+        __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, y), t), _mm_set1_ps(F3));
+        __m128i i = floor_sse2(_mm_add_ps(x, s));
+        __m128i j = floor_sse2(_mm_add_ps(y, s));
+        __m128i k = floor_sse2(_mm_add_ps(t, s));
+
+        __m128 u = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), g1);
+        __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), u));
+        __m128 y0 = _mm_sub_ps(y, _mm_sub_ps(_mm_cvtepi32_ps(j), u));
+        __m128 t0 = _mm_sub_ps(t, _mm_sub_ps(_mm_cvtepi32_ps(k), u));
+
+        __m128i xy = _mm_castps_si128(_mm_cmpge_ps(x0, y0));
+        __m128i yt = _mm_castps_si128(_mm_cmpge_ps(y0, t0));
+        __m128i xt = _mm_castps_si128(_mm_cmpge_ps(x0, t0));
+        __m128i i1 = _mm_and_si128(_mm_and_si128(xy, xt), one);
+        __m128i j1 = _mm_and_si128(_mm_andnot_si128(xy, yt), one);
+        __m128i k1 = _mm_andnot_si128(_mm_or_si128(xt, yt), one);
+        __m128i i2 = _mm_and_si128(_mm_or_si128(xy, xt), one);
+        __m128i j2 = _mm_andnot_si128(_mm_andnot_si128(yt, xy), one);
+        __m128i k2 = _mm_andnot_si128(_mm_and_si128(xt, yt), one);
+
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), g1);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), g1);
+        __m128 t1 = _mm_add_ps(_mm_sub_ps(t0, _mm_cvtepi32_ps(k1)), g1);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i2)), g2);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j2)), g2);
+        __m128 t2 = _mm_add_ps(_mm_sub_ps(t0, _mm_cvtepi32_ps(k2)), g2);
+        __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, onef), g3);
+        __m128 y3 = _mm_add_ps(_mm_sub_ps(y0, onef), g3);
+        __m128 t3 = _mm_add_ps(_mm_sub_ps(t0, onef), g3);
+
+        __m128i ii = _mm_and_si128(i, mask);
+        __m128i jj = _mm_and_si128(j, mask);
+        __m128i kk = _mm_and_si128(k, mask);
+
+        __m128 gx, gy, gt, n0, n1, n2, n3;
+        gradient_sse2(ctx, ii, jj, kk, &gx, &gy, &gt);
+        n0 = corner_sse2(gx, gy, gt, x0, y0, t0);
+        gradient_sse2(ctx, _mm_add_epi32(ii, i1), _mm_add_epi32(jj, j1),
+                _mm_add_epi32(kk, k1), &gx, &gy, &gt);
+        n1 = corner_sse2(gx, gy, gt, x1, y1, t1);
+        gradient_sse2(ctx, _mm_add_epi32(ii, i2), _mm_add_epi32(jj, j2),
+                _mm_add_epi32(kk, k2), &gx, &gy, &gt);
+        n2 = corner_sse2(gx, gy, gt, x2, y2, t2);
+        gradient_sse2(ctx, _mm_add_epi32(ii, one), _mm_add_epi32(jj, one),
+                _mm_add_epi32(kk, one), &gx, &gy, &gt);
+        n3 = corner_sse2(gx, gy, gt, x3, y3, t3);
+
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(n0, n1), n2), n3);
+        _mm_storeu_ps(out + n4, _mm_mul_ps(_mm_set1_ps(SCALE), sum));
+    }
+
+    raw_batch_scalar(ctx, out + n4, ys + n4, xs + n4, ts + n4, n - n4);
+}
+
+// avx2 kernel, 8 samples per iteration --------------------------------------
+
+__attribute__((target("avx2")))
+static inline __m256i floor_avx2(__m256 v)
+{
+    __m256i i = _mm256_cvttps_epi32(v);
+    __m256i above = _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_cvtepi32_ps(i), _CMP_LT_OQ));
+    return _mm256_add_epi32(i, above);
+}
+
+// three dependent byte gathers for the hash, see gather_avx2 in
+// perlin_simd.c, then the gradient's components gathered by row
+__attribute__((target("avx2")))
+static inline void gradient_avx2(const perlin_ctx * ctx, __m256i i, __m256i j, __m256i k,
+        __m256 * gx, __m256 * gy, __m256 * gt)
+{
+    const __m256i mask = _mm256_set1_epi32(255);
+    const int * perm = (const int *) ctx->perm;
+
+    __m256i h = _mm256_and_si256(_mm256_i32gather_epi32(perm, k, 1), mask);
+    h = _mm256_and_si256(_mm256_i32gather_epi32(perm, _mm256_add_epi32(j, h), 1), mask);
+    h = _mm256_i32gather_epi32(perm, _mm256_add_epi32(i, h), 1);
+
+    __m256i row = _mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(15)), 2);
+    const float * g = &gradients3[0][0];
+    *gx = _mm256_i32gather_ps(g, row, 4);
+    *gy = _mm256_i32gather_ps(g + 1, row, 4);
+    *gt = _mm256_i32gather_ps(g + 2, row, 4);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 corner_avx2(__m256 gx, __m256 gy, __m256 gt,
+        __m256 x, __m256 y, __m256 t)
+{
+    __m256 w = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(RADIUS),
+                    _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_mul_ps(t, t));
+    w = _mm256_max_ps(w, _mm256_setzero_ps());
+    w = _mm256_mul_ps(w, w);
+    __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gy, y)),
+            _mm256_mul_ps(gt, t));
+    return _mm256_mul_ps(_mm256_mul_ps(w, w), dot);
+}
+
+__attribute__((target("avx2")))
+static void raw_batch_avx2(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, const float * ts, int n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256 g1 = _mm256_set1_ps(G3), g2 = _mm256_set1_ps(G3_2), g3 = _mm256_set1_ps(G3_3);
+    const __m256 onef = _mm256_set1_ps(1.0f);
+    int n8 = 0;
+
+    for (; n8 + 8 <= n; n8 += 8)
+    {
+        __m256 y = _mm256_loadu_ps(ys + n8);
+        __m256 x = _mm256_loadu_ps(xs + n8);
+        __m256 t = _mm256_loadu_ps(ts + n8);
+
+        __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, y), t), _mm256_set1_ps(F3));
+        __m256i i = floor_avx2(_mm256_add_ps(x, s));
+        __m256i j = floor_avx2(_mm256_add_ps(y, s));
+        __m256i k = floor_avx2(_mm256_add_ps(t, s));
+
+        __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(
+                    _mm256_add_epi32(_mm256_add_epi32(i, j), k)), g1);
+        __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), u));
+        __m256 y0 = _mm256_sub_ps(y, _mm256_sub_ps(_mm256_cvtepi32_ps(j), u));
+        __m256 t0 = _mm256_sub_ps(t, _mm256_sub_ps(_mm256_cvtepi32_ps(k), u));
+
+        __m256i xy = _mm256_castps_si256(_mm256_cmp_ps(x0, y0, _CMP_GE_OQ));
+        __m256i yt = _mm256_castps_si256(_mm256_cmp_ps(y0, t0, _CMP_GE_OQ));
+        __m256i xt = _mm256_castps_si256(_mm256_cmp_ps(x0, t0, _CMP_GE_OQ));
+        __m256i i1 = _mm256_and_si256(_mm256_and_si256(xy, xt), one);
+        __m256i j1 = _mm256_and_si256(_mm256_andnot_si256(xy, yt), one);
+        __m256i k1 = _mm256_andnot_si256(_mm256_or_si256(xt, yt), one);
+        __m256i i2 = _mm256_and_si256(_mm256_or_si256(xy, xt), one);
+        __m256i j2 = _mm256_andnot_si256(_mm256_andnot_si256(yt, xy), one);
+        __m256i k2 = _mm256_andnot_si256(_mm256_and_si256(xt, yt), one);
+
+        __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i1)), g1);
+        __m256 y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j1)), g1);
+        __m256 t1 = _mm256_add_ps(_mm256_sub_ps(t0, _mm256_cvtepi32_ps(k1)), g1);
+        __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_cvtepi32_ps(i2)), g2);
+        __m256 y2 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_cvtepi32_ps(j2)), g2);
+        __m256 t2 = _mm256_add_ps(_mm256_sub_ps(t0, _mm256_cvtepi32_ps(k2)), g2);
+        __m256 x3 = _mm256_add_ps(_mm256_sub_ps(x0, onef), g3);
+        __m256 y3 = _mm256_add_ps(_mm256_sub_ps(y0, onef), g3);
+        __m256 t3 = _mm256_add_ps(_mm256_sub_ps(t0, onef), g3);
+
+        __m256i ii = _mm256_and_si256(i, mask);
+        __m256i jj = _mm256_and_si256(j, mask);
+        __m256i kk = _mm256_and_si256(k, mask);
+
+        __m256 gx, gy, gt, n0, n1, n2, n3;
+        gradient_avx2(ctx, ii, jj, kk, &gx, &gy, &gt);
+        n0 = corner_avx2(gx, gy, gt, x0, y0, t0);
+        gradient_avx2(ctx, _mm256_add_epi32(ii, i1), _mm256_add_epi32(jj, j1),
+                _mm256_add_epi32(kk, k1), &gx, &gy, &gt);
+        n1 = corner_avx2(gx, gy, gt, x1, y1, t1);
+        gradient_avx2(ctx, _mm256_add_epi32(ii, i2), _mm256_add_epi32(jj, j2),
+                _mm256_add_epi32(kk, k2), &gx, &gy, &gt);
+        n2 = corner_avx2(gx, gy, gt, x2, y2, t2);
+        gradient_avx2(ctx, _mm256_add_epi32(ii, one), _mm256_add_epi32(jj, one),
+                _mm256_add_epi32(kk, one), &gx, &gy, &gt);
+        n3 = corner_avx2(gx, gy, gt, x3, y3, t3);
+
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(n0, n1), n2), n3);
+        _mm256_storeu_ps(out + n8, _mm256_mul_ps(_mm256_set1_ps(SCALE), sum));
+    }
+
+    raw_batch_scalar(ctx, out + n8, ys + n8, xs + n8, ts + n8, n - n8);
+}
+
+#endif
+
+// dispatch --------------------------------------------------------------------
+
+void simplex3_raw_batch(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, const float * ts, int n)
+{
+    switch (perlin_get_kernel())
+    {
+#ifdef SIMPLEX_X86
+        case SIMD_AVX2: raw_batch_avx2(ctx, out, ys, xs, ts, n); break;
+        case SIMD_SSE2: raw_batch_sse2(ctx, out, ys, xs, ts, n); break;
+#endif
+        default:        raw_batch_scalar(ctx, out, ys, xs, ts, n); break;
+    }
+}
+
+void simplex3_fill_grid(const perlin_ctx * ctx, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, float t, int stride)
+{
+    float ys[FILL_BATCH], xs[FILL_BATCH], ts[FILL_BATCH], raw[FILL_BATCH];
+    for (int i = 0; i < FILL_BATCH; i++) { ts[i] = t; }
+
+    for (int row = 0; row < height; row++)
+    {
+        float yf = (origin_y + row + 0.5f) / 8;
+        for (int i = 0; i < FILL_BATCH; i++) { ys[i] = yf; }
+
+        uint8_t * dst = out + (size_t) row * stride;
+        for (int col = 0; col < width; col += FILL_BATCH)
+        {
+            int n = width - col < FILL_BATCH ? width - col : FILL_BATCH;
+            for (int i = 0; i < n; i++) { xs[i] = (origin_x + col + i + 0.5f) / 8; }
+
+            simplex3_raw_batch(ctx, raw, ys, xs, ts, n);
+            for (int i = 0; i < n; i++) { dst[col + i] = (uint8_t) quantize(raw[i]); }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/*
+   simplex.h
+   3D simplex noise, time as the third axis, for animating 2D fields
+*/
+
+#ifndef SIMPLEX
+#define SIMPLEX
+
+#include <stdint.h>
+
+#include "perlin.h"
+
+// max abs difference between simplex3_raw and any simplex3_raw_batch
+// kernel, see PERLIN_SIMD_EPSILON. the falloff takes a fourth power, so
+// a fused multiply-add moves the result a little further than in perlin
+#define SIMPLEX_SIMD_EPSILON 1e-5f
+
+// simplex noise at y, x, t in lattice units, roughly -1 to 1. a sample
+// sums the 4 corners of the tetrahedron it falls in, where classic 3D
+// perlin would blend the 8 corners of a cube. hashed with ctx's table
+float simplex3_raw(const perlin_ctx * ctx, float y, float x, float t);
+
+// simplex3_raw at integer pixel coordinates and time t, from 0 to 255, at
+// the same base frequency as perlin()
+int simplex3(const perlin_ctx * ctx, int y, int x, float t);
+
+// simplex3_raw for n samples at once, using the vector kernel perlin
+// dispatches to (see perlin_get_kernel)
+void simplex3_raw_batch(const perlin_ctx * ctx, float * out,
+        const float * ys, const float * xs, const float * ts, int n);
+
+// fill a caller-owned width x height buffer (rows stride bytes apart) with
+// simplex3() values at time t, starting at pixel origin_y, origin_x.
+// samples go through simplex3_raw_batch, so with the scalar kernel the
+// output is exactly simplex3()
+void simplex3_fill_grid(const perlin_ctx * ctx, uint8_t * out, int width, int height,
+        int origin_y, int origin_x, float t, int stride);
+
+
+#endif
@@ -0,0 +1,400 @@
+/*
+   snapshot.c
+   memory mapped binary snapshots of the flock and noise, with step replay
+
+   a snapshot is a fixed header then its sections, each aligned so that
+   the mapped file can be used in place: the six state arrays, the noise
+   context and the cached tiles with their keys. loading is an mmap and a
+   bounds check of the header, the pages come in as they are read. step
+   records are appended after the body, each one the inputs of a step and
+   a hash of the state it produced, so a run can be redone from its start
+   and checked step by step
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+static uint64_t align_up(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+// writing --------------------------------------------------------------------
+
+// writes sections one after another, zero padded to their offsets
+struct writer
+{
+    FILE * file;
+    uint64_t at;
+    int ok;
+    size_t tile_bytes;
+};
+
+static void pad_to(struct writer * w, uint64_t offset)
+{
+    static const char zeros[SNAPSHOT_ALIGN];
+    while (w->ok && w->at < offset)
+    {
+        size_t n = offset - w->at < sizeof(zeros) ? offset - w->at : sizeof(zeros);
+        w->ok = fwrite(zeros, 1, n, w->file) == n;
+        w->at += n;
+    }
+}
+
+static void put(struct writer * w, const void * data, size_t size)
+{
+    w->ok = w->ok && fwrite(data, 1, size, w->file) == size;
+    w->at += size;
+}
+
+// tiles are written in two passes over the cache, keys then data
+static void put_key(void * arg, const struct noise_tile_key * key, const uint8_t * tile)
+{
+    (void) tile;
+    put(arg, key, sizeof(struct noise_tile_key));
+}
+
+static void put_tile(void * arg, const struct noise_tile_key * key, const uint8_t * tile)
+{
+    struct writer * w = arg;
+    (void) key;
+    put(w, tile, w->tile_bytes);
+}
+
+int snapshot_write(const char * path, const struct boids * boids,
+        const struct boid_params * params, const perlin_ctx * ctx,
+        const struct noise_cache * cache, uint64_t step)
+{
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.endian = SNAPSHOT_ENDIAN;
+    header.header_size = sizeof(struct snapshot_header);
+    header.ctx_size = sizeof(perlin_ctx);
+    header.step = step;
+    header.count = boids->count;
+    header.kernel = boids->kernel;
+    header.search = boids->search;
+    header.params = *params;
+
+    struct noise_cache_stats stats = {0};
+    if (cache != NULL)
+    {
+        noise_cache_get_stats(cache, &stats);
+        header.tile = noise_cache_tile(cache);
+        header.tile_count = stats.tiles;
+    }
+
+    // lay the sections out
+    uint64_t at = sizeof(struct snapshot_header);
+    for (int a = 0; a < 6; a++)
+    {
+        header.arrays[a] = align_up(at);
+        at = header.arrays[a] + sizeof(float) * (uint64_t) boids->count;
+    }
+    if (ctx != NULL)
+    {
+        header.ctx = align_up(at);
+        at = header.ctx + sizeof(perlin_ctx);
+    }
+    if (header.tile_count > 0)
+    {
+        header.tile_keys = align_up(at);
+        header.tiles = align_up(header.tile_keys +
+                sizeof(struct noise_tile_key) * (uint64_t) header.tile_count);
+        at = header.tiles + (uint64_t) header.tile * header.tile * header.tile_count;
+    }
+    header.body_size = align_up(at);
+
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    struct writer w = { fopen(temp, "wb"), 0, 1, (size_t) header.tile * header.tile };
+    if (w.file == NULL)
+    {
+        printf("Error: couldnt open %s\n", temp);
+        return 0;
+    }
+
+    const struct boid_state * s = boids_current(boids);
+    const float * arrays[6] = { s->px, s->py, s->pz, s->vx, s->vy, s->vz };
+    put(&w, &header, sizeof(header));
+    for (int a = 0; a < 6; a++)
+    {
+        pad_to(&w, header.arrays[a]);
+        put(&w, arrays[a], sizeof(float) * (size_t) boids->count);
+    }
+    if (ctx != NULL)
+    {
+        pad_to(&w, header.ctx);
+        put(&w, ctx, sizeof(perlin_ctx));
+    }
+    if (header.tile_count > 0)
+    {
+        pad_to(&w, header.tile_keys);
+        noise_cache_each(cache, put_key, &w);
+        pad_to(&w, header.tiles);
+        noise_cache_each(cache, put_tile, &w);
+    }
+    pad_to(&w, header.body_size);
+
+    int ok = w.ok && w.at == header.body_size;
+    if (fclose(w.file) != 0) { ok = 0; }
+    ok = ok && rename(temp, path) == 0;
+    if (!ok)
+    {
+        printf("Error: couldnt write %s\n", path);
+        remove(temp);
+    }
+    return ok;
+}
+
+// reading --------------------------------------------------------------------
+
+// section of size bytes at offset lies inside the body and is aligned
+static int section_fits(const struct snapshot_header * h, uint64_t offset, uint64_t size)
+{
+    return offset % SNAPSHOT_ALIGN == 0 && offset >= h->header_size &&
+        offset <= h->body_size && size <= h->body_size - offset;
+}
+
+static int header_valid(const struct snapshot_header * h, size_t file_size)
+{
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0 ||
+        h->endian != SNAPSHOT_ENDIAN || h->version != SNAPSHOT_VERSION ||
+        h->header_size != sizeof(struct snapshot_header) ||
+        h->ctx_size != sizeof(perlin_ctx) || h->body_size > file_size ||
+        h->count < 0 || h->tile < 0 || h->tile_count < 0 ||
+        h->kernel < SIMD_SCALAR || h->kernel > SIMD_AVX2 ||
+        h->search < BOIDS_GRID || h->search > BOIDS_BRUTE)
+    {
+        return 0;
+    }
+
+    int ok = 1;
+    for (int a = 0; a < 6; a++)
+    {
+        ok = ok && section_fits(h, h->arrays[a], sizeof(float) * (uint64_t) h->count);
+    }
+    if (h->ctx != 0) { ok = ok && section_fits(h, h->ctx, sizeof(perlin_ctx)); }
+    if (h->tile_count > 0)
+    {
+        ok = ok && section_fits(h, h->tile_keys,
+                sizeof(struct noise_tile_key) * (uint64_t) h->tile_count);
+        ok = ok && section_fits(h, h->tiles,
+                (uint64_t) h->tile * h->tile * h->tile_count);
+    }
+    return ok;
+}
+
+int snapshot_open(struct snapshot * s, const char * path)
+{
+    memset(s, 0, sizeof(struct snapshot));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return 0;
+    }
+
+    struct stat st;
+    void * map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(struct snapshot_header))
+    {
+        map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED || !header_valid(map, st.st_size))
+    {
+        printf("Error: %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        if (map != MAP_FAILED) { munmap(map, st.st_size); }
+        return 0;
+    }
+
+    const struct snapshot_header * h = map;
+    char * base = map;
+    s->map = map;
+    s->size = st.st_size;
+    s->header = h;
+
+    float ** arrays[6] = { &s->state.px, &s->state.py, &s->state.pz,
+                           &s->state.vx, &s->state.vy, &s->state.vz };
+    for (int a = 0; a < 6; a++)
+    {
+        *arrays[a] = (float *) (base + h->arrays[a]);
+    }
+    s->ctx = h->ctx != 0 ? (const perlin_ctx *) (base + h->ctx) : NULL;
+    if (h->tile_count > 0)
+    {
+        s->tile_keys = (const struct noise_tile_key *) (base + h->tile_keys);
+        s->tiles = (const uint8_t *) (base + h->tiles);
+    }
+
+    s->records = (const struct snapshot_record *) (base + h->body_size);
+    s->record_count = (int) ((s->size - h->body_size) / sizeof(struct snapshot_record));
+    return 1;
+}
+
+void snapshot_close(struct snapshot * s)
+{
+    if (s->map != NULL) { munmap(s->map, s->size); }
+    memset(s, 0, sizeof(struct snapshot));
+}
+
+int snapshot_restore(const struct snapshot * s, struct boids * boids,
+        struct boid_params * params)
+{
+    const struct snapshot_header * h = s->header;
+    if (h->count > boids->capacity)
+    {
+        printf("Error: snapshot of %d boids wont fit in %d\n", h->count, boids->capacity);
+        return 0;
+    }
+
+    struct boid_state * to = &boids->state[boids->current];
+    float * dst[6] = { to->px, to->py, to->pz, to->vx, to->vy, to->vz };
+    const float * src[6] = { s->state.px, s->state.py, s->state.pz,
+                             s->state.vx, s->state.vy, s->state.vz };
+    for (int a = 0; a < 6; a++)
+    {
+        memcpy(dst[a], src[a], sizeof(float) * (size_t) h->count);
+    }
+
+    boids->count = h->count;
+    boids->kernel = (enum simd_level) h->kernel <= simd_detect() ?
+        (enum simd_level) h->kernel : simd_detect();
+    boids->search = (enum boids_search) h->search;
+    *params = h->params;
+    return 1;
+}
+
+int snapshot_restore_tiles(const struct snapshot * s, struct noise_cache * cache)
+{
+    const struct snapshot_header * h = s->header;
+    if (h->tile_count == 0 || h->tile != noise_cache_tile(cache)) { return 0; }
+
+    size_t bytes = (size_t) h->tile * h->tile;
+    for (int i = 0; i < h->tile_count; i++)
+    {
+        noise_cache_put(cache, &s->tile_keys[i], s->tiles + i * bytes);
+    }
+    return h->tile_count;
+}
+
+// replay ---------------------------------------------------------------------
+
+uint64_t snapshot_hash(const struct boid_state * state, int count)
+{
+    // fnv-1a over 32 bit words, each array in turn
+    const float * arrays[6] = { state->px, state->py, state->pz,
+                                state->vx, state->vy, state->vz };
+    uint64_t hash = 14695981039346656037ull;
+    for (int a = 0; a < 6; a++)
+    {
+        const uint32_t * words = (const uint32_t *) arrays[a];
+        for (int i = 0; i < count; i++)
+        {
+            hash = (hash ^ words[i]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int snapshot_replay(const struct snapshot * s, struct boids * boids, struct pool * pool)
+{
+    struct boid_params params;
+    if (!snapshot_restore(s, boids, &params)) { return -1; }
+    if (boids->kernel != (enum simd_level) s->header->kernel)
+    {
+        printf("replay: recorded with %s, this cpu only has %s, expect it to differ\n",
+                simd_name(s->header->kernel), simd_name(boids->kernel));
+    }
+
+    for (int i = 0; i < s->record_count; i++)
+    {
+        const struct snapshot_record * record = &s->records[i];
+        if (record->magic != SNAPSHOT_RECORD_MAGIC ||
+            !boids_step(boids, &record->params, record->dt, pool) ||
+            snapshot_hash(boids_current(boids), boids->count) != record->hash)
+        {
+            return i;
+        }
+    }
+    return s->record_count;
+}
+
+int snapshot_recorder_open(struct snapshot_recorder * r, const char * path)
+{
+    memset(r, 0, sizeof(struct snapshot_recorder));
+
+    struct snapshot_header header;
+    FILE * file = fopen(path, "r+b");
+    if (file == NULL)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return 0;
+    }
+
+    long size = -1;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+        fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 &&
+        header_valid(&header, size);
+    if (!ok)
+    {
+        printf("Error: %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        fclose(file);
+        return 0;
+    }
+
+    // whole records only, whatever a crash left half written goes
+    r->records = (size - header.body_size) / sizeof(struct snapshot_record);
+    long end = header.body_size + r->records * sizeof(struct snapshot_record);
+    if (end != size && (fflush(file) != 0 || ftruncate(fileno(file), end) != 0))
+    {
+        printf("Error: couldnt truncate %s\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    r->file = file;
+    r->step = header.step + r->records;
+    return fseek(file, end, SEEK_SET) == 0;
+}
+
+int snapshot_record(struct snapshot_recorder * r, const struct boids * boids,
+        const struct boid_params * params, float dt)
+{
+    struct snapshot_record record;
+    memset(&record, 0, sizeof(record));
+    record.magic = SNAPSHOT_RECORD_MAGIC;
+    record.step = r->step + 1;
+    record.dt = dt;
+    record.params = *params;
+    record.hash = snapshot_hash(boids_current(boids), boids->count);
+
+    // flushed every step, a crash loses at most the step in progress
+    if (fwrite(&record, sizeof(record), 1, r->file) != 1 || fflush(r->file) != 0)
+    {
+        printf("Error: couldnt append step %lu\n", (unsigned long) record.step);
+        return 0;
+    }
+    r->step++;
+    r->records++;
+    return 1;
+}
+
+int snapshot_recorder_close(struct snapshot_recorder * r)
+{
+    int ok = r->file == NULL || fclose(r->file) == 0;
+    memset(r, 0, sizeof(struct snapshot_recorder));
+    return ok;
+}
@@ -0,0 +1,140 @@
+/*
+   snapshot.h
+   memory mapped binary snapshots of the flock and noise, with step replay
+*/
+
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "boids.h"
+#include "noise_cache.h"
+#include "perlin.h"
+#include "pool.h"
+
+#define SNAPSHOT_MAGIC "FLOCKSNP"
+#define SNAPSHOT_VERSION 1
+
+// alignment of every section in the file. mappings start on a page, so
+// the arrays of a mapped snapshot are as aligned as boids_create's
+#define SNAPSHOT_ALIGN 64
+
+// written as is and checked on load, a file from a machine of the other
+// byte order reads back as SNAPSHOT_ENDIAN swapped and is refused
+#define SNAPSHOT_ENDIAN 0x01020304u
+
+#define SNAPSHOT_RECORD_MAGIC 0x50455453u   // "STEP"
+
+// the file starts with this. offsets are in bytes from the start of the
+// file, SNAPSHOT_ALIGN aligned, 0 for a section that was not saved
+struct snapshot_header
+{
+    char magic[8];              // SNAPSHOT_MAGIC, not terminated
+    uint32_t version;
+    uint32_t endian;
+    uint32_t header_size;       // sizeof(struct snapshot_header)
+    uint32_t ctx_size;          // sizeof(perlin_ctx)
+    uint64_t body_size;         // bytes before the step records
+
+    uint64_t step;              // steps the flock had taken when saved
+    int32_t count;              // boids
+    int32_t kernel;             // enum simd_level the flock stepped with
+    int32_t search;             // enum boids_search
+    int32_t tile;               // noise tile edge in pixels
+    int32_t tile_count;
+    int32_t reserved;
+    struct boid_params params;
+
+    uint64_t arrays[6];         // count floats each: px, py, pz, vx, vy, vz
+    uint64_t ctx;               // perlin_ctx of the noise field
+    uint64_t tile_keys;         // tile_count struct noise_tile_key
+    uint64_t tiles;             // tile_count tiles of tile * tile bytes
+};
+
+// appended after the body once per step, in step order. a fixed size, so
+// a record torn by a crash is simply dropped on the next open
+struct snapshot_record
+{
+    uint32_t magic;             // SNAPSHOT_RECORD_MAGIC
+    float dt;
+    uint64_t step;              // steps taken once this one is done
+    struct boid_params params;  // the step was taken with
+    uint32_t reserved;
+    uint64_t hash;              // snapshot_hash of the state after it
+};
+
+// an open snapshot. everything points into a private mapping of the file,
+// nothing is copied or parsed, pages are read on first touch. writes go
+// to private copies of the pages and never reach the file
+struct snapshot
+{
+    void * map;
+    size_t size;
+    const struct snapshot_header * header;
+
+    struct boid_state state;    // header->count boids
+    const perlin_ctx * ctx;     // NULL if none was saved
+    const struct noise_tile_key * tile_keys;
+    const uint8_t * tiles;      // tile i at tiles + i * tile * tile
+
+    const struct snapshot_record * records;
+    int record_count;
+};
+
+// appends a record per step to a snapshot file
+struct snapshot_recorder
+{
+    FILE * file;
+    uint64_t step;              // of the last record
+    uint64_t records;
+};
+
+// write boids, params, ctx (or NULL) and every tile of cache (or NULL) to
+// path, as a flock that has taken step steps. the file is written beside
+// path and renamed over it, so readers never see half of it
+int snapshot_write(const char * path, const struct boids * boids,
+        const struct boid_params * params, const perlin_ctx * ctx,
+        const struct noise_cache * cache, uint64_t step);
+
+// map and check path. returns 0, with s zeroed, if it is not a snapshot
+// this build can read
+int snapshot_open(struct snapshot * s, const char * path);
+
+void snapshot_close(struct snapshot * s);
+
+// copy the flock of s into boids, which must have room for it, replacing
+// its boids, and hand back the params. the kernel and search are the saved
+// ones so later steps match the original run, the kernel clamped to what
+// this cpu has. returns 0 if boids is too small
+int snapshot_restore(const struct snapshot * s, struct boids * boids,
+        struct boid_params * params);
+
+// put every tile of s into cache, returns how many. none if the tile edges
+// differ
+int snapshot_restore_tiles(const struct snapshot * s, struct noise_cache * cache);
+
+// restore s and redo its recorded steps over pool (or NULL), checking the
+// state after each against the record. the step does not depend on thread
+// count, only on the kernel. returns the steps that matched, which is
+// s->record_count for a deterministic replay, -1 if restoring failed
+int snapshot_replay(const struct snapshot * s, struct boids * boids, struct pool * pool);
+
+// hash of the positions and velocities of count boids, for records
+uint64_t snapshot_hash(const struct boid_state * state, int count);
+
+// open the snapshot at path for appending records, after dropping any torn
+// one at its end
+int snapshot_recorder_open(struct snapshot_recorder * r, const char * path);
+
+// append the step boids just took with params and dt
+int snapshot_record(struct snapshot_recorder * r, const struct boids * boids,
+        const struct boid_params * params, float dt);
+
+// returns 0 if the records could not all be written
+int snapshot_recorder_close(struct snapshot_recorder * r);
+
+
+#endif
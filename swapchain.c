@@ -0,0 +1,212 @@
+/*
+   swapchain.c
+   swapchain setup and recreation over a window surface
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "swapchain.h"
+
+// min and max from freebsd
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// standard 32 bit color if the surface has it, else whatever comes first
+VkSurfaceFormatKHR swapchain_pick_format(VkPhysicalDevice physical_device, VkSurfaceKHR surface)
+{
+    VkSurfaceFormatKHR chosen = { VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &count, NULL);
+    VkSurfaceFormatKHR * formats = malloc(sizeof(VkSurfaceFormatKHR) * count);
+    if (formats == NULL ||
+        vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &count, formats) != VK_SUCCESS ||
+        count == 0)
+    {
+        free(formats);
+        return chosen;
+    }
+
+    // a lone undefined format means any is fine
+    if (count == 1 && formats[0].format == VK_FORMAT_UNDEFINED)
+    {
+        free(formats);
+        return chosen;
+    }
+
+    chosen = formats[0];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (formats[i].format == VK_FORMAT_R8G8B8A8_UNORM ||
+            formats[i].format == VK_FORMAT_B8G8R8A8_UNORM)
+        {
+            chosen = formats[i];
+            break;
+        }
+    }
+
+    free(formats);
+    return chosen;
+}
+
+// mailbox for low latency without tearing, else fifo which always exists
+static VkPresentModeKHR choose_present_mode(VkPhysicalDevice physical_device, VkSurfaceKHR surface)
+{
+    VkPresentModeKHR chosen = VK_PRESENT_MODE_FIFO_KHR;
+
+    uint32_t count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count, NULL);
+    VkPresentModeKHR * modes = malloc(sizeof(VkPresentModeKHR) * count);
+    if (modes != NULL &&
+        vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &count, modes) == VK_SUCCESS)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) { chosen = modes[i]; }
+        }
+    }
+
+    free(modes);
+    return chosen;
+}
+
+// create a swapchain for the current surface size, replacing old
+static int build(struct swapchain * sc, uint32_t width, uint32_t height, VkSwapchainKHR old)
+{
+    VkSurfaceCapabilitiesKHR capabilities;
+    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(sc->physical_device, sc->surface,
+                &capabilities) != VK_SUCCESS)
+    {
+        printf("Error: couldnt get surface capabilities. \n");
+        return 0;
+    }
+
+    // the surface decides the size unless it reports the special value
+    VkExtent2D extent = capabilities.currentExtent;
+    if (capabilities.currentExtent.width == UINT32_MAX)
+    {
+        extent.width = MIN(MAX(width, capabilities.minImageExtent.width),
+                capabilities.maxImageExtent.width);
+        extent.height = MIN(MAX(height, capabilities.minImageExtent.height),
+                capabilities.maxImageExtent.height);
+    }
+    if (extent.width == 0 || extent.height == 0) { return -1; }
+
+    // one more than the minimum so acquire rarely waits on the compositor
+    uint32_t image_count = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount != 0 && image_count > capabilities.maxImageCount)
+    {
+        image_count = capabilities.maxImageCount;
+    }
+
+    VkSwapchainCreateInfoKHR swapchain_info = {0};
+    swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapchain_info.surface = sc->surface;
+    swapchain_info.minImageCount = image_count;
+    swapchain_info.imageFormat = sc->format.format;
+    swapchain_info.imageColorSpace = sc->format.colorSpace;
+    swapchain_info.imageExtent = extent;
+    swapchain_info.imageArrayLayers = 1;
+    swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    swapchain_info.preTransform =
+        (capabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) ?
+        VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR : capabilities.currentTransform;
+    swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    swapchain_info.presentMode = sc->present_mode;
+    swapchain_info.clipped = VK_TRUE;
+    swapchain_info.oldSwapchain = old;
+
+    VkSwapchainKHR handle;
+    if (vkCreateSwapchainKHR(sc->device, &swapchain_info, sc->host, &handle) != VK_SUCCESS)
+    {
+        printf("Error: couldnt create swapchain. \n");
+        return 0;
+    }
+
+    uint32_t count = 0;
+    VkImage * images = NULL;
+    if (vkGetSwapchainImagesKHR(sc->device, handle, &count, NULL) != VK_SUCCESS ||
+        count == 0 ||
+        (images = malloc(sizeof(VkImage) * count)) == NULL ||
+        vkGetSwapchainImagesKHR(sc->device, handle, &count, images) != VK_SUCCESS)
+    {
+        printf("Error: couldnt get swapchain images. \n");
+        free(images);
+        vkDestroySwapchainKHR(sc->device, handle, sc->host);
+        return 0;
+    }
+
+    free(sc->images);
+    sc->handle = handle;
+    sc->extent = extent;
+    sc->image_count = count;
+    sc->images = images;
+    return 1;
+}
+
+int swapchain_create(struct swapchain * sc, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, VkSurfaceKHR surface,
+        uint32_t width, uint32_t height)
+{
+    memset(sc, 0, sizeof(struct swapchain));
+    sc->physical_device = physical_device;
+    sc->device = device;
+    sc->host = host;
+    sc->surface = surface;
+    sc->format = swapchain_pick_format(physical_device, surface);
+    sc->present_mode = choose_present_mode(physical_device, surface);
+
+    return build(sc, width, height, VK_NULL_HANDLE) == 1;
+}
+
+int swapchain_recreate(struct swapchain * sc, uint32_t width, uint32_t height,
+        uint64_t serial)
+{
+    // no room to park the old one, wait for the oldest to go
+    if (sc->retired_count == SWAPCHAIN_MAX_RETIRED)
+    {
+        vkDeviceWaitIdle(sc->device);
+        swapchain_collect(sc, UINT64_MAX);
+    }
+
+    VkSwapchainKHR old = sc->handle;
+    int result = build(sc, width, height, old);
+    if (result != 1) { return result; }
+
+    sc->retired[sc->retired_count] = old;
+    sc->retired_serial[sc->retired_count] = serial;
+    sc->retired_count++;
+    return 1;
+}
+
+void swapchain_collect(struct swapchain * sc, uint64_t completed)
+{
+    int kept = 0;
+    for (int i = 0; i < sc->retired_count; i++)
+    {
+        if (sc->retired_serial[i] <= completed)
+        {
+            vkDestroySwapchainKHR(sc->device, sc->retired[i], sc->host);
+        }
+        else
+        {
+            sc->retired[kept] = sc->retired[i];
+            sc->retired_serial[kept] = sc->retired_serial[i];
+            kept++;
+        }
+    }
+    sc->retired_count = kept;
+}
+
+void swapchain_destroy(struct swapchain * sc)
+{
+    if (sc->device == VK_NULL_HANDLE) { return; }
+
+    swapchain_collect(sc, UINT64_MAX);
+    if (sc->handle != VK_NULL_HANDLE) { vkDestroySwapchainKHR(sc->device, sc->handle, sc->host); }
+    free(sc->images);
+    memset(sc, 0, sizeof(struct swapchain));
+}
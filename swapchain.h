@@ -0,0 +1,63 @@
+/*
+   swapchain.h
+   swapchain setup and recreation over a window surface
+*/
+
+#ifndef SWAPCHAIN
+#define SWAPCHAIN
+
+#include <stdint.h>
+#include <vulkan.h>
+
+// most old swapchains waiting for their last frame to finish
+#define SWAPCHAIN_MAX_RETIRED 4
+
+struct swapchain
+{
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    const VkAllocationCallbacks * host;     // for every swapchain, NULL is fine
+    VkSurfaceKHR surface;
+
+    VkSwapchainKHR handle;
+    VkSurfaceFormatKHR format;
+    VkPresentModeKHR present_mode;
+    VkExtent2D extent;
+    uint32_t image_count;
+    VkImage * images;
+
+    // replaced swapchains, destroyed once the frame tagged with them is done
+    VkSwapchainKHR retired[SWAPCHAIN_MAX_RETIRED];
+    uint64_t retired_serial[SWAPCHAIN_MAX_RETIRED];
+    int retired_count;
+};
+
+// the format swapchain_create will pick for surface, so whatever renders
+// into it can be built before the swapchain exists
+VkSurfaceFormatKHR swapchain_pick_format(VkPhysicalDevice physical_device,
+        VkSurfaceKHR surface);
+
+// pick a format, present mode and size for surface and create the
+// swapchain. width and height are used when the surface leaves the size
+// to us. returns 0 on failure
+int swapchain_create(struct swapchain * sc, VkPhysicalDevice physical_device,
+        VkDevice device, const VkAllocationCallbacks * host, VkSurfaceKHR surface,
+        uint32_t width, uint32_t height);
+
+// replace the swapchain after a resize without waiting for the device.
+// the old one is handed to the new as oldSwapchain and kept until the
+// frame with serial, the last one that may use it, has finished. the
+// format stays the same. returns 0 on failure, 1 on success and -1 if the
+// surface has no area (minimized), in which case nothing changed
+int swapchain_recreate(struct swapchain * sc, uint32_t width, uint32_t height,
+        uint64_t serial);
+
+// destroy retired swapchains whose frames are done, completed being the
+// serial of the latest finished frame
+void swapchain_collect(struct swapchain * sc, uint64_t completed);
+
+// the device must be idle
+void swapchain_destroy(struct swapchain * sc);
+
+
+#endif
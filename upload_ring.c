@@ -0,0 +1,85 @@
+/*
+   upload_ring.c
+   persistently mapped ring of per frame upload slices
+
+   the buffer is allocated once out of a mapped block. uploads are plain stores into
+   the mapping, there is no map, unmap, flush or reallocation per frame.
+   coherent memory is required so nothing has to be flushed, and device
+   local memory is preferred when the host can see it (resizable bar,
+   integrated gpus and lavapipe) so the gpu reads it at full speed
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "upload_ring.h"
+
+int upload_ring_create(struct upload_ring * ring, struct gpu_allocator * allocator,
+        VkDeviceSize slice, int frames, VkBufferUsageFlags usage)
+{
+    memset(ring, 0, sizeof(struct upload_ring));
+    ring->allocator = allocator;
+    ring->slice = slice;
+    ring->frames = frames;
+
+    if (frames < 1 || frames > UPLOAD_RING_MAX_FRAMES || slice == 0)
+    {
+        printf("Error: bad upload ring of %d x %lu bytes\n", frames, (unsigned long) slice);
+        return 0;
+    }
+
+    VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (!gpu_create_buffer(allocator, slice * frames, usage,
+                host | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &ring->buffer, &ring->memory) &&
+        !gpu_create_buffer(allocator, slice * frames, usage, host,
+                &ring->buffer, &ring->memory))
+    {
+        printf("Error: couldnt create %lu byte upload ring\n", (unsigned long) (slice * frames));
+        return 0;
+    }
+    ring->mapped = ring->memory.mapped;
+
+    return 1;
+}
+
+void upload_ring_destroy(struct upload_ring * ring)
+{
+    if (ring->allocator == NULL) { return; }
+
+    gpu_destroy_buffer(ring->allocator, ring->buffer, &ring->memory);
+
+    memset(ring, 0, sizeof(struct upload_ring));
+}
+
+void upload_ring_begin(struct upload_ring * ring, int frame)
+{
+    ring->frame = frame;
+    ring->used = 0;
+}
+
+void * upload_ring_alloc(struct upload_ring * ring, VkDeviceSize size,
+        VkDeviceSize alignment, VkDeviceSize * offset)
+{
+    VkDeviceSize begin = (ring->used + alignment - 1) & ~(alignment - 1);
+    if (begin + size > ring->slice)
+    {
+        ring->stats.overflows++;
+        return NULL;
+    }
+
+    ring->used = begin + size;
+    *offset = ring->slice * ring->frame + begin;
+    return ring->mapped + *offset;
+}
+
+void upload_ring_end(struct upload_ring * ring)
+{
+    ring->stats.frames++;
+    ring->stats.bytes += ring->used;
+    ring->stats.frame_bytes = ring->used;
+    if (ring->used > ring->stats.peak_frame_bytes)
+    {
+        ring->stats.peak_frame_bytes = ring->used;
+    }
+}
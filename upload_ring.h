@@ -0,0 +1,65 @@
+/*
+   upload_ring.h
+   persistently mapped ring of per frame upload slices
+*/
+
+#ifndef UPLOAD_RING
+#define UPLOAD_RING
+
+#include <stdint.h>
+#include <vulkan.h>
+
+#include "gpu_alloc.h"
+
+#define UPLOAD_RING_MAX_FRAMES 8
+
+struct upload_ring_stats
+{
+    uint64_t frames;            // slices handed out so far
+    uint64_t bytes;             // total bytes written into slices
+    uint64_t frame_bytes;       // bytes written in the last finished frame
+    uint64_t peak_frame_bytes;  // most bytes written in one frame
+    uint64_t overflows;         // allocations that did not fit in a slice
+};
+
+// one host visible buffer split into frames slices of slice bytes. it is
+// mapped once at creation and stays mapped, so a frame only writes through
+// the pointer. slice i belongs to frame in flight i, whose fence says when
+// the gpu is done reading it
+struct upload_ring
+{
+    struct gpu_allocator * allocator;
+    VkBuffer buffer;
+    struct gpu_allocation memory;
+    uint8_t * mapped;
+
+    VkDeviceSize slice;         // bytes per frame
+    int frames;                 // slices in the ring
+    int frame;                  // slice of the current frame
+    VkDeviceSize used;          // bytes handed out of the current slice
+
+    struct upload_ring_stats stats;
+};
+
+// create a ring of frames (<= UPLOAD_RING_MAX_FRAMES) slices of slice bytes,
+// usable as usage (ie vertex and uniform). returns 0 on failure
+int upload_ring_create(struct upload_ring * ring, struct gpu_allocator * allocator,
+        VkDeviceSize slice, int frames, VkBufferUsageFlags usage);
+
+// the gpu must be done with every slice
+void upload_ring_destroy(struct upload_ring * ring);
+
+// start writing slice frame. the submit that last read it must be done,
+// which the frame waiting on its fence guarantees
+void upload_ring_begin(struct upload_ring * ring, int frame);
+
+// size bytes of the current slice at a multiple of alignment (a power of
+// two), with its offset into ring->buffer in offset. NULL if the slice is full
+void * upload_ring_alloc(struct upload_ring * ring, VkDeviceSize size,
+        VkDeviceSize alignment, VkDeviceSize * offset);
+
+// finish the current slice
+void upload_ring_end(struct upload_ring * ring);
+
+
+#endif
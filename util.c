@@ -1,6 +1,8 @@
 #include <SDL2/SDL.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "util.h"
 
@@ -11,3 +13,182 @@ int die(SDL_Window * win, int status)
     return status;
 }
 
+// read a whole file into a malloced buffer
+char * read_file(const char * path, size_t * size)
+{
+    FILE * file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("Error: couldnt open %s\n", path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char * data = length > 0 ? malloc(length) : NULL;
+    if (data == NULL || fread(data, 1, length, file) != (size_t) length)
+    {
+        printf("Error: couldnt read %s\n", path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *size = length;
+    return data;
+}
+
+// files read by shader_preload, looked up by the path load_shader is given
+struct preloaded
+{
+    char * path;
+    char * code;
+    size_t size;
+};
+
+static struct preloaded * preloaded;
+static int preloaded_count;
+
+int shader_preload(const char * dir)
+{
+    DIR * d = opendir(dir);
+    if (d == NULL)
+    {
+        printf("Error: couldnt open %s\n", dir);
+        return 0;
+    }
+
+    struct dirent * entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length < 4 || strcmp(entry->d_name + length - 4, ".spv") != 0) { continue; }
+
+        struct preloaded * grown = realloc(preloaded,
+                sizeof(struct preloaded) * (preloaded_count + 1));
+        if (grown == NULL) { break; }
+        preloaded = grown;
+
+        // the path as the modules spell it, dir then name
+        struct preloaded * p = &preloaded[preloaded_count];
+        p->path = malloc(strlen(dir) + length + 1);
+        if (p->path == NULL) { break; }
+        strcpy(p->path, dir);
+        strcat(p->path, entry->d_name);
+
+        p->code = read_file(p->path, &p->size);
+        if (p->code == NULL)
+        {
+            free(p->path);
+            continue;
+        }
+        preloaded_count++;
+    }
+
+    closedir(d);
+    return preloaded_count;
+}
+
+void shader_preload_free(void)
+{
+    for (int i = 0; i < preloaded_count; i++)
+    {
+        free(preloaded[i].path);
+        free(preloaded[i].code);
+    }
+    free(preloaded);
+    preloaded = NULL;
+    preloaded_count = 0;
+}
+
+// load a SPIR-V file into a shader module, preloaded or from disk
+VkShaderModule load_shader(VkDevice device, const VkAllocationCallbacks * host,
+        const char * path)
+{
+    size_t size = 0;
+    char * code = NULL;
+    const char * source = NULL;
+    for (int i = 0; i < preloaded_count && source == NULL; i++)
+    {
+        if (strcmp(preloaded[i].path, path) == 0)
+        {
+            source = preloaded[i].code;
+            size = preloaded[i].size;
+        }
+    }
+    if (source == NULL)
+    {
+        code = read_file(path, &size);
+        if (code == NULL) { return VK_NULL_HANDLE; }
+        source = code;
+    }
+
+    VkShaderModuleCreateInfo module_info = {0};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = size;
+    module_info.pCode = (const uint32_t *) source;
+
+    VkShaderModule module = VK_NULL_HANDLE;
+    if (vkCreateShaderModule(device, &module_info, host, &module) != VK_SUCCESS)
+    {
+        printf("Error: couldnt create shader module from %s\n", path);
+        module = VK_NULL_HANDLE;
+    }
+
+    free(code);
+    return module;
+}
+
+// allocate a primary command buffer and begin it for one submission
+VkCommandBuffer begin_one_shot(VkDevice device, VkCommandPool command_pool)
+{
+    VkCommandBufferAllocateInfo alloc_info = {0};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS)
+    {
+        return VK_NULL_HANDLE;
+    }
+
+    VkCommandBufferBeginInfo begin_info = {0};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+    {
+        vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+        return VK_NULL_HANDLE;
+    }
+
+    return command_buffer;
+}
+
+// submit a one shot command buffer, wait for it and free it
+VkResult end_one_shot(VkDevice device, VkCommandPool command_pool,
+        VkQueue queue, VkCommandBuffer command_buffer)
+{
+    VkResult result = vkEndCommandBuffer(command_buffer);
+
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    if (result == VK_SUCCESS)
+    {
+        result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+    }
+    if (result == VK_SUCCESS)
+    {
+        result = vkQueueWaitIdle(queue);
+    }
+
+    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+    return result;
+}
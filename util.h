@@ -2,14 +2,44 @@
 #define UTIL
 
 #include <SDL2/SDL.h>
+#include <vulkan.h>
 
 struct Vertex {
     float position[3];
     float color[3];
 };
 
+// per boid instance data uploaded every frame, 16 bytes
+struct Instance {
+    int16_t position[4];    // snorm, xyz over the world box, w unused
+    int8_t heading[4];      // snorm, xyz unit velocity, w speed / max speed
+    uint8_t color[4];       // unorm rgba
+};
+
 
 int die(SDL_Window * win, int status);
 
+// read a whole file (ie SPIR-V) into a malloced buffer, NULL on failure
+char * read_file(const char * path, size_t * size);
+
+// read every .spv file in dir (ie "shaders/") ahead of time, so load_shader
+// finds them in memory instead of on disk. run it before any load_shader
+// or after they are all done, the table is not locked. returns the count
+int shader_preload(const char * dir);
+
+// drop the preloaded files, load_shader reads from disk again
+void shader_preload_free(void);
+
+// load a SPIR-V file into a shader module made with host (or NULL), which
+// must go to its vkDestroyShaderModule too. VK_NULL_HANDLE on failure
+VkShaderModule load_shader(VkDevice device, const VkAllocationCallbacks * host,
+        const char * path);
+
+// record and submit a one off command buffer and wait for it to finish.
+// begin_one_shot returns VK_NULL_HANDLE on failure
+VkCommandBuffer begin_one_shot(VkDevice device, VkCommandPool command_pool);
+VkResult end_one_shot(VkDevice device, VkCommandPool command_pool,
+        VkQueue queue, VkCommandBuffer command_buffer);
+
 
 #endif